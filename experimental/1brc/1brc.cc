@@ -1,642 +1,874 @@
 #include <fcntl.h>
 #include <linux/mman.h>
+#include <sys/inotify.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 #include <algorithm>
-#include <array>
+#include <barrier>
+#include <cerrno>
 #include <chrono>
+#include <cmath>
+#include <cstring>
+#include <deque>
 #include <format>
+#include <fstream>
 #include <iostream>
+#include <optional>
+#include <string>
 #include <string_view>
 #include <thread>
+#include <tuple>
+#include <utility>
 #include <vector>
 
-#include "hwy/contrib/algo/find-inl.h"
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/usage.h"
+#include "absl/log/check.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_split.h"
+#include "experimental/1brc/accumulators.h"
+#include "experimental/1brc/block_reader.h"
+#include "experimental/1brc/checkpoint.h"
+#include "experimental/1brc/column_cache.h"
+#include "experimental/1brc/histogram.h"
+#include "experimental/1brc/morsel_queue.h"
+#include "experimental/1brc/perf_counters.h"
+#include "experimental/1brc/partial.h"
+#include "experimental/1brc/placement.h"
+#include "experimental/1brc/print.h"
+#include "experimental/1brc/record.h"
+#include "experimental/1brc/scan.h"
+#include "experimental/1brc/scan_stats.h"
+#include "experimental/1brc/station_table.h"
+#include "experimental/1brc/stations.h"
+#include "experimental/1brc/zstd_input.h"
 #include "hwy/contrib/thread_pool/topology.h"
-#include "third_party/mph/mph.h"
+#include "hwy/targets.h"
 
-namespace hn = hwy::HWY_NAMESPACE;
+ABSL_FLAG(bool, dynamic_stations, false,
+          "Discover station names at runtime instead of resolving them "
+          "against the built-in station list");
 
-using std::literals::operator""sv;
-using Clock = std::chrono::high_resolution_clock;
+ABSL_FLAG(std::string, scheduler, "morsel",
+          "How the input is split across threads: 'morsel' hands out small "
+          "newline-aligned chunks with work stealing, 'static' gives every "
+          "thread one equal slice");
 
-const hn::ScalableTag<uint8_t> kTag;
-const auto broadcasted = Set(kTag, ';');
+ABSL_FLAG(uint64_t, morsel_size, 4 << 20,
+          "Size in bytes of the chunks handed out by --scheduler=morsel");
 
-struct Record {
-  int sum;
-  int count;
-  int min;
-  int max;
-};
+ABSL_FLAG(std::string, accumulators, "auto",
+          "Layout of the per-thread 32-bit accumulators, flushed into 64-bit "
+          "totals before they can overflow: 'records' for an array of "
+          "Records, 'columns' for a struct of arrays, 'auto' for columns "
+          "with a small built-in station set and records otherwise");
 
-// Returns id for given city name.
-static int city_id(const char *name, size_t len);
+ABSL_FLAG(bool, report_threads, false,
+          "Print per-thread busy and idle time to stderr");
 
-// Returns name for given city id.
-static std::string_view city_name(int id);
+ABSL_FLAG(bool, stream, false,
+          "Read the input through a bounded set of block buffers instead of "
+          "mapping it. Always on for pipes and stdin");
 
-// Return total number of cities.
-static std::size_t city_count();
+ABSL_FLAG(uint64_t, stream_block_size, 16 << 20,
+          "Size in bytes of a block with --stream, a multiple of 4096");
 
-int main(int argc, char *agrv[]) {
-  auto tik = Clock::now();
+ABSL_FLAG(uint64_t, stream_buffer_size, 256 << 20,
+          "Total size in bytes of the block buffers with --stream");
 
-  const auto n_threads = std::thread::hardware_concurrency();
+ABSL_FLAG(std::string, compression, "auto",
+          "Compression of the input: 'zstd', 'none', or 'auto' for zstd if "
+          "the name ends in .zst. Multi-frame zstd files are decompressed "
+          "frame-parallel, anything else by the --stream reader thread");
 
-  hwy::LogicalProcessorSet lps;
-  lps.Set(n_threads - 1);
-  hwy::SetThreadAffinity(lps);
+ABSL_FLAG(bool, direct_io, true,
+          "Read regular files with O_DIRECT when streaming");
 
-  int fd = open("measurements.txt", O_RDONLY);
-  struct stat file_stat;
-  fstat(fd, &file_stat);
+ABSL_FLAG(std::string, parser, "branchy",
+          "Line parser: 'branchy' finds one ';' at a time and branches on the "
+          "temperature format, 'swar' finds all separators of a 64-byte window "
+          "at once and parses temperatures without branches");
+
+ABSL_FLAG(bool, report_targets, false,
+          "Before the run, time a single-threaded scan of up to "
+          "--report_targets_size bytes with every SIMD target the host "
+          "supports and print the throughput of each");
+
+ABSL_FLAG(uint64_t, report_targets_size, 1 << 30,
+          "Bytes scanned per target with --report_targets");
+
+ABSL_FLAG(std::string, build_cache, "",
+          "Parse the input into a columnar cache at this path and exit");
+
+ABSL_FLAG(std::string, cache, "",
+          "Answer from the columnar cache at this path, building it first "
+          "when it is missing or the input changed size or mtime");
+
+ABSL_FLAG(std::string, station, "",
+          "With --cache, only aggregate rows of this station");
+
+ABSL_FLAG(double, min_temp, -99.9,
+          "With --cache, only aggregate temperatures at or above this one");
+
+ABSL_FLAG(double, max_temp, 99.9,
+          "With --cache, only aggregate temperatures at or below this one");
+
+ABSL_FLAG(std::string, checkpoint, "",
+          "Resume from the totals and input offset saved at this path, if they "
+          "are for the same input file, aggregate only the bytes appended "
+          "since, and save the new totals back");
+
+ABSL_FLAG(bool, follow, false,
+          "After the run, watch the input for appends with inotify and "
+          "aggregate and print them as they come, until the file is removed, "
+          "replaced or truncated");
+
+ABSL_FLAG(bool, percentiles, false,
+          "Also report the exact median, 95th and 99th percentile per "
+          "station, from per-thread histograms of all temperatures");
+
+ABSL_FLAG(std::string, stats, "",
+          "Report per-thread counters of every run: 'json' writes bytes, rows, "
+          "parser fallbacks, chunk times, page faults and hardware counters "
+          "as one JSON object per line to --stats_file");
+
+ABSL_FLAG(std::string, stats_file, "",
+          "File the --stats report is appended to, stderr if empty");
+
+ABSL_FLAG(std::string, range, "",
+          "Only aggregate the lines that start in byte range BEGIN:END of the "
+          "input, END defaulting to its size. Adjacent ranges split the lines "
+          "exactly, so that separate processes can share one file");
+
+ABSL_FLAG(std::string, partial_out, "",
+          "Write the totals to this file as a partial aggregate instead of "
+          "printing them, for combining with those of other runs by `merge`");
+
+using Clock = std::chrono::high_resolution_clock;
+
+using g5::brc::city_count;
+using g5::brc::city_name;
+using g5::brc::kEmptyRecord;
+using g5::brc::kEmptyWideRecord;
+using g5::brc::Record;
+using g5::brc::WideRecord;
+
+// Per-thread scheduling statistics.
+struct alignas(64) WorkerStats {
+  Clock::time_point start;
+  Clock::time_point stop;
+  std::chrono::duration<double> busy{};
+  int morsels = 0;
+
+  // Collected with --stats only.
+  uint64_t bytes = 0;
+  g5::brc::ScanStats scan;
+  // Start and end of every morsel or block.
+  std::vector<std::pair<Clock::time_point, Clock::time_point>> chunks;
+  g5::brc::PerfCounters::Values perf;
+};
+
+// Writes the --stats=json report of one Aggregate() call, started at `t0`, as
+// a single line.
+static void WriteStats(std::ostream &out, Clock::time_point t0,
+                       Clock::time_point done, g5::brc::Parser parser,
+                       bool dynamic_stations,
+                       const std::vector<g5::brc::WorkerPlacement> &placement,
+                       const std::vector<WorkerStats> &stats,
+                       const g5::brc::MorselQueue *queue) {
+  auto seconds = [t0](Clock::time_point t) {
+    return std::format("{:.6f}",
+                       std::chrono::duration<double>(t - t0).count());
+  };
+
+  uint64_t bytes = 0;
+  uint64_t rows = 0;
+  for (const auto &s : stats) {
+    bytes += s.bytes;
+    rows += s.scan.rows;
+  }
+  std::string json = std::format(
+      R"({{"parser":"{}","stations":"{}","target":"{}","threads":{},)"
+      R"("elapsed_s":{},"bytes":{},"rows":{},"workers":[)",
+      parser == g5::brc::Parser::kSwar ? "swar" : "branchy",
+      dynamic_stations ? "dynamic" : "static", g5::brc::ScanTargetName(),
+      stats.size(), seconds(done), bytes, rows);
+  for (size_t tid = 0; tid < stats.size(); ++tid) {
+    const auto &s = stats[tid];
+    json += std::format(
+        R"({}{{"tid":{},"lp":{},"group":{},"bytes":{},"rows":{},)"
+        R"("second_vector_probes":{},"memchr_fallbacks":{},"morsels":{},)"
+        R"("steals":{},"busy_s":{:.6f},"start_s":{},"stop_s":{},)"
+        R"("minor_faults":{},"major_faults":{},"perf":{{)",
+        tid == 0 ? "" : ",", tid, placement[tid].lp, placement[tid].group,
+        s.bytes, s.scan.rows, s.scan.second_vector_probes,
+        s.scan.memchr_fallbacks, s.morsels, queue ? queue->steals(tid) : 0,
+        s.busy.count(), seconds(s.start), seconds(s.stop),
+        s.perf.minor_faults, s.perf.major_faults);
+    // Events the host doesn't count are null.
+    for (int i = 0; i < g5::brc::PerfCounters::kEvents; ++i) {
+      const auto &count = s.perf.events[i];
+      json += std::format(R"({}"{}":{})", i == 0 ? "" : ",",
+                          g5::brc::PerfCounters::kNames[i],
+                          count ? std::to_string(*count) : "null");
+    }
+    json += R"(},"chunks":[)";
+    for (size_t i = 0; i < s.chunks.size(); ++i) {
+      json += std::format("{}[{},{}]", i == 0 ? "" : ",",
+                          seconds(s.chunks[i].first),
+                          seconds(s.chunks[i].second));
+    }
+    json += "]}";
+  }
+  json += "]}";
+  out << json << std::endl;
+}
+
+// Prints single-threaded scan throughput over the head of the input for each
+// SIMD target supported by both the binary and the host.
+static void ReportTargets(const char *data, size_t size, g5::brc::Parser parser,
+                          bool dynamic_stations) {
+  size = std::min<size_t>(size, absl::GetFlag(FLAGS_report_targets_size));
+  while (size > 0 && data[size - 1] != '\n') {
+    --size;
+  }
 
-  size_t file_size = file_stat.st_size;
-  const char *data = reinterpret_cast<const char *>(
-      mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE | MAP_HUGE_1GB, fd, 0));
+  for (const auto &target : g5::brc::SupportedScanTargets()) {
+    g5::brc::StationTable table;
+    std::vector<Record> records(dynamic_stations ? 0 : city_count(),
+                                kEmptyRecord);
+    const auto t0 = Clock::now();
+    if (dynamic_stations) {
+      target.scan_dynamic(data, data + size, parser, &table, &records,
+                          nullptr, nullptr);
+    } else {
+      target.scan_static(data, data + size, parser, records.data(), nullptr,
+                         nullptr);
+    }
+    const std::chrono::duration<double> elapsed = Clock::now() - t0;
 
-  std::vector<std::vector<Record>> records(n_threads,
-                                           std::vector<Record>{city_count()});
-  size_t chunk_size = file_size / n_threads;
+    size_t n_rows = 0;
+    for (const auto &rec : records) {
+      n_rows += rec.count;
+    }
+    std::cerr << std::format("Target {:>8}: {:.1f}M rows/s, {:.2f} GB/s",
+                             hwy::TargetName(target.target),
+                             n_rows / elapsed.count() / 1e6,
+                             size / elapsed.count() / 1e9)
+              << std::endl;
+  }
+}
 
+// Answers from the columnar cache at `path` for the input `data` of file
+// status `source`, building the cache first if needed.
+static void QueryCache(const std::string &path, const char *data,
+                       const struct stat &source, g5::brc::Parser parser,
+                       int n_threads) {
+  auto cache = g5::brc::ColumnCache::Open(path, source);
+  if (cache == nullptr) {
+    std::cerr << "Building cache " << path << std::endl;
+    g5::brc::BuildColumnCache(data, source.st_size, source, parser, n_threads,
+                              path);
+    cache = g5::brc::ColumnCache::Open(path, source);
+    CHECK(cache != nullptr) << "Input changed while building " << path;
+  }
+
+  const auto t0 = Clock::now();
+  g5::brc::CacheQuery query;
+  query.station = absl::GetFlag(FLAGS_station);
+  query.min_temperature = std::lround(absl::GetFlag(FLAGS_min_temp) * 10);
+  query.max_temperature = std::lround(absl::GetFlag(FLAGS_max_temp) * 10);
+  g5::brc::CacheQueryStats stats;
+  g5::brc::PrintResults(cache->Query(query, n_threads, &stats));
+  const std::chrono::duration<double> elapsed = Clock::now() - t0;
+
+  std::cerr << std::format("Query: {:.3f}s, {} rows, {} groups skipped, {} "
+                           "from stats, {} scanned",
+                           elapsed.count(), cache->rows(), stats.groups_skipped,
+                           stats.groups_from_stats, stats.groups_scanned)
+            << std::endl;
+}
+
+// Aggregates the rows in [data, data + size), or all of `fd` if `stream` is
+// set, zstd compressed if `zstd` is set, into `totals` with one worker per
+// entry of `placement`, with histograms if `totals` keeps them. Writes the
+// --stats report to `stats_out` if not null. Returns number of bytes parsed.
+static uint64_t Aggregate(
+    const char *data, size_t size, int fd, bool stream, bool zstd,
+    g5::brc::Parser parser, bool dynamic_stations,
+    const std::vector<g5::brc::WorkerPlacement> &placement,
+    g5::brc::Checkpoint *totals, std::ostream *stats_out = nullptr) {
+  const auto t0 = Clock::now();
+  const int n_threads = placement.size();
+  const bool collect = stats_out != nullptr;
+  const bool percentiles = totals->percentiles();
+  const std::string accumulators = absl::GetFlag(FLAGS_accumulators);
+  // The runtime station set can grow past the point where columns lose, see
+  // kHotColumnsMaxStations.
+  const bool columns =
+      accumulators == "columns" ||
+      (accumulators == "auto" && !dynamic_stations && !percentiles &&
+       city_count() <= g5::brc::kHotColumnsMaxStations);
+
+  // With --dynamic_stations, records are indexed by the ids of the thread's
+  // own station table and grow as new stations show up. Both are allocated by
+  // their worker once pinned, so that first touch puts them on its NUMA node.
+  // Histograms, with --percentiles, are indexed like the records. These are
+  // the 64-bit totals of a thread, the 32-bit accumulators it scans into are
+  // its own.
+  std::vector<std::vector<WideRecord>> records(n_threads);
+  std::vector<std::vector<g5::brc::Histogram>> histograms(n_threads);
+  std::vector<g5::brc::StationTable> tables(dynamic_stations ? n_threads : 0);
+  std::vector<WorkerStats> stats(n_threads);
+
+  // Workers of a group reduce their records in a tree, then the calling thread
+  // combines the group leaders, so only one partial per node crosses nodes.
+  // The calling thread itself stays unpinned, it only waits until then.
+  std::vector<std::vector<int>> groups;
+  std::vector<int> group_of(n_threads);
   {
-    std::vector<std::jthread> threads;
-    const char *end;
-    const char *file_end = data + file_size;
+    std::vector<int> group_index;
     for (int tid = 0; tid < n_threads; ++tid) {
-      end = data + chunk_size;
-      while ((*end != '\n') && (end < file_end))
-        ++end;
-
-      threads.emplace_back(std::jthread{
-          [tid, &records](const char *data, const char *end) {
-            hwy::LogicalProcessorSet lps;
-            lps.Set(tid);
-            hwy::SetThreadAffinity(lps);
-
-            for (;;) {
-              if (data >= end) {
-                break;
-              }
-
-              auto mask =
-                  Eq(broadcasted,
-                     LoadU(kTag, reinterpret_cast<const uint8_t *>(data)));
-
-              auto pos = FindFirstTrue(kTag, mask);
-              if (pos < 0) {
-                // Probe one more vector to find the end of city name.
-                mask = Eq(broadcasted,
-                          LoadU(kTag, reinterpret_cast<const uint8_t *>(
-                                          data + hn::Lanes(kTag))));
-                pos = FindFirstTrue(kTag, mask);
-                if (pos < 0) {
-                  break;
-                }
-                pos += hn::Lanes(kTag);
-              }
-
-              for (; pos >= 0; pos = FindFirstTrue(kTag, mask)) {
-                auto &rec = records[tid][city_id(data, pos)];
-                data += pos + 1;
-                size_t offset = pos + 1;
-
-                int val;
-                if (data[1] == '.') {
-                  val = data[0] * 10 + data[2] - '0' * 11;
-                  data += 4;
-                  offset += 4;
-                } else if (data[2] == '.') {
-                  if (data[0] == '-') {
-                    val = -(data[1] * 10 + data[3] - '0' * 11);
-                  } else {
-                    val = data[0] * 100 + data[1] * 10 + data[3] - '0' * 111;
-                  }
-                  data += 5;
-                  offset += 5;
-                } else {
-                  val = -(data[1] * 100 + data[2] * 10 + data[4] - '0' * 111);
-                  data += 6;
-                  offset += 6;
-                }
-
-                rec.max = std::max(rec.max, val);
-                rec.min = std::max(rec.min, -val);
-                rec.sum += val;
-                rec.count += 1;
-
-                mask = SlideMaskDownLanes(kTag, mask, offset);
-              }
-            }
-          },
-          data, end});
-      data = end + 1;
+      const int group = placement[tid].group;
+      if (group >= group_index.size()) {
+        group_index.resize(group + 1, -1);
+      }
+      if (group_index[group] < 0) {
+        group_index[group] = groups.size();
+        groups.emplace_back();
+      }
+      group_of[tid] = group_index[group];
+      groups[group_of[tid]].push_back(tid);
     }
   }
+  std::deque<std::barrier<>> barriers;
+  for (const auto &members : groups) {
+    barriers.emplace_back(members.size());
+  }
+
+  // Merges the records of worker `src` into those of worker `dst`.
+  auto merge_into = [dynamic_stations, percentiles, &records, &histograms,
+                     &tables](int dst, int src) {
+    for (int j = 0; j < records[src].size(); ++j) {
+      int id = j;
+      if (dynamic_stations) {
+        const auto name = tables[src].name(j);
+        id = tables[dst].FindOrInsert(name.data(), name.size());
+        if (id >= records[dst].size()) {
+          records[dst].resize(id + 1, kEmptyWideRecord);
+          histograms[dst].resize(percentiles ? id + 1 : 0);
+        }
+      }
+      g5::brc::Merge(records[dst][id], records[src][j]);
+      if (percentiles) {
+        histograms[dst][id].Merge(histograms[src][j]);
+      }
+    }
+  };
+
+  // A static split is a morsel queue with one morsel per thread.
+  const size_t morsel_size = absl::GetFlag(FLAGS_scheduler) == "static"
+                                 ? (size + n_threads - 1) / n_threads
+                                 : absl::GetFlag(FLAGS_morsel_size);
+  const size_t block_size = absl::GetFlag(FLAGS_stream_block_size);
+  const int n_buffers = std::max<size_t>(
+      absl::GetFlag(FLAGS_stream_buffer_size) / block_size, 2);
+  std::optional<g5::brc::MorselQueue> queue;
+  std::optional<g5::brc::BlockReader> reader;
+  std::optional<g5::brc::ZstdFrameQueue> frames;
+  if (zstd && !stream) {
+    auto split = g5::brc::SplitZstdFrames(data, size);
+    if (split.size() > 1) {
+      frames.emplace(std::move(split));
+    }
+  }
+  if (frames) {
+    // Decompressed by the workers.
+  } else if (zstd) {
+    reader.emplace(stream ? g5::brc::ZstdSource(fd)
+                          : g5::brc::ZstdSource(std::string_view(data, size)),
+                   block_size, n_buffers);
+  } else if (stream) {
+    reader.emplace(fd, block_size, n_buffers, absl::GetFlag(FLAGS_direct_io));
+  } else {
+    queue.emplace(data, size, morsel_size, n_threads);
+  }
 
-  // Gather results from all the threads.
-  for (int i = 1; i < records.size(); ++i) {
-    for (int j = 0; j < records[0].size(); ++j) {
-      records[0][j].count += records[i][j].count;
-      records[0][j].sum += records[i][j].sum;
-      records[0][j].max = std::max(records[0][j].max, records[i][j].max);
-      records[0][j].min = std::max(records[0][j].min, records[i][j].min);
+  {
+    std::vector<std::jthread> threads;
+    for (int tid = 0; tid < n_threads; ++tid) {
+      threads.emplace_back([tid, dynamic_stations, percentiles, columns,
+                            parser, collect, &placement, &groups, &group_of,
+                            &barriers, &merge_into, &records, &histograms,
+                            &tables, &stats, &queue, &reader, &frames] {
+        hwy::LogicalProcessorSet lps;
+        lps.Set(placement[tid].lp);
+        hwy::SetThreadAffinity(lps);
+
+        auto &thread_records = records[tid];
+        auto &thread_histograms = histograms[tid];
+        std::vector<Record> hot_records;
+        g5::brc::HotColumns hot_columns;
+        if (dynamic_stations) {
+          tables[tid] = g5::brc::StationTable();
+        } else {
+          thread_records.assign(city_count(), kEmptyWideRecord);
+          thread_histograms.resize(percentiles ? city_count() : 0);
+          if (columns) {
+            hot_columns.Resize(city_count());
+          } else {
+            hot_records.assign(city_count(), kEmptyRecord);
+          }
+        }
+        auto &thread_stats = stats[tid];
+        g5::brc::ScanStats *scan_stats =
+            collect ? &thread_stats.scan : nullptr;
+        auto scan = [&](const char *begin, const char *end) {
+          if (columns && dynamic_stations) {
+            g5::brc::ScanDynamicColumns(begin, end, parser, &tables[tid],
+                                        &hot_columns, scan_stats);
+          } else if (columns) {
+            g5::brc::ScanStaticColumns(begin, end, parser, &hot_columns,
+                                       scan_stats);
+          } else if (dynamic_stations) {
+            g5::brc::ScanDynamic(begin, end, parser, &tables[tid],
+                                 &hot_records,
+                                 percentiles ? &thread_histograms : nullptr,
+                                 scan_stats);
+          } else {
+            g5::brc::ScanStatic(
+                begin, end, parser, hot_records.data(),
+                percentiles ? thread_histograms.data() : nullptr, scan_stats);
+          }
+        };
+        auto flush = [&] {
+          if (columns) {
+            hot_columns.FlushInto(&thread_records);
+          } else {
+            g5::brc::FlushInto(&hot_records, &thread_records);
+          }
+        };
+        g5::brc::FlushBudget budget;
+        auto process = [&](const char *begin, const char *end) {
+          const auto t0 = Clock::now();
+          budget.Scan(begin, end, scan, flush);
+          const auto t1 = Clock::now();
+          thread_stats.busy += t1 - t0;
+          thread_stats.morsels += 1;
+          if (collect) {
+            thread_stats.bytes += end - begin;
+            thread_stats.chunks.emplace_back(t0, t1);
+          }
+        };
+
+        std::optional<g5::brc::PerfCounters> perf;
+        if (collect) {
+          perf.emplace();
+          perf->Start();
+        }
+        thread_stats.start = Clock::now();
+        if (reader) {
+          g5::brc::BlockReader::Block block;
+          while (reader->Next(&block)) {
+            process(block.begin, block.end);
+            reader->Release(block);
+          }
+        } else if (frames) {
+          std::string buffer;
+          const char *begin;
+          const char *end;
+          while (frames->Next(&buffer, &begin, &end)) {
+            process(begin, end);
+          }
+        } else {
+          g5::brc::MorselQueue::Morsel morsel;
+          while (queue->Next(tid, &morsel)) {
+            process(morsel.begin, morsel.end);
+          }
+        }
+        flush();
+        thread_stats.stop = Clock::now();
+        if (perf) {
+          thread_stats.perf = perf->Stop();
+        }
+
+        // In round k, every 2^(k+1)-th member of the group takes in the
+        // records of the member 2^k ranks above it.
+        const auto &members = groups[group_of[tid]];
+        auto &barrier = barriers[group_of[tid]];
+        const size_t rank = std::ranges::find(members, tid) - members.begin();
+        for (size_t stride = 1; stride < members.size(); stride *= 2) {
+          barrier.arrive_and_wait();
+          if (rank % (2 * stride) == 0 && rank + stride < members.size()) {
+            merge_into(tid, members[rank + stride]);
+          }
+        }
+      });
     }
   }
 
-  std::cout << "{";
+  if (absl::GetFlag(FLAGS_report_threads)) {
+    // Idle time covers both looking for work and waiting for the slowest
+    // thread to finish.
+    const auto done = std::ranges::max(stats, {}, &WorkerStats::stop).stop;
+    for (int tid = 0; tid < n_threads; ++tid) {
+      const auto &s = stats[tid];
+      const std::chrono::duration<double> idle = done - s.start - s.busy;
+      std::cerr << std::format(
+                       "Thread {:3}: busy {:.3f}s, idle {:.3f}s, {} morsels "
+                       "({} steals)",
+                       tid, s.busy.count(), idle.count(), s.morsels,
+                       queue ? queue->steals(tid) : 0)
+                << std::endl;
+    }
+  }
 
-  bool is_first = true;
-  for (int i = 0; i < records[0].size(); ++i) {
-    const auto &rec = records[0][i];
-    const auto &name = city_name(i);
-    if (is_first) {
-      std::cout << std::format("{}={:.1f}/{:.1f}/{:.1f}", name, -rec.min / 10.0,
-                               rec.sum / 10.0 / rec.count, rec.max / 10.0);
-      is_first = false;
+  // Combine the per-group results into the leader of the first group.
+  const int leader = groups[0][0];
+  for (int g = 1; g < groups.size(); ++g) {
+    merge_into(leader, groups[g][0]);
+  }
+  if (frames) {
+    // The few lines split across frames.
+    std::string buffer;
+    const char *begin;
+    const char *end;
+    frames->Seams(&buffer, &begin, &end);
+    std::vector<Record> hot(
+        dynamic_stations ? tables[leader].size() : city_count(), kEmptyRecord);
+    if (dynamic_stations) {
+      g5::brc::ScanDynamic(begin, end, parser, &tables[leader], &hot,
+                           percentiles ? &histograms[leader] : nullptr);
     } else {
-      std::cout << std::format(", {}={:.1f}/{:.1f}/{:.1f}", name,
-                               -rec.min / 10.0, rec.sum / 10.0 / rec.count,
-                               rec.max / 10.0);
+      g5::brc::ScanStatic(begin, end, parser, hot.data(),
+                          percentiles ? histograms[leader].data() : nullptr);
+    }
+    g5::brc::FlushInto(&hot, &records[leader]);
+  }
+  for (int i = 0; i < records[leader].size(); ++i) {
+    if (records[leader][i].count > 0) {
+      totals->Add(dynamic_stations ? tables[leader].name(i) : city_name(i),
+                  records[leader][i],
+                  percentiles ? &histograms[leader][i] : nullptr);
     }
   }
 
-  std::cout << "}" << std::endl;
+  if (collect) {
+    WriteStats(*stats_out, t0, Clock::now(), parser, dynamic_stations,
+               placement, stats, queue ? &*queue : nullptr);
+  }
 
-  auto tok = Clock::now();
-  std::cerr << "Time used: " << std::chrono::duration<double>(tok - tik)
-            << std::endl;
+  if (frames) {
+    return frames->bytes();
+  }
+  return reader ? reader->bytes_read() : size;
+}
 
-  return 0;
+// Returns the end of the last complete line in [data + begin, data + end), or
+// `begin` if there is none.
+static uint64_t LastLineEnd(const char *data, uint64_t begin, uint64_t end) {
+  const void *nl = memrchr(data + begin, '\n', end - begin);
+  return nl ? static_cast<const char *>(nl) - data + 1 : begin;
 }
 
-static constexpr auto _names = std::array{
-    "Abha"sv,
-    "Abidjan"sv,
-    "Abéché"sv,
-    "Accra"sv,
-    "Addis Ababa"sv,
-    "Adelaide"sv,
-    "Aden"sv,
-    "Ahvaz"sv,
-    "Albuquerque"sv,
-    "Alexandra"sv,
-    "Alexandria"sv,
-    "Algiers"sv,
-    "Alice Springs"sv,
-    "Almaty"sv,
-    "Amsterdam"sv,
-    "Anadyr"sv,
-    "Anchorage"sv,
-    "Andorra la Vella"sv,
-    "Ankara"sv,
-    "Antananarivo"sv,
-    "Antsiranana"sv,
-    "Arkhangelsk"sv,
-    "Ashgabat"sv,
-    "Asmara"sv,
-    "Assab"sv,
-    "Astana"sv,
-    "Athens"sv,
-    "Atlanta"sv,
-    "Auckland"sv,
-    "Austin"sv,
-    "Baghdad"sv,
-    "Baguio"sv,
-    "Baku"sv,
-    "Baltimore"sv,
-    "Bamako"sv,
-    "Bangkok"sv,
-    "Bangui"sv,
-    "Banjul"sv,
-    "Barcelona"sv,
-    "Bata"sv,
-    "Batumi"sv,
-    "Beijing"sv,
-    "Beirut"sv,
-    "Belgrade"sv,
-    "Belize City"sv,
-    "Benghazi"sv,
-    "Bergen"sv,
-    "Berlin"sv,
-    "Bilbao"sv,
-    "Birao"sv,
-    "Bishkek"sv,
-    "Bissau"sv,
-    "Blantyre"sv,
-    "Bloemfontein"sv,
-    "Boise"sv,
-    "Bordeaux"sv,
-    "Bosaso"sv,
-    "Boston"sv,
-    "Bouaké"sv,
-    "Bratislava"sv,
-    "Brazzaville"sv,
-    "Bridgetown"sv,
-    "Brisbane"sv,
-    "Brussels"sv,
-    "Bucharest"sv,
-    "Budapest"sv,
-    "Bujumbura"sv,
-    "Bulawayo"sv,
-    "Burnie"sv,
-    "Busan"sv,
-    "Cabo San Lucas"sv,
-    "Cairns"sv,
-    "Cairo"sv,
-    "Calgary"sv,
-    "Canberra"sv,
-    "Cape Town"sv,
-    "Changsha"sv,
-    "Charlotte"sv,
-    "Chiang Mai"sv,
-    "Chicago"sv,
-    "Chihuahua"sv,
-    "Chittagong"sv,
-    "Chișinău"sv,
-    "Chongqing"sv,
-    "Christchurch"sv,
-    "City of San Marino"sv,
-    "Colombo"sv,
-    "Columbus"sv,
-    "Conakry"sv,
-    "Copenhagen"sv,
-    "Cotonou"sv,
-    "Cracow"sv,
-    "Da Lat"sv,
-    "Da Nang"sv,
-    "Dakar"sv,
-    "Dallas"sv,
-    "Damascus"sv,
-    "Dampier"sv,
-    "Dar es Salaam"sv,
-    "Darwin"sv,
-    "Denpasar"sv,
-    "Denver"sv,
-    "Detroit"sv,
-    "Dhaka"sv,
-    "Dikson"sv,
-    "Dili"sv,
-    "Djibouti"sv,
-    "Dodoma"sv,
-    "Dolisie"sv,
-    "Douala"sv,
-    "Dubai"sv,
-    "Dublin"sv,
-    "Dunedin"sv,
-    "Durban"sv,
-    "Dushanbe"sv,
-    "Edinburgh"sv,
-    "Edmonton"sv,
-    "El Paso"sv,
-    "Entebbe"sv,
-    "Erbil"sv,
-    "Erzurum"sv,
-    "Fairbanks"sv,
-    "Fianarantsoa"sv,
-    "Flores,  Petén"sv,
-    "Frankfurt"sv,
-    "Fresno"sv,
-    "Fukuoka"sv,
-    "Gaborone"sv,
-    "Gabès"sv,
-    "Gagnoa"sv,
-    "Gangtok"sv,
-    "Garissa"sv,
-    "Garoua"sv,
-    "George Town"sv,
-    "Ghanzi"sv,
-    "Gjoa Haven"sv,
-    "Guadalajara"sv,
-    "Guangzhou"sv,
-    "Guatemala City"sv,
-    "Halifax"sv,
-    "Hamburg"sv,
-    "Hamilton"sv,
-    "Hanga Roa"sv,
-    "Hanoi"sv,
-    "Harare"sv,
-    "Harbin"sv,
-    "Hargeisa"sv,
-    "Hat Yai"sv,
-    "Havana"sv,
-    "Helsinki"sv,
-    "Heraklion"sv,
-    "Hiroshima"sv,
-    "Ho Chi Minh City"sv,
-    "Hobart"sv,
-    "Hong Kong"sv,
-    "Honiara"sv,
-    "Honolulu"sv,
-    "Houston"sv,
-    "Ifrane"sv,
-    "Indianapolis"sv,
-    "Iqaluit"sv,
-    "Irkutsk"sv,
-    "Istanbul"sv,
-    "Jacksonville"sv,
-    "Jakarta"sv,
-    "Jayapura"sv,
-    "Jerusalem"sv,
-    "Johannesburg"sv,
-    "Jos"sv,
-    "Juba"sv,
-    "Kabul"sv,
-    "Kampala"sv,
-    "Kandi"sv,
-    "Kankan"sv,
-    "Kano"sv,
-    "Kansas City"sv,
-    "Karachi"sv,
-    "Karonga"sv,
-    "Kathmandu"sv,
-    "Khartoum"sv,
-    "Kingston"sv,
-    "Kinshasa"sv,
-    "Kolkata"sv,
-    "Kuala Lumpur"sv,
-    "Kumasi"sv,
-    "Kunming"sv,
-    "Kuopio"sv,
-    "Kuwait City"sv,
-    "Kyiv"sv,
-    "Kyoto"sv,
-    "La Ceiba"sv,
-    "La Paz"sv,
-    "Lagos"sv,
-    "Lahore"sv,
-    "Lake Havasu City"sv,
-    "Lake Tekapo"sv,
-    "Las Palmas de Gran Canaria"sv,
-    "Las Vegas"sv,
-    "Launceston"sv,
-    "Lhasa"sv,
-    "Libreville"sv,
-    "Lisbon"sv,
-    "Livingstone"sv,
-    "Ljubljana"sv,
-    "Lodwar"sv,
-    "Lomé"sv,
-    "London"sv,
-    "Los Angeles"sv,
-    "Louisville"sv,
-    "Luanda"sv,
-    "Lubumbashi"sv,
-    "Lusaka"sv,
-    "Luxembourg City"sv,
-    "Lviv"sv,
-    "Lyon"sv,
-    "Madrid"sv,
-    "Mahajanga"sv,
-    "Makassar"sv,
-    "Makurdi"sv,
-    "Malabo"sv,
-    "Malé"sv,
-    "Managua"sv,
-    "Manama"sv,
-    "Mandalay"sv,
-    "Mango"sv,
-    "Manila"sv,
-    "Maputo"sv,
-    "Marrakesh"sv,
-    "Marseille"sv,
-    "Maun"sv,
-    "Medan"sv,
-    "Mek'ele"sv,
-    "Melbourne"sv,
-    "Memphis"sv,
-    "Mexicali"sv,
-    "Mexico City"sv,
-    "Miami"sv,
-    "Milan"sv,
-    "Milwaukee"sv,
-    "Minneapolis"sv,
-    "Minsk"sv,
-    "Mogadishu"sv,
-    "Mombasa"sv,
-    "Monaco"sv,
-    "Moncton"sv,
-    "Monterrey"sv,
-    "Montreal"sv,
-    "Moscow"sv,
-    "Mumbai"sv,
-    "Murmansk"sv,
-    "Muscat"sv,
-    "Mzuzu"sv,
-    "N'Djamena"sv,
-    "Naha"sv,
-    "Nairobi"sv,
-    "Nakhon Ratchasima"sv,
-    "Napier"sv,
-    "Napoli"sv,
-    "Nashville"sv,
-    "Nassau"sv,
-    "Ndola"sv,
-    "New Delhi"sv,
-    "New Orleans"sv,
-    "New York City"sv,
-    "Ngaoundéré"sv,
-    "Niamey"sv,
-    "Nicosia"sv,
-    "Niigata"sv,
-    "Nouadhibou"sv,
-    "Nouakchott"sv,
-    "Novosibirsk"sv,
-    "Nuuk"sv,
-    "Odesa"sv,
-    "Odienné"sv,
-    "Oklahoma City"sv,
-    "Omaha"sv,
-    "Oranjestad"sv,
-    "Oslo"sv,
-    "Ottawa"sv,
-    "Ouagadougou"sv,
-    "Ouahigouya"sv,
-    "Ouarzazate"sv,
-    "Oulu"sv,
-    "Palembang"sv,
-    "Palermo"sv,
-    "Palm Springs"sv,
-    "Palmerston North"sv,
-    "Panama City"sv,
-    "Parakou"sv,
-    "Paris"sv,
-    "Perth"sv,
-    "Petropavlovsk-Kamchatsky"sv,
-    "Philadelphia"sv,
-    "Phnom Penh"sv,
-    "Phoenix"sv,
-    "Pittsburgh"sv,
-    "Podgorica"sv,
-    "Pointe-Noire"sv,
-    "Pontianak"sv,
-    "Port Moresby"sv,
-    "Port Sudan"sv,
-    "Port Vila"sv,
-    "Port-Gentil"sv,
-    "Portland (OR)"sv,
-    "Porto"sv,
-    "Prague"sv,
-    "Praia"sv,
-    "Pretoria"sv,
-    "Pyongyang"sv,
-    "Rabat"sv,
-    "Rangpur"sv,
-    "Reggane"sv,
-    "Reykjavík"sv,
-    "Riga"sv,
-    "Riyadh"sv,
-    "Rome"sv,
-    "Roseau"sv,
-    "Rostov-on-Don"sv,
-    "Sacramento"sv,
-    "Saint Petersburg"sv,
-    "Saint-Pierre"sv,
-    "Salt Lake City"sv,
-    "San Antonio"sv,
-    "San Diego"sv,
-    "San Francisco"sv,
-    "San Jose"sv,
-    "San José"sv,
-    "San Juan"sv,
-    "San Salvador"sv,
-    "Sana'a"sv,
-    "Santo Domingo"sv,
-    "Sapporo"sv,
-    "Sarajevo"sv,
-    "Saskatoon"sv,
-    "Seattle"sv,
-    "Seoul"sv,
-    "Seville"sv,
-    "Shanghai"sv,
-    "Singapore"sv,
-    "Skopje"sv,
-    "Sochi"sv,
-    "Sofia"sv,
-    "Sokoto"sv,
-    "Split"sv,
-    "St. John's"sv,
-    "St. Louis"sv,
-    "Stockholm"sv,
-    "Surabaya"sv,
-    "Suva"sv,
-    "Suwałki"sv,
-    "Sydney"sv,
-    "Ségou"sv,
-    "Tabora"sv,
-    "Tabriz"sv,
-    "Taipei"sv,
-    "Tallinn"sv,
-    "Tamale"sv,
-    "Tamanrasset"sv,
-    "Tampa"sv,
-    "Tashkent"sv,
-    "Tauranga"sv,
-    "Tbilisi"sv,
-    "Tegucigalpa"sv,
-    "Tehran"sv,
-    "Tel Aviv"sv,
-    "Thessaloniki"sv,
-    "Thiès"sv,
-    "Tijuana"sv,
-    "Timbuktu"sv,
-    "Tirana"sv,
-    "Toamasina"sv,
-    "Tokyo"sv,
-    "Toliara"sv,
-    "Toluca"sv,
-    "Toronto"sv,
-    "Tripoli"sv,
-    "Tromsø"sv,
-    "Tucson"sv,
-    "Tunis"sv,
-    "Ulaanbaatar"sv,
-    "Upington"sv,
-    "Vaduz"sv,
-    "Valencia"sv,
-    "Valletta"sv,
-    "Vancouver"sv,
-    "Veracruz"sv,
-    "Vienna"sv,
-    "Vientiane"sv,
-    "Villahermosa"sv,
-    "Vilnius"sv,
-    "Virginia Beach"sv,
-    "Vladivostok"sv,
-    "Warsaw"sv,
-    "Washington, D.C."sv,
-    "Wau"sv,
-    "Wellington"sv,
-    "Whitehorse"sv,
-    "Wichita"sv,
-    "Willemstad"sv,
-    "Winnipeg"sv,
-    "Wrocław"sv,
-    "Xi'an"sv,
-    "Yakutsk"sv,
-    "Yangon"sv,
-    "Yaoundé"sv,
-    "Yellowknife"sv,
-    "Yerevan"sv,
-    "Yinchuan"sv,
-    "Zagreb"sv,
-    "Zanzibar City"sv,
-    "Zürich"sv,
-    "Ürümqi"sv,
-    "İzmir"sv,
-};
+// Returns the [begin, end) offsets of the lines that start in byte range
+// `range`, "BEGIN:END" or "BEGIN:", of the `size` bytes at `data`.
+static std::pair<uint64_t, uint64_t> LineRange(const char *data, uint64_t size,
+                                               const std::string &range) {
+  const std::pair<std::string, std::string> bounds =
+      absl::StrSplit(range, absl::MaxSplits(':', 1));
+  uint64_t begin;
+  uint64_t end = size;
+  CHECK(absl::SimpleAtoi(bounds.first, &begin) &&
+        (bounds.second.empty() || absl::SimpleAtoi(bounds.second, &end)) &&
+        begin <= end)
+      << "Invalid --range: " << range;
+
+  // A line belongs to the range its first byte is in.
+  auto line_start = [data, size](uint64_t pos) -> uint64_t {
+    if (pos == 0 || pos >= size) {
+      return std::min(pos, size);
+    }
+    const void *nl = memchr(data + pos - 1, '\n', size - pos + 1);
+    return nl ? static_cast<const char *>(nl) - data + 1 : size;
+  };
+  return {line_start(begin), line_start(end)};
+}
 
-static constexpr uint32_t o1hash(const char *s, size_t len) {
-  static_assert(HWY_IS_LITTLE_ENDIAN, "Only support little endian");
-
-  if consteval {
-    if (len >= 4) {
-      uint32_t first = (std::bit_cast<uint8_t>(s[3]) << 24) +
-                       (std::bit_cast<uint8_t>(s[2]) << 16) +
-                       (std::bit_cast<uint8_t>(s[1]) << 8) +
-                       std::bit_cast<uint8_t>(s[0]),
-               last = (std::bit_cast<uint8_t>(s[len - 1]) << 24) +
-                      (std::bit_cast<uint8_t>(s[len - 2]) << 16) +
-                      (std::bit_cast<uint8_t>(s[len - 3]) << 8) +
-                      std::bit_cast<uint8_t>(s[len - 4]);
-      return first + last;
-    } else if (len) {
-      return (std::bit_cast<uint8_t>(s[0]) << 16) |
-             std::bit_cast<uint8_t>(s[len - 1]);
+// Returns whether the input at `path` is zstd compressed, as per
+// --compression.
+static bool IsZstdInput(const std::string &path) {
+  const std::string compression = absl::GetFlag(FLAGS_compression);
+  return compression == "zstd" ||
+         (compression == "auto" && path.ends_with(".zst"));
+}
+
+// Aggregates all of the input at `path` into `totals`, streaming it if it is
+// not a regular file. Returns number of bytes read.
+static uint64_t AggregateFile(
+    const std::string &path, g5::brc::Parser parser, bool dynamic_stations,
+    const std::vector<g5::brc::WorkerPlacement> &placement,
+    g5::brc::Checkpoint *totals, std::ostream *stats_out) {
+  const int fd = path == "-" ? STDIN_FILENO : open(path.c_str(), O_RDONLY);
+  PCHECK(fd >= 0) << "Failed to open " << path;
+  struct stat file_stat;
+  PCHECK(fstat(fd, &file_stat) == 0);
+
+  const bool stream =
+      absl::GetFlag(FLAGS_stream) || !S_ISREG(file_stat.st_mode);
+  const bool zstd = IsZstdInput(path);
+  const size_t size = stream ? 0 : file_stat.st_size;
+  const char *data = nullptr;
+  if (size > 0) {
+    data = reinterpret_cast<const char *>(
+        mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0));
+    PCHECK(data != MAP_FAILED) << "Failed to map " << path;
+  }
+  const uint64_t bytes = Aggregate(data, size, fd, stream, zstd, parser,
+                                   dynamic_stations, placement, totals,
+                                   stats_out);
+  if (data != nullptr) {
+    munmap(const_cast<char *>(data), size);
+  }
+  if (fd != STDIN_FILENO) {
+    close(fd);
+  }
+  return bytes;
+}
+
+// Waits for appends to `path`, open as `fd`, and aggregates them into
+// `totals`, printing the updated results after every pass. Returns once the
+// file is removed, replaced or truncated.
+static void Follow(const std::string &path, int fd,
+                   const std::string &checkpoint, g5::brc::Parser parser,
+                   bool dynamic_stations,
+                   const std::vector<g5::brc::WorkerPlacement> &placement,
+                   g5::brc::Checkpoint *totals, std::ostream *stats_out) {
+  const int inotify_fd = inotify_init1(IN_CLOEXEC);
+  PCHECK(inotify_fd >= 0) << "Failed to initialize inotify";
+  // The file is held open, so removing it only shows as a change of its link
+  // count.
+  PCHECK(inotify_add_watch(inotify_fd, path.c_str(),
+                           IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF) >= 0)
+      << "Failed to watch " << path;
+
+  alignas(struct inotify_event) char events[4096];
+  for (;;) {
+    const ssize_t n = read(inotify_fd, events, sizeof(events));
+    if (n < 0 && errno == EINTR) {
+      continue;
     }
-  } else {
-    if (len >= 4) {
-      uint32_t first = *reinterpret_cast<const uint32_t *>(s),
-               last = *reinterpret_cast<const uint32_t *>(s + len - 4);
-      return first + last;
-    } else if (len) {
-      return (std::bit_cast<uint8_t>(s[0]) << 16) |
-             std::bit_cast<uint8_t>(s[len - 1]);
+    PCHECK(n > 0) << "Failed to read inotify events";
+    uint32_t mask = 0;
+    for (const char *p = events; p < events + n;) {
+      const auto *event = reinterpret_cast<const struct inotify_event *>(p);
+      mask |= event->mask;
+      p += sizeof(struct inotify_event) + event->len;
+    }
+    struct stat file_stat;
+    PCHECK(fstat(fd, &file_stat) == 0);
+    if ((mask & (IN_MOVE_SELF | IN_IGNORED)) || file_stat.st_nlink == 0) {
+      std::cerr << path << " was removed or replaced" << std::endl;
+      break;
     }
+    const uint64_t size = file_stat.st_size;
+    const uint64_t begin = totals->offset();
+    if (size < begin) {
+      std::cerr << path << " was truncated" << std::endl;
+      break;
+    }
+    if (size == begin) {
+      continue;
+    }
+
+    const auto t0 = Clock::now();
+    const char *data = reinterpret_cast<const char *>(
+        mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0));
+    PCHECK(data != MAP_FAILED) << "Failed to map " << path;
+    // The last line may still be half written.
+    const uint64_t end = LastLineEnd(data, begin, size);
+    Aggregate(data + begin, end - begin, fd, /*stream=*/false, /*zstd=*/false,
+              parser, dynamic_stations, placement, totals, stats_out);
+    munmap(const_cast<char *>(data), size);
+
+    totals->set_offset(end);
+    if (!checkpoint.empty()) {
+      totals->Save(checkpoint, file_stat);
+    }
+    g5::brc::PrintTotals(*totals);
+    const std::chrono::duration<double> elapsed = Clock::now() - t0;
+    std::cerr << std::format("Aggregated {} new bytes in {:.3f}s", end - begin,
+                             elapsed.count())
+              << std::endl;
   }
 
-  return 0;
+  close(inotify_fd);
 }
 
-static constexpr auto _table = []() consteval {
-  std::array<uint32_t, std::size(_names)> values;
-  size_t i = 0;
-  for (auto &v : values) {
-    auto name = _names[i++];
-    if (name.size() > 2 * hn::Lanes(kTag)) {
-      throw "City name too long";
+int main(int argc, char *argv[]) {
+  absl::SetProgramUsageMessage(
+      "Aggregates min/mean/max temperature per station.\n"
+      "Usage: 1brc [flags] [measurements.txt | -]...");
+  const std::vector<char *> args = absl::ParseCommandLine(argc, argv);
+  const std::string path = args.size() > 1 ? args[1] : "measurements.txt";
+
+  auto tik = Clock::now();
+
+  const auto n_threads = std::thread::hardware_concurrency();
+  const bool dynamic_stations = absl::GetFlag(FLAGS_dynamic_stations);
+  const std::string scheduler = absl::GetFlag(FLAGS_scheduler);
+  CHECK(scheduler == "morsel" || scheduler == "static")
+      << "Unknown --scheduler: " << scheduler;
+  const std::string parser_name = absl::GetFlag(FLAGS_parser);
+  CHECK(parser_name == "branchy" || parser_name == "swar")
+      << "Unknown --parser: " << parser_name;
+  const auto parser = parser_name == "swar" ? g5::brc::Parser::kSwar
+                                            : g5::brc::Parser::kBranchy;
+  const std::string accumulators = absl::GetFlag(FLAGS_accumulators);
+  CHECK(accumulators == "auto" || accumulators == "records" ||
+        accumulators == "columns")
+      << "Unknown --accumulators: " << accumulators;
+  CHECK(accumulators != "columns" || !absl::GetFlag(FLAGS_percentiles))
+      << "--percentiles does not support --accumulators=columns";
+  const std::string compression = absl::GetFlag(FLAGS_compression);
+  CHECK(compression == "auto" || compression == "zstd" ||
+        compression == "none")
+      << "Unknown --compression: " << compression;
+  const std::string stats_format = absl::GetFlag(FLAGS_stats);
+  CHECK(stats_format.empty() || stats_format == "json")
+      << "Unknown --stats: " << stats_format;
+
+  int fd = path == "-" ? STDIN_FILENO : open(path.c_str(), O_RDONLY);
+  PCHECK(fd >= 0) << "Failed to open " << path;
+  struct stat file_stat;
+  fstat(fd, &file_stat);
+
+  // Pipes can't be mapped, stream them instead.
+  const bool stream =
+      absl::GetFlag(FLAGS_stream) || !S_ISREG(file_stat.st_mode);
+  const bool zstd = IsZstdInput(path);
+  size_t file_size = stream ? 0 : file_stat.st_size;
+  const char *data =
+      stream ? nullptr
+             : reinterpret_cast<const char *>(
+                   mmap(nullptr, file_size, PROT_READ,
+                        MAP_PRIVATE | MAP_HUGE_1GB, fd, 0));
+
+  if (absl::GetFlag(FLAGS_report_targets)) {
+    CHECK(!stream && !zstd)
+        << "--report_targets needs an uncompressed regular file";
+    ReportTargets(data, file_size, parser, dynamic_stations);
+  }
+
+  const std::string build_cache = absl::GetFlag(FLAGS_build_cache);
+  const std::string cache = absl::GetFlag(FLAGS_cache);
+  CHECK(!cache.empty() || (absl::GetFlag(FLAGS_station).empty() &&
+                           absl::GetFlag(FLAGS_min_temp) == -99.9 &&
+                           absl::GetFlag(FLAGS_max_temp) == 99.9))
+      << "--station, --min_temp and --max_temp need --cache";
+  const std::string range = absl::GetFlag(FLAGS_range);
+  if (!build_cache.empty() || !cache.empty()) {
+    CHECK(!stream && !zstd)
+        << "The columnar cache needs an uncompressed regular file";
+    CHECK(args.size() <= 2 && range.empty())
+        << "The columnar cache takes a single whole input";
+    CHECK(!absl::GetFlag(FLAGS_percentiles))
+        << "--percentiles is not supported with the columnar cache";
+    if (!build_cache.empty()) {
+      g5::brc::BuildColumnCache(data, file_size, file_stat, parser, n_threads,
+                                build_cache);
+    } else {
+      QueryCache(cache, data, file_stat, parser, n_threads);
     }
-    v = o1hash(name.data(), name.size());
+    const std::chrono::duration<double> elapsed = Clock::now() - tik;
+    std::cerr << "Time used: " << elapsed << std::endl;
+    return 0;
   }
-  return values;
-}();
 
-static int city_id(const char *name, size_t len) {
-  return mph::lookup<_table>(o1hash(name, len));
-}
+  const auto placement = g5::brc::PlaceWorkers(n_threads);
+
+  // Every pass appends one line to the --stats report.
+  std::ostream *stats_out = nullptr;
+  std::ofstream stats_file;
+  if (!stats_format.empty()) {
+    stats_out = &std::cerr;
+    if (const std::string path = absl::GetFlag(FLAGS_stats_file);
+        !path.empty()) {
+      stats_file.open(path, std::ios::app);
+      PCHECK(stats_file.is_open()) << "Failed to open " << path;
+      stats_out = &stats_file;
+    }
+  }
+
+  // Totals of all rows so far, resumed from --checkpoint if it is still valid
+  // for the input.
+  const std::string checkpoint = absl::GetFlag(FLAGS_checkpoint);
+  const bool follow = absl::GetFlag(FLAGS_follow);
+  g5::brc::Checkpoint totals(absl::GetFlag(FLAGS_percentiles));
+  if (!checkpoint.empty() || follow) {
+    CHECK(!stream && !zstd)
+        << "--checkpoint and --follow need an uncompressed regular file";
+    CHECK(args.size() <= 2 && range.empty())
+        << "--checkpoint and --follow take a single whole input";
+  }
+  if (!range.empty()) {
+    CHECK(!stream && !zstd) << "--range needs an uncompressed regular file";
+    CHECK(args.size() <= 2) << "--range takes a single input";
+  }
+  if (!checkpoint.empty() && totals.Load(checkpoint, file_stat)) {
+    std::cerr << "Resuming " << path << " at byte " << totals.offset()
+              << std::endl;
+  }
+
+  // An incremental run leaves a trailing line without newline to the next
+  // pass, it may still be written to.
+  uint64_t begin = totals.offset();
+  uint64_t end = !checkpoint.empty() || follow
+                     ? LastLineEnd(data, begin, file_size)
+                     : file_size;
+  if (!range.empty()) {
+    std::tie(begin, end) = LineRange(data, file_size, range);
+  }
+  const uint64_t rows_before = totals.rows();
+  uint64_t bytes =
+      Aggregate(data + begin, end - begin, fd, stream, zstd, parser,
+                dynamic_stations, placement, &totals, stats_out);
+  // Further inputs are added whole to the same totals.
+  for (size_t i = 2; i < args.size(); ++i) {
+    bytes += AggregateFile(args[i], parser, dynamic_stations, placement,
+                           &totals, stats_out);
+  }
+  const uint64_t n_rows = totals.rows() - rows_before;
+  totals.set_offset(end);
+  if (!checkpoint.empty()) {
+    totals.Save(checkpoint, file_stat);
+  }
+
+  if (const std::string partial_out = absl::GetFlag(FLAGS_partial_out);
+      !partial_out.empty()) {
+    g5::brc::WritePartial(partial_out, totals);
+  } else {
+    g5::brc::PrintTotals(totals);
+  }
 
-static std::string_view city_name(int id) { return _names[id]; }
+  auto tok = Clock::now();
+  const std::chrono::duration<double> elapsed = tok - tik;
+  std::cerr << "Time used: " << elapsed << std::endl;
+  std::cerr << std::format("Throughput ({} stations, {}): {:.1f}M rows/s, "
+                           "{:.2f} GB/s",
+                           dynamic_stations ? "dynamic" : "static",
+                           g5::brc::ScanTargetName(),
+                           n_rows / elapsed.count() / 1e6,
+                           bytes / elapsed.count() / 1e9)
+            << std::endl;
 
-static std::size_t city_count() { return _names.size(); }
+  if (follow) {
+    Follow(path, fd, checkpoint, parser, dynamic_stations, placement, &totals,
+           stats_out);
+  }
+
+  return 0;
+}
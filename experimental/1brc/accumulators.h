@@ -0,0 +1,136 @@
+// Per-thread accumulators of 1brc: 32-bit hot ones that the kernels update,
+// flushed into 64-bit cold totals before they can overflow.
+//
+// Keeping the hot accumulators 32-bit keeps the per-thread table small enough
+// for L1 at 10B+ rows. A line is at least 6 bytes ("a;0.0\n"), so a hot
+// accumulator that has seen at most kFlushBytes of input has at most
+// kRecordSafeRows rows and can't have overflowed. FlushBudget cuts the scans
+// of a thread so that it flushes at least that often.
+//
+// The hot accumulators are either a std::vector<Record>, or HotColumns, the
+// same fields as a struct of arrays with 16-bit bounds.
+
+#ifndef EXPERIMENTAL_1BRC_ACCUMULATORS_H_
+#define EXPERIMENTAL_1BRC_ACCUMULATORS_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include "absl/log/check.h"
+#include "experimental/1brc/record.h"
+
+namespace g5::brc {
+
+// Shortest possible line, a one-byte name and a three-byte temperature.
+inline constexpr size_t kMinLineBytes = 6;
+
+// Input bytes a hot accumulator may take between two flushes.
+inline constexpr size_t kFlushBytes = kRecordSafeRows * kMinLineBytes;
+
+// Most stations HotColumns is picked for by default. In hot_path_benchmark,
+// columns beat records at the 413 built-in stations and lose at 10k and 50k.
+inline constexpr size_t kHotColumnsMaxStations = 1024;
+
+// Accumulators of all stations as a struct of arrays, indexed by station id.
+// Takes 12 bytes per station instead of the 16 of a Record.
+class HotColumns {
+ public:
+  size_t size() const { return sum_.size(); }
+
+  // Grows or shrinks to `n` stations, new ones empty.
+  void Resize(size_t n) {
+    sum_.resize(n, 0);
+    count_.resize(n, 0);
+    min_.resize(n, kEmpty);
+    max_.resize(n, kEmpty);
+  }
+
+  // Adds one temperature to station `id`.
+  void Update(int id, int val) {
+    max_[id] = std::max<int16_t>(max_[id], val);
+    min_[id] = std::max<int16_t>(min_[id], -val);
+    sum_[id] += val;
+    count_[id] += 1;
+  }
+
+  // Adds all stations to `cold`, growing it to size() first, and empties
+  // them.
+  void FlushInto(std::vector<WideRecord>* cold) {
+    if (cold->size() < size()) {
+      cold->resize(size(), kEmptyWideRecord);
+    }
+    for (size_t id = 0; id < size(); ++id) {
+      if (count_[id] == 0) {
+        continue;
+      }
+      Merge((*cold)[id], Record{sum_[id], count_[id], min_[id], max_[id]});
+    }
+    std::ranges::fill(sum_, 0);
+    std::ranges::fill(count_, 0);
+    std::ranges::fill(min_, kEmpty);
+    std::ranges::fill(max_, kEmpty);
+  }
+
+ private:
+  static constexpr int16_t kEmpty = std::numeric_limits<int16_t>::min();
+
+  std::vector<int32_t> sum_;
+  std::vector<int32_t> count_;
+  // Negated, like Record::min.
+  std::vector<int16_t> min_;
+  std::vector<int16_t> max_;
+};
+
+// Adds `hot` to `cold`, growing it to the size of `hot` first, and empties
+// `hot`.
+inline void FlushInto(std::vector<Record>* hot,
+                      std::vector<WideRecord>* cold) {
+  if (cold->size() < hot->size()) {
+    cold->resize(hot->size(), kEmptyWideRecord);
+  }
+  for (size_t id = 0; id < hot->size(); ++id) {
+    if ((*hot)[id].count > 0) {
+      Merge((*cold)[id], (*hot)[id]);
+      (*hot)[id] = kEmptyRecord;
+    }
+  }
+}
+
+// Keeps track of the input a thread has scanned since its last flush.
+class FlushBudget {
+ public:
+  // Calls `scan(begin, end)` on consecutive line-aligned pieces of
+  // [begin, end), and `flush()` in between whenever the next piece would take
+  // the input since the last flush over kFlushBytes.
+  template <typename ScanFn, typename FlushFn>
+  void Scan(const char* begin, const char* end, ScanFn&& scan,
+            FlushFn&& flush) {
+    while (begin < end) {
+      const char* stop = end;
+      if (static_cast<size_t>(end - begin) > left_) {
+        const void* nl = left_ > 0 ? memrchr(begin, '\n', left_) : nullptr;
+        if (nl == nullptr) {
+          CHECK_LT(left_, kFlushBytes) << "Line too long";
+          flush();
+          left_ = kFlushBytes;
+          continue;
+        }
+        stop = static_cast<const char*>(nl) + 1;
+      }
+      scan(begin, stop);
+      left_ -= stop - begin;
+      begin = stop;
+    }
+  }
+
+ private:
+  size_t left_ = kFlushBytes;
+};
+
+}  // namespace g5::brc
+
+#endif  // EXPERIMENTAL_1BRC_ACCUMULATORS_H_
@@ -0,0 +1,215 @@
+// Aggregates 1brc rows that producers stream in over gRPC, instead of having
+// them write files for 1brc to read back, and answers queries for the totals
+// while the rows keep coming.
+//
+// Every thread runs a GrpcContext on a completion queue of its own, pinned
+// like the 1brc workers, and parses the Ingest streams of its queue into its
+// own IngestShard. Queries merge the shards by station name. On SIGINT or
+// SIGTERM the server stops and prints the totals like 1brc does.
+
+#include <pthread.h>
+#include <signal.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/usage.h"
+#include "absl/log/check.h"
+#include "asio/awaitable.hpp"
+#include "asio/detached.hpp"
+#include "asio/use_awaitable.hpp"
+#include "experimental/1brc/aggregator.grpc.pb.h"
+#include "experimental/1brc/aggregator.pb.h"
+#include "experimental/1brc/checkpoint.h"
+#include "experimental/1brc/ingest_shard.h"
+#include "experimental/1brc/placement.h"
+#include "experimental/1brc/print.h"
+#include "experimental/1brc/record.h"
+#include "experimental/1brc/scan.h"
+#include "grpcpp/security/server_credentials.h"
+#include "grpcpp/server.h"
+#include "grpcpp/server_builder.h"
+#include "hwy/contrib/thread_pool/topology.h"
+#include "third_party/agrpc/asio_grpc.hpp"
+
+ABSL_FLAG(std::string, address, "[::]:50051", "Address to listen on");
+
+ABSL_FLAG(int, threads, 0,
+          "Server threads, each with its own completion queue and shard, 0 "
+          "for all cores");
+
+ABSL_FLAG(std::string, parser, "branchy",
+          "Line parser: 'branchy' or 'swar', see 1brc --parser");
+
+namespace {
+
+using g5::brc::Aggregator;
+using g5::brc::IngestShard;
+
+using IngestRPC = agrpc::ServerRPC<&Aggregator::AsyncService::RequestIngest>;
+using QueryRPC = agrpc::ServerRPC<&Aggregator::AsyncService::RequestQuery>;
+
+// Longest partial line a stream may carry from one batch into the next.
+constexpr size_t kMaxLineBytes = 4096;
+
+// Grace period of the streams still open at shutdown.
+constexpr auto kShutdownDeadline = std::chrono::seconds(1);
+
+asio::awaitable<void> Ingest(IngestRPC& rpc, IngestShard& shard) {
+  g5::brc::IngestRequest request;
+  g5::brc::IngestResponse response;
+  // The partial line carried over from the previous batch, followed by the
+  // current batch and the tail room of the kernels.
+  std::string buffer;
+  size_t carry = 0;
+  while (co_await rpc.read(request, asio::use_awaitable)) {
+    const std::string& rows = request.rows();
+    const size_t size = carry + rows.size();
+    buffer.resize(size + IngestShard::kTailRoom);
+    memcpy(buffer.data() + carry, rows.data(), rows.size());
+
+    const char* begin = buffer.data();
+    const void* nl = memrchr(begin, '\n', size);
+    const char* end = nl != nullptr ? static_cast<const char*>(nl) + 1 : begin;
+    response.set_rows(response.rows() + shard.Add(begin, end));
+    response.set_bytes(response.bytes() + rows.size());
+
+    carry = begin + size - end;
+    if (carry > kMaxLineBytes) {
+      co_await rpc.finish_with_error(
+          grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Line too long"),
+          asio::use_awaitable);
+      co_return;
+    }
+    memmove(buffer.data(), end, carry);
+  }
+
+  if (carry > 0) {
+    // Terminate the last line.
+    buffer.resize(carry + 1 + IngestShard::kTailRoom);
+    buffer[carry] = '\n';
+    response.set_rows(response.rows() +
+                      shard.Add(buffer.data(), buffer.data() + carry + 1));
+  }
+  co_await rpc.finish(response, grpc::Status::OK, asio::use_awaitable);
+}
+
+// Returns the totals of all shards, merged by station name.
+g5::brc::Checkpoint MergeShards(std::deque<IngestShard>& shards) {
+  g5::brc::Checkpoint totals;
+  for (IngestShard& shard : shards) {
+    shard.ForEach([&](std::string_view name, const g5::brc::WideRecord& rec) {
+      totals.Add(name, rec, nullptr);
+    });
+  }
+  return totals;
+}
+
+asio::awaitable<void> Query(QueryRPC& rpc, std::deque<IngestShard>& shards) {
+  auto results = MergeShards(shards).results();
+  std::ranges::sort(results, {}, [](const auto& result) {
+    return result.first;
+  });
+
+  g5::brc::QueryResponse response;
+  for (const auto& [name, rec] : results) {
+    if (rec.count == 0) {
+      continue;
+    }
+    g5::brc::StationSummary& station = *response.add_stations();
+    station.set_name(name);
+    station.set_count(rec.count);
+    station.set_min(-rec.min);
+    station.set_mean(static_cast<double>(rec.sum) / rec.count);
+    station.set_max(rec.max);
+  }
+  co_await rpc.finish(response, grpc::Status::OK, asio::use_awaitable);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  absl::SetProgramUsageMessage(
+      "Serves live min/mean/max temperature per station over gRPC.\n"
+      "Usage: aggregator_server [flags]");
+  absl::ParseCommandLine(argc, argv);
+
+  const std::string address = absl::GetFlag(FLAGS_address);
+  const int n_threads = absl::GetFlag(FLAGS_threads) > 0
+                            ? absl::GetFlag(FLAGS_threads)
+                            : std::thread::hardware_concurrency();
+  const std::string parser_name = absl::GetFlag(FLAGS_parser);
+  CHECK(parser_name == "branchy" || parser_name == "swar")
+      << "Unknown --parser: " << parser_name;
+  const auto parser = parser_name == "swar" ? g5::brc::Parser::kSwar
+                                            : g5::brc::Parser::kBranchy;
+
+  // Blocked before any thread starts, so that only sigwait() takes them.
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  CHECK_EQ(pthread_sigmask(SIG_BLOCK, &signals, nullptr), 0);
+
+  Aggregator::AsyncService service;
+  grpc::ServerBuilder builder;
+  builder.AddListeningPort(address, grpc::InsecureServerCredentials());
+  builder.RegisterService(&service);
+  // Set once the shards have their completion queues. The shards are torn
+  // down first on exit, as their contexts still drain into the server.
+  std::unique_ptr<grpc::Server> server;
+  std::deque<agrpc::GrpcContext> contexts;
+  std::deque<IngestShard> shards;
+  for (int tid = 0; tid < n_threads; ++tid) {
+    contexts.emplace_back(builder.AddCompletionQueue());
+    shards.emplace_back(parser);
+  }
+  server = builder.BuildAndStart();
+  CHECK(server != nullptr) << "Failed to listen on " << address;
+
+  const auto placement = g5::brc::PlaceWorkers(n_threads);
+  {
+    std::vector<std::jthread> threads;
+    for (int tid = 0; tid < n_threads; ++tid) {
+      threads.emplace_back([&, tid] {
+        hwy::LogicalProcessorSet lps;
+        lps.Set(placement[tid].lp);
+        hwy::SetThreadAffinity(lps);
+
+        agrpc::GrpcContext& context = contexts[tid];
+        IngestShard& shard = shards[tid];
+        agrpc::register_awaitable_rpc_handler<IngestRPC>(
+            context, service,
+            [&shard](IngestRPC& rpc) { return Ingest(rpc, shard); },
+            asio::detached);
+        agrpc::register_awaitable_rpc_handler<QueryRPC>(
+            context, service,
+            [&shards](QueryRPC& rpc, g5::brc::QueryRequest&) {
+              return Query(rpc, shards);
+            },
+            asio::detached);
+        context.run();
+      });
+    }
+
+    int signal;
+    sigwait(&signals, &signal);
+    // Cancels the calls still open after the deadline, after which every
+    // context runs out of work.
+    server->Shutdown(std::chrono::system_clock::now() + kShutdownDeadline);
+  }
+
+  g5::brc::PrintTotals(MergeShards(shards));
+  return 0;
+}
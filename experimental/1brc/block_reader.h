@@ -0,0 +1,229 @@
+// Streaming input for 1brc: stdin, pipes and files larger than memory.
+//
+// A reader thread fills a fixed ring of aligned block buffers, with O_DIRECT
+// for regular files so that the page cache is bypassed. The partial line at the
+// end of a block is carried into the head room in front of the next block, so
+// every block handed to a worker holds complete lines only. Memory use is
+// bounded by the number of buffers, whatever the input size.
+//
+// Instead of a file descriptor, the reader thread can also pull from any
+// Source, e.g. a decompressor.
+
+#ifndef EXPERIMENTAL_1BRC_BLOCK_READER_H_
+#define EXPERIMENTAL_1BRC_BLOCK_READER_H_
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/log/check.h"
+
+namespace g5::brc {
+
+class BlockReader {
+ public:
+  // Alignment required by O_DIRECT, also the head and tail room of a block.
+  static constexpr size_t kAlignment = 4096;
+
+  // Fills up to `size` bytes at `dest` and returns how many, fewer only at
+  // the end of input.
+  using Source = std::function<size_t(char* dest, size_t size)>;
+
+  // Complete lines [begin, end) in buffer `buffer`.
+  struct Block {
+    const char* begin;
+    const char* end;
+    int buffer;
+  };
+
+  // Starts reading `fd` in blocks of `block_size` bytes into `n_buffers`
+  // buffers. Regular files are read with O_DIRECT when `direct` is set and the
+  // file system supports it.
+  BlockReader(int fd, size_t block_size, int n_buffers, bool direct)
+      : fd_(fd), block_size_(block_size) {
+    CHECK_EQ(block_size_ % kAlignment, 0u)
+        << "Block size must be a multiple of " << kAlignment;
+    CHECK_GE(n_buffers, 2);
+
+    struct stat file_stat;
+    PCHECK(fstat(fd_, &file_stat) == 0);
+    if (direct && S_ISREG(file_stat.st_mode)) {
+      // Not all file systems support O_DIRECT, fall back to buffered reads.
+      const int flags = fcntl(fd_, F_GETFL);
+      direct_ = flags >= 0 && fcntl(fd_, F_SETFL, flags | O_DIRECT) == 0;
+    }
+
+    Start(n_buffers);
+  }
+
+  // Starts reading `source` in blocks of `block_size` bytes into `n_buffers`
+  // buffers.
+  BlockReader(Source source, size_t block_size, int n_buffers)
+      : fd_(-1), block_size_(block_size), source_(std::move(source)) {
+    CHECK_EQ(block_size_ % kAlignment, 0u)
+        << "Block size must be a multiple of " << kAlignment;
+    CHECK_GE(n_buffers, 2);
+    Start(n_buffers);
+  }
+
+  // Waits for the next block. Returns false at the end of input.
+  bool Next(Block* block) {
+    std::unique_lock lock(mu_);
+    cv_.wait(lock, [this] { return !ready_.empty() || done_; });
+    if (ready_.empty()) {
+      return false;
+    }
+    *block = ready_.front();
+    ready_.pop_front();
+    return true;
+  }
+
+  // Hands the buffer of a processed block back to the reader.
+  void Release(const Block& block) {
+    {
+      std::lock_guard lock(mu_);
+      free_.push_back(block.buffer);
+    }
+    cv_.notify_all();
+  }
+
+  // Returns total number of bytes read so far.
+  uint64_t bytes_read() const {
+    return bytes_read_.load(std::memory_order_relaxed);
+  }
+
+  // Returns whether the input is read with O_DIRECT.
+  bool direct() const { return direct_; }
+
+ private:
+  struct FreeDeleter {
+    void operator()(char* p) const { std::free(p); }
+  };
+
+  void Start(int n_buffers) {
+    for (int i = 0; i < n_buffers; ++i) {
+      buffers_.emplace_back(static_cast<char*>(std::aligned_alloc(
+          kAlignment, block_size_ + 2 * kAlignment)));
+      CHECK(buffers_.back() != nullptr);
+      free_.push_back(i);
+    }
+
+    reader_ = std::jthread([this](std::stop_token stop) { ReadLoop(stop); });
+  }
+
+  // Reads until `block_size_` bytes are filled or the input ends.
+  size_t Fill(char* data) {
+    if (source_) {
+      return source_(data, block_size_);
+    }
+    size_t n = 0;
+    while (n < block_size_) {
+      const ssize_t ret = read(fd_, data + n, block_size_ - n);
+      if (ret < 0 && errno == EINTR) {
+        continue;
+      }
+      PCHECK(ret >= 0) << "Failed to read input";
+      if (ret == 0) {
+        break;
+      }
+      n += ret;
+      if (direct_ && n % kAlignment != 0) {
+        // Only the last read of a file may be unaligned.
+        break;
+      }
+    }
+    return n;
+  }
+
+  void ReadLoop(std::stop_token stop) {
+    char carry[kAlignment];
+    size_t carry_len = 0;
+
+    for (;;) {
+      int buffer;
+      {
+        std::unique_lock lock(mu_);
+        if (!cv_.wait(lock, stop, [this] { return !free_.empty(); })) {
+          return;
+        }
+        buffer = free_.front();
+        free_.pop_front();
+      }
+
+      char* data = buffers_[buffer].get() + kAlignment;
+      const size_t n = Fill(data);
+      bytes_read_.fetch_add(n, std::memory_order_relaxed);
+      const bool eof = n < block_size_;
+
+      // Prepend the partial line left over from the previous block.
+      char* begin = data - carry_len;
+      memcpy(begin, carry, carry_len);
+      char* end = data + n;
+
+      if (!eof) {
+        const char* nl = static_cast<const char*>(
+            memrchr(begin, '\n', end - begin));
+        CHECK(nl != nullptr) << "Line longer than block";
+        carry_len = end - (nl + 1);
+        CHECK_LE(carry_len, kAlignment) << "Line too long";
+        memcpy(carry, nl + 1, carry_len);
+        end = const_cast<char*>(nl) + 1;
+      } else if (end > begin && end[-1] != '\n') {
+        // Terminate the last line, there is tail room behind the block.
+        *end++ = '\n';
+      }
+
+      {
+        std::lock_guard lock(mu_);
+        if (end > begin) {
+          ready_.push_back({begin, end, buffer});
+        } else {
+          free_.push_back(buffer);
+        }
+        done_ = eof;
+      }
+      cv_.notify_all();
+
+      if (eof) {
+        return;
+      }
+    }
+  }
+
+  const int fd_;
+  const size_t block_size_;
+  const Source source_;
+  bool direct_ = false;
+
+  std::vector<std::unique_ptr<char[], FreeDeleter>> buffers_;
+  std::atomic<uint64_t> bytes_read_ = 0;
+
+  std::mutex mu_;
+  std::condition_variable_any cv_;
+  std::deque<int> free_;
+  std::deque<Block> ready_;
+  bool done_ = false;
+
+  // Declared last, so that it is stopped and joined before the buffers go.
+  std::jthread reader_;
+};
+
+}  // namespace g5::brc
+
+#endif  // EXPERIMENTAL_1BRC_BLOCK_READER_H_
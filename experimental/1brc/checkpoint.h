@@ -0,0 +1,223 @@
+// Running per-station totals of 1brc together with the input offset they
+// cover, persisted so that appends to the input can be aggregated alone.
+//
+// A checkpoint belongs to one file, identified by device and inode. It is
+// dropped when the file is replaced or shrinks below the offset; appending
+// is the only change it survives. With percentiles, the histogram of every
+// station is kept and saved along with its record.
+
+#ifndef EXPERIMENTAL_1BRC_CHECKPOINT_H_
+#define EXPERIMENTAL_1BRC_CHECKPOINT_H_
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/log/check.h"
+#include "experimental/1brc/histogram.h"
+#include "experimental/1brc/record.h"
+#include "experimental/1brc/station_table.h"
+
+namespace g5::brc {
+
+class Checkpoint {
+ public:
+  explicit Checkpoint(bool percentiles = false) : percentiles_(percentiles) {}
+
+  // Loads the checkpoint at `path` if it was taken of the file whose status
+  // is `source`, with histograms if percentiles are on. Returns false and
+  // leaves the totals empty otherwise.
+  bool Load(const std::string& path, const struct stat& source) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      PCHECK(errno == ENOENT) << "Failed to open " << path;
+      return false;
+    }
+    std::string buffer;
+    char chunk[1 << 16];
+    for (ssize_t n; (n = read(fd, chunk, sizeof(chunk))) != 0;) {
+      PCHECK(n > 0 || errno == EINTR) << "Failed to read " << path;
+      buffer.append(chunk, std::max<ssize_t>(n, 0));
+    }
+    close(fd);
+
+    Header header;
+    CHECK_GE(buffer.size(), sizeof(header)) << "Corrupt checkpoint " << path;
+    memcpy(&header, buffer.data(), sizeof(header));
+    CHECK_EQ(memcmp(header.magic, kMagic, sizeof(kMagic) - 1), 0)
+        << "Not a checkpoint: " << path;
+    // Older versions are dropped like checkpoints of other files.
+    if (header.magic[sizeof(kMagic) - 1] != kMagic[sizeof(kMagic) - 1] ||
+        header.source_dev != source.st_dev ||
+        header.source_ino != source.st_ino ||
+        header.offset > static_cast<uint64_t>(source.st_size) ||
+        (percentiles_ && !header.percentiles)) {
+      return false;
+    }
+
+    size_t pos = sizeof(header);
+    for (uint64_t i = 0; i < header.n_stations; ++i) {
+      uint32_t len;
+      WideRecord rec;
+      CHECK_LE(pos + sizeof(len), buffer.size())
+          << "Corrupt checkpoint " << path;
+      memcpy(&len, buffer.data() + pos, sizeof(len));
+      pos += sizeof(len);
+      CHECK_LE(pos + len + sizeof(rec), buffer.size())
+          << "Corrupt checkpoint " << path;
+      const std::string_view name(buffer.data() + pos, len);
+      memcpy(&rec, buffer.data() + pos + len, sizeof(rec));
+      pos += len + sizeof(rec);
+
+      Histogram histogram;
+      if (header.percentiles) {
+        uint32_t n_values;
+        CHECK_LE(pos + sizeof(n_values), buffer.size())
+            << "Corrupt checkpoint " << path;
+        memcpy(&n_values, buffer.data() + pos, sizeof(n_values));
+        pos += sizeof(n_values);
+        CHECK_LE(pos + n_values * kValueSize, buffer.size())
+            << "Corrupt checkpoint " << path;
+        for (uint32_t j = 0; j < n_values; ++j, pos += kValueSize) {
+          int32_t val;
+          uint64_t count;
+          memcpy(&val, buffer.data() + pos, sizeof(val));
+          memcpy(&count, buffer.data() + pos + sizeof(val), sizeof(count));
+          CHECK(Histogram::kMinValue <= val && val <= Histogram::kMaxValue)
+              << "Corrupt checkpoint " << path;
+          histogram.Add(val, count);
+        }
+      }
+      Add(name, rec, percentiles_ ? &histogram : nullptr);
+    }
+    offset_ = header.offset;
+    return true;
+  }
+
+  // Writes the checkpoint for the file whose status is `source` to `path`,
+  // through a temporary file so that a crash keeps the previous one.
+  void Save(const std::string& path, const struct stat& source) const {
+    Header header = {};
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.source_dev = source.st_dev;
+    header.source_ino = source.st_ino;
+    header.offset = offset_;
+    header.n_stations = records_.size();
+    header.percentiles = percentiles_;
+
+    std::string buffer(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (size_t id = 0; id < records_.size(); ++id) {
+      const std::string_view name = table_.name(id);
+      const uint32_t len = name.size();
+      buffer.append(reinterpret_cast<const char*>(&len), sizeof(len));
+      buffer.append(name);
+      buffer.append(reinterpret_cast<const char*>(&records_[id]),
+                    sizeof(WideRecord));
+
+      if (percentiles_) {
+        const size_t n_values_pos = buffer.size();
+        uint32_t n_values = 0;
+        buffer.append(sizeof(n_values), '\0');
+        histograms_[id].ForEach([&](int32_t val, uint64_t count) {
+          buffer.append(reinterpret_cast<const char*>(&val), sizeof(val));
+          buffer.append(reinterpret_cast<const char*>(&count), sizeof(count));
+          n_values += 1;
+        });
+        memcpy(buffer.data() + n_values_pos, &n_values, sizeof(n_values));
+      }
+    }
+
+    const std::string tmp_path = path + ".tmp";
+    const int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    PCHECK(fd >= 0) << "Failed to create " << tmp_path;
+    for (size_t n = 0; n < buffer.size();) {
+      const ssize_t ret = write(fd, buffer.data() + n, buffer.size() - n);
+      PCHECK(ret > 0 || errno == EINTR) << "Failed to write " << tmp_path;
+      n += std::max<ssize_t>(ret, 0);
+    }
+    PCHECK(fsync(fd) == 0) << "Failed to sync " << tmp_path;
+    PCHECK(close(fd) == 0);
+    PCHECK(rename(tmp_path.c_str(), path.c_str()) == 0)
+        << "Failed to rename " << tmp_path << " to " << path;
+  }
+
+  // Returns input offset up to which rows are included in the totals.
+  uint64_t offset() const { return offset_; }
+  void set_offset(uint64_t offset) { offset_ = offset; }
+
+  // Returns whether histograms are kept.
+  bool percentiles() const { return percentiles_; }
+
+  // Merges `rec` into the totals of station `name`, and `histogram` into its
+  // histogram with percentiles.
+  void Add(std::string_view name, const WideRecord& rec,
+           const Histogram* histogram = nullptr) {
+    const int id = table_.FindOrInsert(name.data(), name.size());
+    if (id >= std::ssize(records_)) {
+      records_.resize(id + 1, kEmptyWideRecord);
+      histograms_.resize(percentiles_ ? id + 1 : 0);
+    }
+    Merge(records_[id], rec);
+    if (percentiles_) {
+      CHECK(histogram != nullptr);
+      histograms_[id].Merge(*histogram);
+    }
+  }
+
+  // Returns total number of rows.
+  uint64_t rows() const {
+    uint64_t rows = 0;
+    for (const WideRecord& rec : records_) {
+      rows += rec.count;
+    }
+    return rows;
+  }
+
+  // Returns the totals of all stations, valid until the next Add().
+  std::vector<std::pair<std::string_view, WideRecord>> results() const {
+    std::vector<std::pair<std::string_view, WideRecord>> results;
+    for (size_t id = 0; id < records_.size(); ++id) {
+      results.emplace_back(table_.name(id), records_[id]);
+    }
+    return results;
+  }
+
+  // Returns histogram of the i-th station of results(), with percentiles.
+  const Histogram& histogram(int i) const { return histograms_[i]; }
+
+ private:
+  // The last byte is the format version.
+  static constexpr char kMagic[8] = {'1', 'B', 'R', 'C', 'C', 'K', 'P', '3'};
+  // A histogram value is an int32_t temperature and a uint64_t count.
+  static constexpr size_t kValueSize = sizeof(int32_t) + sizeof(uint64_t);
+
+  struct Header {
+    char magic[8];
+    uint64_t source_dev;
+    uint64_t source_ino;
+    uint64_t offset;
+    uint64_t n_stations;
+    // Whether a histogram follows every record.
+    uint64_t percentiles;
+  };
+
+  const bool percentiles_;
+  uint64_t offset_ = 0;
+  StationTable table_;
+  std::vector<WideRecord> records_;
+  std::vector<Histogram> histograms_;
+};
+
+}  // namespace g5::brc
+
+#endif  // EXPERIMENTAL_1BRC_CHECKPOINT_H_
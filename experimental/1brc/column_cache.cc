@@ -0,0 +1,353 @@
+#include "experimental/1brc/column_cache.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/log/check.h"
+#include "experimental/1brc/morsel_queue.h"
+#include "experimental/1brc/record.h"
+#include "experimental/1brc/scan.h"
+#include "experimental/1brc/station_table.h"
+
+#undef HWY_TARGET_INCLUDE
+#define HWY_TARGET_INCLUDE "experimental/1brc/column_cache.cc"
+#include "hwy/foreach_target.h"  // IWYU pragma: keep
+#include "hwy/highway.h"
+
+HWY_BEFORE_NAMESPACE();
+namespace g5::brc {
+namespace HWY_NAMESPACE {
+
+namespace hn = hwy::HWY_NAMESPACE;
+
+// Aggregates the temperatures within [lo, hi] of `temperatures[0, n)` into
+// `rec`. The 32-bit lane sums hold for n up to kRowGroupRows.
+void ReduceTemperatures(const int16_t* temperatures, size_t n, int lo, int hi,
+                        WideRecord* rec) {
+  const hn::ScalableTag<int16_t> d;
+  const hn::RepartitionToWide<decltype(d)> d32;
+  const size_t lanes = hn::Lanes(d);
+
+  const auto vlo = hn::Set(d, lo);
+  const auto vhi = hn::Set(d, hi);
+  const auto vmin_init = hn::Set(d, std::numeric_limits<int16_t>::max());
+  const auto vmax_init = hn::Set(d, std::numeric_limits<int16_t>::min());
+  auto vmin = vmin_init;
+  auto vmax = vmax_init;
+  auto vsum = hn::Zero(d32);
+  size_t count = 0;
+
+  size_t i = 0;
+  for (; i + lanes <= n; i += lanes) {
+    const auto v = hn::LoadU(d, temperatures + i);
+    const auto in = hn::And(hn::Ge(v, vlo), hn::Le(v, vhi));
+    count += hn::CountTrue(d, in);
+    vmin = hn::Min(vmin, hn::IfThenElse(in, v, vmin_init));
+    vmax = hn::Max(vmax, hn::IfThenElse(in, v, vmax_init));
+    const auto masked = hn::IfThenElseZero(in, v);
+    vsum = hn::Add(vsum, hn::Add(hn::PromoteLowerTo(d32, masked),
+                                 hn::PromoteUpperTo(d32, masked)));
+  }
+
+  int min = hn::ReduceMin(d, vmin);
+  int max = hn::ReduceMax(d, vmax);
+  int sum = hn::ReduceSum(d32, vsum);
+  for (; i < n; ++i) {
+    const int t = temperatures[i];
+    if (lo <= t && t <= hi) {
+      min = std::min(min, t);
+      max = std::max(max, t);
+      sum += t;
+      count += 1;
+    }
+  }
+
+  if (count > 0) {
+    Merge(*rec, Record{sum, static_cast<int>(count), -min, max});
+  }
+}
+
+}  // namespace HWY_NAMESPACE
+}  // namespace g5::brc
+HWY_AFTER_NAMESPACE();
+
+#if HWY_ONCE
+namespace g5::brc {
+
+HWY_EXPORT(ReduceTemperatures);
+
+namespace {
+
+constexpr char kMagic[8] = {'1', 'B', 'R', 'C', 'C', 'O', 'L', '2'};
+constexpr size_t kMorselSize = 4 << 20;
+
+uint64_t Align64(uint64_t offset) { return (offset + 63) & ~uint64_t{63}; }
+
+int64_t MtimeNs(const struct stat& st) {
+  return int64_t{st.st_mtim.tv_sec} * 1'000'000'000 + st.st_mtim.tv_nsec;
+}
+
+// Runs `fn(tid)` on `n_threads` threads and waits for all of them.
+template <typename Fn>
+void RunThreads(int n_threads, Fn&& fn) {
+  std::vector<std::jthread> threads;
+  for (int tid = 0; tid < n_threads; ++tid) {
+    threads.emplace_back([&fn, tid] { fn(tid); });
+  }
+}
+
+}  // namespace
+
+void BuildColumnCache(const char* data, size_t size, const struct stat& source,
+                      Parser parser, int n_threads, const std::string& path) {
+  // Rows of each thread, with ids of its own station table at first.
+  struct Part {
+    StationTable table;
+    std::vector<uint16_t> ids;
+    std::vector<int16_t> temperatures;
+    // Rows per station, then where the next row of a station goes.
+    std::vector<uint64_t> cursors;
+  };
+  std::vector<Part> parts(n_threads);
+
+  MorselQueue queue(data, size, kMorselSize, n_threads);
+  RunThreads(n_threads, [&](int tid) {
+    auto& part = parts[tid];
+    MorselQueue::Morsel morsel;
+    while (queue.Next(tid, &morsel)) {
+      ScanRows(morsel.begin, morsel.end, parser, &part.table, &part.ids,
+               &part.temperatures);
+    }
+  });
+
+  StationTable stations;
+  std::vector<std::vector<uint16_t>> remaps(n_threads);
+  for (int tid = 0; tid < n_threads; ++tid) {
+    for (size_t j = 0; j < parts[tid].table.size(); ++j) {
+      const auto name = parts[tid].table.name(j);
+      remaps[tid].push_back(stations.FindOrInsert(name.data(), name.size()));
+    }
+  }
+  const size_t n_stations = stations.size();
+
+  RunThreads(n_threads, [&](int tid) {
+    auto& part = parts[tid];
+    part.cursors.assign(n_stations, 0);
+    for (auto& id : part.ids) {
+      id = remaps[tid][id];
+      part.cursors[id] += 1;
+    }
+  });
+
+  // Cluster rows by station; the rows of a station are ordered by thread.
+  uint64_t n_rows = 0;
+  std::vector<RowGroup> groups;
+  for (size_t s = 0; s < n_stations; ++s) {
+    const uint64_t first = n_rows;
+    for (auto& part : parts) {
+      const uint64_t count = part.cursors[s];
+      part.cursors[s] = n_rows;
+      n_rows += count;
+    }
+    for (uint64_t row = first; row < n_rows; row += kRowGroupRows) {
+      groups.push_back(RowGroup{
+          .first_row = row,
+          .n_rows = static_cast<uint32_t>(
+              std::min<uint64_t>(kRowGroupRows, n_rows - row)),
+          .station = static_cast<uint16_t>(s),
+      });
+    }
+  }
+
+  CacheHeader header = {};
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.source_size = source.st_size;
+  header.source_mtime_ns = MtimeNs(source);
+  header.n_rows = n_rows;
+  header.n_stations = n_stations;
+  header.n_groups = groups.size();
+  uint64_t names_size = n_stations * sizeof(uint32_t);
+  for (size_t s = 0; s < n_stations; ++s) {
+    names_size += stations.name(s).size();
+  }
+  header.names_offset = Align64(sizeof(header));
+  header.groups_offset = Align64(header.names_offset + names_size);
+  header.temperatures_offset =
+      Align64(header.groups_offset + groups.size() * sizeof(RowGroup));
+  header.file_size = header.temperatures_offset + n_rows * sizeof(int16_t);
+
+  const std::string tmp_path = path + ".tmp";
+  const int fd = open(tmp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  PCHECK(fd >= 0) << "Failed to create " << tmp_path;
+  PCHECK(ftruncate(fd, header.file_size) == 0);
+  char* out = static_cast<char*>(mmap(
+      nullptr, header.file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+  PCHECK(out != MAP_FAILED) << "Failed to map " << tmp_path;
+
+  uint32_t* name_ends = reinterpret_cast<uint32_t*>(out + header.names_offset);
+  char* name_bytes = reinterpret_cast<char*>(name_ends + n_stations);
+  uint32_t name_end = 0;
+  for (size_t s = 0; s < n_stations; ++s) {
+    const auto name = stations.name(s);
+    memcpy(name_bytes + name_end, name.data(), name.size());
+    name_end += name.size();
+    name_ends[s] = name_end;
+  }
+
+  auto* temperatures =
+      reinterpret_cast<int16_t*>(out + header.temperatures_offset);
+  RunThreads(n_threads, [&](int tid) {
+    auto& part = parts[tid];
+    for (size_t i = 0; i < part.ids.size(); ++i) {
+      const uint64_t row = part.cursors[part.ids[i]]++;
+      temperatures[row] = part.temperatures[i];
+    }
+    part = Part();
+  });
+
+  std::atomic<size_t> next_group = 0;
+  RunThreads(n_threads, [&](int) {
+    for (size_t g; (g = next_group.fetch_add(1, std::memory_order_relaxed)) <
+                   groups.size();) {
+      auto& group = groups[g];
+      WideRecord rec = kEmptyWideRecord;
+      HWY_DYNAMIC_DISPATCH(ReduceTemperatures)(temperatures + group.first_row,
+                                               group.n_rows, -999, 999, &rec);
+      group.min = -rec.min;
+      group.max = rec.max;
+      group.sum = rec.sum;
+    }
+  });
+  memcpy(out + header.groups_offset, groups.data(),
+         groups.size() * sizeof(RowGroup));
+  memcpy(out, &header, sizeof(header));
+
+  PCHECK(munmap(out, header.file_size) == 0);
+  PCHECK(close(fd) == 0);
+  PCHECK(rename(tmp_path.c_str(), path.c_str()) == 0)
+      << "Failed to rename " << tmp_path << " to " << path;
+}
+
+std::unique_ptr<ColumnCache> ColumnCache::Open(const std::string& path,
+                                               const struct stat& source) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat file_stat;
+  PCHECK(fstat(fd, &file_stat) == 0);
+
+  CacheHeader header;
+  if (file_stat.st_size < static_cast<off_t>(sizeof(header)) ||
+      pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+      memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.file_size != static_cast<uint64_t>(file_stat.st_size) ||
+      header.source_size != static_cast<uint64_t>(source.st_size) ||
+      header.source_mtime_ns != MtimeNs(source)) {
+    close(fd);
+    return nullptr;
+  }
+
+  const void* data =
+      mmap(nullptr, header.file_size, PROT_READ, MAP_SHARED, fd, 0);
+  PCHECK(data != MAP_FAILED) << "Failed to map " << path;
+  close(fd);
+  return std::unique_ptr<ColumnCache>(
+      new ColumnCache(static_cast<const char*>(data), header.file_size));
+}
+
+ColumnCache::ColumnCache(const char* data, size_t size)
+    : data_(data),
+      size_(size),
+      header_(reinterpret_cast<const CacheHeader*>(data)),
+      name_ends_(
+          reinterpret_cast<const uint32_t*>(data + header_->names_offset)),
+      name_bytes_(reinterpret_cast<const char*>(name_ends_ +
+                                                header_->n_stations)),
+      groups_(reinterpret_cast<const RowGroup*>(data + header_->groups_offset)),
+      temperatures_(reinterpret_cast<const int16_t*>(
+          data + header_->temperatures_offset)) {}
+
+ColumnCache::~ColumnCache() {
+  munmap(const_cast<char*>(data_), size_);
+}
+
+std::string_view ColumnCache::name(int station) const {
+  const uint32_t begin = station > 0 ? name_ends_[station - 1] : 0;
+  return {name_bytes_ + begin, name_ends_[station] - begin};
+}
+
+std::vector<std::pair<std::string_view, WideRecord>> ColumnCache::Query(
+    const CacheQuery& query, int n_threads, CacheQueryStats* stats) const {
+  const int n_stations = header_->n_stations;
+  int station = -1;
+  if (!query.station.empty()) {
+    for (int s = 0; s < n_stations && station < 0; ++s) {
+      if (name(s) == query.station) {
+        station = s;
+      }
+    }
+    if (station < 0) {
+      stats->groups_skipped += header_->n_groups;
+      return {};
+    }
+  }
+  const int lo = query.min_temperature;
+  const int hi = query.max_temperature;
+
+  std::vector<std::vector<WideRecord>> records(n_threads);
+  std::atomic<uint32_t> next_group = 0;
+  std::atomic<uint64_t> skipped = 0, from_stats = 0, scanned = 0;
+  RunThreads(n_threads, [&](int tid) {
+    auto& thread_records = records[tid];
+    thread_records.assign(n_stations, kEmptyWideRecord);
+    for (uint32_t g; (g = next_group.fetch_add(1, std::memory_order_relaxed)) <
+                     header_->n_groups;) {
+      const RowGroup& group = groups_[g];
+      if ((station >= 0 && group.station != station) || group.max < lo ||
+          group.min > hi) {
+        skipped.fetch_add(1, std::memory_order_relaxed);
+      } else if (lo <= group.min && group.max <= hi) {
+        Merge(thread_records[group.station],
+              WideRecord{group.sum, group.n_rows, -group.min, group.max});
+        from_stats.fetch_add(1, std::memory_order_relaxed);
+      } else {
+        HWY_DYNAMIC_DISPATCH(ReduceTemperatures)(
+            temperatures_ + group.first_row, group.n_rows, lo, hi,
+            &thread_records[group.station]);
+        scanned.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+  });
+  stats->groups_skipped += skipped;
+  stats->groups_from_stats += from_stats;
+  stats->groups_scanned += scanned;
+
+  std::vector<std::pair<std::string_view, WideRecord>> results;
+  for (int s = 0; s < n_stations; ++s) {
+    WideRecord rec = kEmptyWideRecord;
+    for (const auto& thread_records : records) {
+      Merge(rec, thread_records[s]);
+    }
+    results.emplace_back(name(s), rec);
+  }
+  return results;
+}
+
+}  // namespace g5::brc
+#endif  // HWY_ONCE
@@ -0,0 +1,122 @@
+// Columnar cache of parsed 1brc measurements, for repeated queries over the
+// same input.
+//
+// The text input is parsed once into a file with one column: the temperature
+// of each row in tenths of a degree (i16). Rows are clustered by station and
+// cut into row groups of at most kRowGroupRows rows, each with its station and
+// the min/max/sum/count of its temperatures, so rows need no station id. A
+// query maps the file and either skips a group, answers it from its stats,
+// or reduces its temperature column with SIMD.
+//
+// The cache records size and mtime of its source and is only used while both
+// still match.
+
+#ifndef EXPERIMENTAL_1BRC_COLUMN_CACHE_H_
+#define EXPERIMENTAL_1BRC_COLUMN_CACHE_H_
+
+#include <sys/stat.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "experimental/1brc/record.h"
+#include "experimental/1brc/scan.h"
+
+namespace g5::brc {
+
+// File layout, little endian: the header, then the sections it points to,
+// each aligned to 64 bytes.
+struct CacheHeader {
+  char magic[8];
+  uint64_t source_size;
+  int64_t source_mtime_ns;
+  uint64_t n_rows;
+  uint32_t n_stations;
+  uint32_t n_groups;
+  // uint32_t name ends[n_stations], followed by the name bytes.
+  uint64_t names_offset;
+  // RowGroup[n_groups].
+  uint64_t groups_offset;
+  // int16_t[n_rows].
+  uint64_t temperatures_offset;
+  uint64_t file_size;
+};
+
+struct RowGroup {
+  uint64_t first_row;
+  uint32_t n_rows;
+  uint16_t station;
+  int16_t min;
+  int16_t max;
+  int64_t sum;
+};
+static_assert(sizeof(RowGroup) == 32);
+
+inline constexpr uint32_t kRowGroupRows = 1 << 16;
+
+// Rows to aggregate, temperatures in tenths of a degree.
+struct CacheQuery {
+  // Only rows of this station, all stations if empty.
+  std::string station;
+  // Only temperatures within [min_temperature, max_temperature].
+  int min_temperature = -999;
+  int max_temperature = 999;
+};
+
+// How the row groups of a query were answered.
+struct CacheQueryStats {
+  uint64_t groups_skipped = 0;
+  uint64_t groups_from_stats = 0;
+  uint64_t groups_scanned = 0;
+};
+
+// Parses the text input [data, data + size) of file status `source` with
+// `n_threads` threads and writes its cache to `path`. The file is written
+// under a temporary name and renamed, so readers never see a partial cache.
+void BuildColumnCache(const char* data, size_t size, const struct stat& source,
+                      Parser parser, int n_threads, const std::string& path);
+
+class ColumnCache {
+ public:
+  // Maps the cache at `path`. Returns nullptr if there is no cache or it is
+  // stale for a source of file status `source`.
+  static std::unique_ptr<ColumnCache> Open(const std::string& path,
+                                           const struct stat& source);
+
+  ColumnCache(const ColumnCache&) = delete;
+  ColumnCache& operator=(const ColumnCache&) = delete;
+  ~ColumnCache();
+
+  // Returns total number of rows.
+  uint64_t rows() const { return header_->n_rows; }
+
+  // Returns size in bytes of the cache file.
+  uint64_t file_size() const { return size_; }
+
+  // Aggregates the rows matching `query` per station with `n_threads`
+  // threads.
+  std::vector<std::pair<std::string_view, WideRecord>> Query(
+      const CacheQuery& query, int n_threads, CacheQueryStats* stats) const;
+
+ private:
+  ColumnCache(const char* data, size_t size);
+
+  std::string_view name(int station) const;
+
+  const char* data_;
+  size_t size_;
+  const CacheHeader* header_;
+  const uint32_t* name_ends_;
+  const char* name_bytes_;
+  const RowGroup* groups_;
+  const int16_t* temperatures_;
+};
+
+}  // namespace g5::brc
+
+#endif  // EXPERIMENTAL_1BRC_COLUMN_CACHE_H_
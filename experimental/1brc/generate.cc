@@ -0,0 +1,144 @@
+// Writes a synthetic measurements file for 1brc.
+//
+// Chunks of rows are formatted in parallel and written in order, so the
+// output only depends on the flags, not on the number of threads. Output to a
+// name ending in .zst is compressed with one zstd frame per chunk, like pzstd
+// writes it, for the frame-parallel reader of 1brc.
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/usage.h"
+#include "absl/log/check.h"
+#include "experimental/1brc/synthetic.h"
+#include "riegeli/bytes/string_writer.h"
+#include "riegeli/zstd/zstd_writer.h"
+
+ABSL_FLAG(uint64_t, rows, 1'000'000'000, "Number of rows to write");
+
+ABSL_FLAG(int, stations, 413, "Number of distinct stations");
+
+ABSL_FLAG(std::string, names, "builtin",
+          "Station names: 'builtin' takes the first --stations names of the "
+          "built-in list, 'random' draws lowercase names");
+
+ABSL_FLAG(int, min_name_len, 3, "Shortest random name in bytes");
+
+ABSL_FLAG(int, max_name_len, 26, "Longest random name in bytes, at most 100");
+
+ABSL_FLAG(std::string, name_lengths, "uniform",
+          "Distribution of random name lengths: 'uniform' or 'geometric'");
+
+ABSL_FLAG(uint64_t, seed, 42, "Seed of the station set and the rows");
+
+ABSL_FLAG(uint64_t, chunk_rows, 1 << 20,
+          "Rows per independently generated chunk");
+
+ABSL_FLAG(int, threads, 0, "Generator threads, 0 for all cores");
+
+namespace {
+
+void WriteAll(int fd, const std::string& data) {
+  size_t n = 0;
+  while (n < data.size()) {
+    const ssize_t ret = write(fd, data.data() + n, data.size() - n);
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    }
+    PCHECK(ret > 0) << "Failed to write output";
+    n += ret;
+  }
+}
+
+// Returns `data` compressed as one zstd frame.
+std::string CompressFrame(const std::string& data) {
+  std::string frame;
+  riegeli::ZstdWriter<riegeli::StringWriter<std::string*>> writer(
+      riegeli::Maker(&frame));
+  CHECK(writer.Write(data) && writer.Close()) << writer.status();
+  return frame;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  absl::SetProgramUsageMessage(
+      "Writes synthetic 1brc measurements.\n"
+      "Usage: generate [flags] [measurements.txt | measurements.txt.zst | -]");
+  const std::vector<char*> args = absl::ParseCommandLine(argc, argv);
+  const std::string path = args.size() > 1 ? args[1] : "measurements.txt";
+  const bool zstd = path.ends_with(".zst");
+
+  const std::string names = absl::GetFlag(FLAGS_names);
+  CHECK(names == "builtin" || names == "random")
+      << "Unknown --names: " << names;
+  const std::string name_lengths = absl::GetFlag(FLAGS_name_lengths);
+  CHECK(name_lengths == "uniform" || name_lengths == "geometric")
+      << "Unknown --name_lengths: " << name_lengths;
+
+  g5::brc::SyntheticOptions options;
+  options.stations = absl::GetFlag(FLAGS_stations);
+  options.builtin_names = names == "builtin";
+  options.min_name_len = absl::GetFlag(FLAGS_min_name_len);
+  options.max_name_len = absl::GetFlag(FLAGS_max_name_len);
+  options.name_lengths = name_lengths == "uniform"
+                             ? g5::brc::NameLengths::kUniform
+                             : g5::brc::NameLengths::kGeometric;
+  options.seed = absl::GetFlag(FLAGS_seed);
+  const g5::brc::SyntheticStations stations(options);
+
+  const int fd =
+      path == "-" ? STDOUT_FILENO
+                  : open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  PCHECK(fd >= 0) << "Failed to open " << path;
+
+  const uint64_t n_rows = absl::GetFlag(FLAGS_rows);
+  const uint64_t chunk_rows =
+      std::max<uint64_t>(absl::GetFlag(FLAGS_chunk_rows), 1);
+  const uint64_t n_chunks = (n_rows + chunk_rows - 1) / chunk_rows;
+  const int n_threads = absl::GetFlag(FLAGS_threads) > 0
+                            ? absl::GetFlag(FLAGS_threads)
+                            : std::thread::hardware_concurrency();
+
+  // Thread t formats chunks t, t + n_threads, ... and waits for its turn to
+  // write each of them.
+  std::atomic<uint64_t> turn = 0;
+  {
+    std::vector<std::jthread> threads;
+    for (int tid = 0; tid < n_threads; ++tid) {
+      threads.emplace_back([&, tid] {
+        std::string buffer;
+        for (uint64_t chunk = tid; chunk < n_chunks; chunk += n_threads) {
+          buffer.clear();
+          stations.AppendRows(options.seed, chunk,
+                              std::min(chunk_rows, n_rows - chunk * chunk_rows),
+                              &buffer);
+          if (zstd) {
+            buffer = CompressFrame(buffer);
+          }
+          for (uint64_t t = turn.load(); t != chunk; t = turn.load()) {
+            turn.wait(t);
+          }
+          WriteAll(fd, buffer);
+          turn.store(chunk + 1);
+          turn.notify_all();
+        }
+      });
+    }
+  }
+
+  if (fd != STDOUT_FILENO) {
+    PCHECK(close(fd) == 0) << "Failed to close " << path;
+  }
+  return 0;
+}
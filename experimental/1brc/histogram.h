@@ -0,0 +1,139 @@
+// Exact per-station temperature histogram of 1brc, for percentiles.
+//
+// Temperatures are integers in tenths within [-99.9, 99.9], so one bin per
+// value is exact and bounded. A histogram starts sparse, with a few inline
+// (value, count) slots for rare stations, and turns dense with 16-bit bins
+// once they run out. A dense bin that wraps carries 2^16 into a lazily
+// allocated 64-bit spill bin, so the hot path is a single 16-bit increment.
+
+#ifndef EXPERIMENTAL_1BRC_HISTOGRAM_H_
+#define EXPERIMENTAL_1BRC_HISTOGRAM_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+
+namespace g5::brc {
+
+class Histogram {
+ public:
+  static constexpr int kMinValue = -999;
+  static constexpr int kMaxValue = 999;
+  static constexpr int kBins = kMaxValue - kMinValue + 1;
+
+  // Adds one temperature.
+  void Add(int val) {
+    if (bins_ != nullptr) [[likely]] {
+      const int bin = val - kMinValue;
+      if (++bins_[bin] == 0) [[unlikely]] {
+        Spill(bin);
+      }
+      return;
+    }
+    Add(val, 1);
+  }
+
+  // Adds `count` times temperature `val`.
+  void Add(int val, uint64_t count) {
+    if (bins_ == nullptr) {
+      for (int i = 0; i < n_sparse_; ++i) {
+        if (sparse_values_[i] == val &&
+            sparse_counts_[i] + count <= UINT16_MAX) {
+          sparse_counts_[i] += count;
+          return;
+        }
+      }
+      if (n_sparse_ < kSparseSlots && count <= UINT16_MAX) {
+        sparse_values_[n_sparse_] = val;
+        sparse_counts_[n_sparse_] = count;
+        n_sparse_ += 1;
+        return;
+      }
+      Densify();
+    }
+    const int bin = val - kMinValue;
+    const uint64_t total = bins_[bin] + count;
+    bins_[bin] = total & UINT16_MAX;
+    if (total > UINT16_MAX) {
+      if (spill_ == nullptr) {
+        spill_ = std::make_unique<uint64_t[]>(kBins);
+      }
+      spill_[bin] += total & ~uint64_t{UINT16_MAX};
+    }
+  }
+
+  // Adds all temperatures of `other`.
+  void Merge(const Histogram& other) {
+    other.ForEach([this](int val, uint64_t count) { Add(val, count); });
+  }
+
+  // Calls `fn(val, count)` for every temperature with a non-zero count, in
+  // no particular order.
+  template <typename Fn>
+  void ForEach(Fn&& fn) const {
+    if (bins_ == nullptr) {
+      for (int i = 0; i < n_sparse_; ++i) {
+        fn(sparse_values_[i], sparse_counts_[i]);
+      }
+      return;
+    }
+    for (int bin = 0; bin < kBins; ++bin) {
+      const uint64_t count = bins_[bin] + (spill_ ? spill_[bin] : 0);
+      if (count > 0) {
+        fn(bin + kMinValue, count);
+      }
+    }
+  }
+
+  // Returns the q-quantile by nearest rank: the smallest temperature with at
+  // least ceil(q * n) of the n temperatures at or below it. Must not be empty.
+  int Quantile(double q) const {
+    uint64_t counts[kBins] = {};
+    uint64_t n = 0;
+    ForEach([&](int val, uint64_t count) {
+      counts[val - kMinValue] += count;
+      n += count;
+    });
+    const uint64_t rank = std::max<uint64_t>(std::ceil(q * n), 1);
+    uint64_t seen = 0;
+    for (int bin = 0; bin < kBins; ++bin) {
+      seen += counts[bin];
+      if (seen >= rank) {
+        return bin + kMinValue;
+      }
+    }
+    return kMaxValue;
+  }
+
+ private:
+  static constexpr int kSparseSlots = 16;
+
+  [[gnu::noinline]] void Spill(int bin) {
+    if (spill_ == nullptr) {
+      spill_ = std::make_unique<uint64_t[]>(kBins);
+    }
+    spill_[bin] += uint64_t{UINT16_MAX} + 1;
+  }
+
+  [[gnu::noinline]] void Densify() {
+    bins_ = std::make_unique<uint16_t[]>(kBins);
+    const int n_sparse = n_sparse_;
+    n_sparse_ = 0;
+    for (int i = 0; i < n_sparse; ++i) {
+      Add(sparse_values_[i], sparse_counts_[i]);
+    }
+  }
+
+  // Dense bins, indexed by temperature - kMinValue, once allocated.
+  std::unique_ptr<uint16_t[]> bins_;
+  std::unique_ptr<uint64_t[]> spill_;
+
+  int16_t sparse_values_[kSparseSlots];
+  uint16_t sparse_counts_[kSparseSlots];
+  int n_sparse_ = 0;
+};
+
+}  // namespace g5::brc
+
+#endif  // EXPERIMENTAL_1BRC_HISTOGRAM_H_
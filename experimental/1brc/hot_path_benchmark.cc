@@ -0,0 +1,238 @@
+// Microbenchmarks of the 1brc hot path, one component at a time: station
+// lookup, temperature parsing, separator search, updating the accumulators and
+// merging partial results.
+//
+// Inputs come from synthetic.h, like the files written by :generate.
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "experimental/1brc/accumulators.h"
+#include "experimental/1brc/record.h"
+#include "experimental/1brc/stations.h"
+#include "experimental/1brc/synthetic.h"
+#include "hwy/highway.h"
+
+// Static target only, see 1brc --report_targets for the others.
+#include "experimental/1brc/scan-inl.h"
+
+namespace g5::brc {
+namespace {
+
+// Returns `n_rows` rows over the built-in stations, padded with tail room for
+// the loads past the last line.
+std::string MakeInput(size_t n_rows) {
+  const SyntheticStations stations(SyntheticOptions{});
+  std::string input;
+  stations.AppendRows(/*seed=*/42, /*chunk=*/0, n_rows, &input);
+  input.append(128, '\0');
+  return input;
+}
+
+// Returns the names and temperatures of all rows of `input`.
+void SplitRows(std::string_view input, std::vector<std::string_view>* names,
+               std::vector<const char*>* temperatures) {
+  for (size_t pos = 0; pos < input.size() && input[pos] != '\0';) {
+    const size_t semicolon = input.find(';', pos);
+    const size_t newline = input.find('\n', semicolon);
+    names->push_back(input.substr(pos, semicolon - pos));
+    temperatures->push_back(input.data() + semicolon + 1);
+    pos = newline + 1;
+  }
+}
+
+void BM_CityId(benchmark::State& state) {
+  const std::string input = MakeInput(state.range(0));
+  std::vector<std::string_view> names;
+  std::vector<const char*> temperatures;
+  SplitRows(input, &names, &temperatures);
+
+  for (auto _ : state) {
+    for (const auto name : names) {
+      benchmark::DoNotOptimize(city_id(name.data(), name.size()));
+    }
+  }
+  state.SetItemsProcessed(names.size() * state.iterations());
+}
+
+void BM_O1Hash(benchmark::State& state) {
+  const std::string input = MakeInput(state.range(0));
+  std::vector<std::string_view> names;
+  std::vector<const char*> temperatures;
+  SplitRows(input, &names, &temperatures);
+
+  for (auto _ : state) {
+    for (const auto name : names) {
+      benchmark::DoNotOptimize(o1hash(name.data(), name.size()));
+    }
+  }
+  state.SetItemsProcessed(names.size() * state.iterations());
+}
+
+void BM_ParseTemperature(benchmark::State& state) {
+  const std::string input = MakeInput(state.range(0));
+  std::vector<std::string_view> names;
+  std::vector<const char*> temperatures;
+  SplitRows(input, &names, &temperatures);
+
+  for (auto _ : state) {
+    int sum = 0;
+    for (const char* t : temperatures) {
+      int val;
+      HWY_NAMESPACE::ParseTemperature(t, &val);
+      sum += val;
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(temperatures.size() * state.iterations());
+}
+
+void BM_ParseTemperatureSwar(benchmark::State& state) {
+  const std::string input = MakeInput(state.range(0));
+  std::vector<std::string_view> names;
+  std::vector<const char*> temperatures;
+  SplitRows(input, &names, &temperatures);
+
+  for (auto _ : state) {
+    int sum = 0;
+    for (const char* t : temperatures) {
+      sum += HWY_NAMESPACE::ParseTemperatureSwar(t);
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(temperatures.size() * state.iterations());
+}
+
+// Finds every ';' one at a time, the baseline for the SIMD search.
+void BM_FindSemicolonMemchr(benchmark::State& state) {
+  const std::string input = MakeInput(state.range(0));
+  const char* const end = input.data() + input.size() - 128;
+
+  for (auto _ : state) {
+    size_t count = 0;
+    for (const char* p = input.data();; ++p) {
+      p = static_cast<const char*>(memchr(p, ';', end - p));
+      if (p == nullptr) {
+        break;
+      }
+      ++count;
+    }
+    benchmark::DoNotOptimize(count);
+  }
+  state.SetBytesProcessed((end - input.data()) * state.iterations());
+}
+
+void BM_FindSeparators(benchmark::State& state) {
+  const std::string input = MakeInput(state.range(0));
+  const char* const end = input.data() + input.size() - 128;
+
+  for (auto _ : state) {
+    size_t count = 0;
+    for (const char* p = input.data(); p < end;
+         p += HWY_NAMESPACE::kSwarWindow) {
+      uint64_t semicolons, newlines;
+      HWY_NAMESPACE::FindSeparators(p, &semicolons, &newlines);
+      count += std::popcount(semicolons);
+    }
+    benchmark::DoNotOptimize(count);
+  }
+  state.SetBytesProcessed((end - input.data()) * state.iterations());
+}
+
+// Returns `n_rows` random station ids below `n_stations` and temperatures.
+void MakeUpdates(size_t n_rows, int n_stations, std::vector<uint16_t>* ids,
+                 std::vector<int16_t>* temperatures) {
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> id(0, n_stations - 1);
+  std::uniform_int_distribution<int> temperature(-kMaxAbsTemperature,
+                                                 kMaxAbsTemperature);
+  for (size_t i = 0; i < n_rows; ++i) {
+    ids->push_back(id(rng));
+    temperatures->push_back(temperature(rng));
+  }
+}
+
+// Rows between two flushes below, about kFlushBytes of typical input.
+constexpr size_t kUpdateRows = 1 << 20;
+
+// Updates an array of Records, flushed into 64-bit totals after every
+// kUpdateRows rows.
+void BM_UpdateRecords(benchmark::State& state) {
+  const int n_stations = state.range(0);
+  std::vector<uint16_t> ids;
+  std::vector<int16_t> temperatures;
+  MakeUpdates(kUpdateRows, n_stations, &ids, &temperatures);
+  std::vector<Record> hot(n_stations, kEmptyRecord);
+  std::vector<WideRecord> cold(n_stations, kEmptyWideRecord);
+
+  for (auto _ : state) {
+    for (size_t i = 0; i < ids.size(); ++i) {
+      Update(hot[ids[i]], temperatures[i]);
+    }
+    FlushInto(&hot, &cold);
+    benchmark::DoNotOptimize(cold.data());
+  }
+  state.SetItemsProcessed(ids.size() * state.iterations());
+}
+
+// Same with a struct of arrays.
+void BM_UpdateColumns(benchmark::State& state) {
+  const int n_stations = state.range(0);
+  std::vector<uint16_t> ids;
+  std::vector<int16_t> temperatures;
+  MakeUpdates(kUpdateRows, n_stations, &ids, &temperatures);
+  HotColumns hot;
+  hot.Resize(n_stations);
+  std::vector<WideRecord> cold(n_stations, kEmptyWideRecord);
+
+  for (auto _ : state) {
+    for (size_t i = 0; i < ids.size(); ++i) {
+      hot.Update(ids[i], temperatures[i]);
+    }
+    hot.FlushInto(&cold);
+    benchmark::DoNotOptimize(cold.data());
+  }
+  state.SetItemsProcessed(ids.size() * state.iterations());
+}
+
+// Merges the records of all but the first thread into the first one.
+void BM_Merge(benchmark::State& state) {
+  const int n_threads = state.range(0);
+  const int n_stations = state.range(1);
+  std::vector<std::vector<Record>> records(
+      n_threads, std::vector<Record>(n_stations, Record{1, 1, 0, 0}));
+
+  for (auto _ : state) {
+    for (int i = 1; i < n_threads; ++i) {
+      for (int j = 0; j < n_stations; ++j) {
+        Merge(records[0][j], records[i][j]);
+      }
+    }
+    benchmark::DoNotOptimize(records[0].data());
+  }
+  state.SetItemsProcessed(int64_t{n_threads - 1} * n_stations *
+                          state.iterations());
+}
+
+// Arg: rows.
+BENCHMARK(BM_CityId)->Range(1 << 10, 1 << 20);
+BENCHMARK(BM_O1Hash)->Range(1 << 10, 1 << 20);
+BENCHMARK(BM_ParseTemperature)->Range(1 << 10, 1 << 20);
+BENCHMARK(BM_ParseTemperatureSwar)->Range(1 << 10, 1 << 20);
+BENCHMARK(BM_FindSemicolonMemchr)->Range(1 << 10, 1 << 20);
+BENCHMARK(BM_FindSeparators)->Range(1 << 10, 1 << 20);
+// Arg: stations.
+BENCHMARK(BM_UpdateRecords)->Arg(413)->Arg(10'000)->Arg(50'000);
+BENCHMARK(BM_UpdateColumns)->Arg(413)->Arg(10'000)->Arg(50'000);
+// Args: threads, stations.
+BENCHMARK(BM_Merge)->ArgsProduct({{8, 64, 256}, {413, 10'000}});
+
+}  // namespace
+}  // namespace g5::brc
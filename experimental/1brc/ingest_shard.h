@@ -0,0 +1,69 @@
+// Live per-station totals of the 1brc aggregation server.
+//
+// Every server thread owns a shard, which the Ingest streams it serves parse
+// their batches into with the 1brc kernels: 32-bit hot accumulators, flushed
+// into 64-bit totals. The lock of a shard is taken once per batch and only
+// ever contended by queries, which read all shards while ingestion goes on.
+
+#ifndef EXPERIMENTAL_1BRC_INGEST_SHARD_H_
+#define EXPERIMENTAL_1BRC_INGEST_SHARD_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+#include "experimental/1brc/accumulators.h"
+#include "experimental/1brc/record.h"
+#include "experimental/1brc/scan.h"
+#include "experimental/1brc/scan_stats.h"
+#include "experimental/1brc/station_table.h"
+
+namespace g5::brc {
+
+class IngestShard {
+ public:
+  // Readable bytes the kernels need behind the last line of a batch.
+  static constexpr size_t kTailRoom = 256;
+
+  explicit IngestShard(Parser parser) : parser_(parser) {}
+
+  // Aggregates the lines in [begin, end), which must be line boundaries with
+  // kTailRoom bytes behind `end`. Returns the number of lines.
+  uint64_t Add(const char* begin, const char* end) {
+    ScanStats stats;
+    std::lock_guard lock(mu_);
+    budget_.Scan(
+        begin, end,
+        [&](const char* b, const char* e) {
+          ScanDynamic(b, e, parser_, &table_, &hot_, nullptr, &stats);
+        },
+        [&] { FlushInto(&hot_, &totals_); });
+    return stats.rows;
+  }
+
+  // Calls `fn(name, totals)` for every station of the shard, with the totals
+  // of all lines added so far.
+  template <typename Fn>
+  void ForEach(Fn&& fn) {
+    std::lock_guard lock(mu_);
+    FlushInto(&hot_, &totals_);
+    for (size_t id = 0; id < totals_.size(); ++id) {
+      fn(table_.name(id), totals_[id]);
+    }
+  }
+
+ private:
+  const Parser parser_;
+
+  std::mutex mu_;
+  StationTable table_;
+  std::vector<Record> hot_;
+  std::vector<WideRecord> totals_;
+  FlushBudget budget_;
+};
+
+}  // namespace g5::brc
+
+#endif  // EXPERIMENTAL_1BRC_INGEST_SHARD_H_
@@ -0,0 +1,231 @@
+// Load generator of aggregator_server: streams synthetic 1brc rows into it
+// over concurrent Ingest streams for a while and reports the rate the server
+// took them at, optionally querying the totals during the run.
+//
+// The batches are generated up front and shared by all streams, so that the
+// rate is that of the transport and the server, not of the generator. Every
+// stream has a connection and a thread of its own.
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/usage.h"
+#include "absl/log/check.h"
+#include "asio/awaitable.hpp"
+#include "asio/co_spawn.hpp"
+#include "asio/detached.hpp"
+#include "asio/use_awaitable.hpp"
+#include "experimental/1brc/aggregator.grpc.pb.h"
+#include "experimental/1brc/aggregator.pb.h"
+#include "experimental/1brc/synthetic.h"
+#include "grpcpp/channel.h"
+#include "grpcpp/client_context.h"
+#include "grpcpp/create_channel.h"
+#include "grpcpp/security/credentials.h"
+#include "grpcpp/support/channel_arguments.h"
+#include "third_party/agrpc/asio_grpc.hpp"
+
+ABSL_FLAG(std::string, address, "localhost:50051", "Server to load");
+
+ABSL_FLAG(int, streams, 0, "Concurrent Ingest streams, 0 for all cores");
+
+ABSL_FLAG(double, seconds, 10, "Duration of the run");
+
+ABSL_FLAG(uint64_t, batch_size, 1 << 20,
+          "Size in bytes of an IngestRequest, whole lines only");
+
+ABSL_FLAG(int, batches, 64,
+          "Distinct batches generated up front, sent round-robin");
+
+ABSL_FLAG(int, stations, 413, "Number of distinct stations");
+
+ABSL_FLAG(uint64_t, seed, 42, "Seed of the synthetic rows");
+
+ABSL_FLAG(int, query_interval_ms, 0,
+          "Query the totals at this interval during the run and report the "
+          "latencies, 0 for no queries");
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using g5::brc::Aggregator;
+
+using IngestRPC = agrpc::ClientRPC<&Aggregator::Stub::PrepareAsyncIngest>;
+using QueryRPC = agrpc::ClientRPC<&Aggregator::Stub::PrepareAsyncQuery>;
+
+struct Batch {
+  g5::brc::IngestRequest request;
+  uint64_t rows = 0;
+};
+
+// Rows generated at a time, until a batch is full.
+constexpr size_t kChunkRows = 1024;
+
+std::vector<Batch> MakeBatches(const g5::brc::SyntheticStations& stations,
+                               int n_batches, size_t batch_size,
+                               uint64_t seed) {
+  std::vector<Batch> batches(n_batches);
+  uint64_t chunk = 0;
+  for (Batch& batch : batches) {
+    std::string& rows = *batch.request.mutable_rows();
+    while (rows.size() < batch_size) {
+      stations.AppendRows(seed, chunk++, kChunkRows, &rows);
+      batch.rows += kChunkRows;
+    }
+  }
+  return batches;
+}
+
+// Opens a channel with a connection of its own, instead of the one shared by
+// all channels to the same server.
+std::shared_ptr<grpc::Channel> NewChannel(const std::string& address) {
+  grpc::ChannelArguments args;
+  args.SetInt(GRPC_ARG_USE_LOCAL_SUBCHANNEL_POOL, 1);
+  return grpc::CreateCustomChannel(
+      address, grpc::InsecureChannelCredentials(), args);
+}
+
+struct StreamResult {
+  uint64_t rows = 0;
+  uint64_t bytes = 0;
+};
+
+// Sends the batches from the `first`-th on, round-robin, until `deadline`.
+asio::awaitable<void> Stream(agrpc::GrpcContext& context, Aggregator::Stub& stub,
+                             const std::vector<Batch>& batches, size_t first,
+                             Clock::time_point deadline,
+                             StreamResult* result) {
+  IngestRPC rpc(context);
+  g5::brc::IngestResponse response;
+  CHECK(co_await rpc.start(stub, response, asio::use_awaitable))
+      << "Failed to start Ingest";
+  for (size_t i = first; Clock::now() < deadline; ++i) {
+    const Batch& batch = batches[i % batches.size()];
+    if (!co_await rpc.write(batch.request, asio::use_awaitable)) {
+      break;
+    }
+    result->rows += batch.rows;
+    result->bytes += batch.request.rows().size();
+  }
+  const grpc::Status status = co_await rpc.finish(asio::use_awaitable);
+  CHECK(status.ok()) << "Ingest failed: " << status.error_message();
+  CHECK_EQ(response.rows(), result->rows) << "Server lost rows";
+}
+
+// Issues a Query every `interval` until `deadline`, and appends the latency
+// of each to `latencies`.
+asio::awaitable<void> QueryLoop(agrpc::GrpcContext& context,
+                                Aggregator::Stub& stub,
+                                std::chrono::milliseconds interval,
+                                Clock::time_point deadline,
+                                std::vector<Clock::duration>* latencies) {
+  agrpc::Alarm alarm(context);
+  for (auto next = Clock::now(); next < deadline; next += interval) {
+    co_await alarm.wait(std::chrono::system_clock::now() +
+                            (next - Clock::now()),
+                        asio::use_awaitable);
+    grpc::ClientContext client_context;
+    g5::brc::QueryResponse response;
+    const auto t0 = Clock::now();
+    const grpc::Status status =
+        co_await QueryRPC::request(context, stub, client_context, {}, response,
+                                   asio::use_awaitable);
+    CHECK(status.ok()) << "Query failed: " << status.error_message();
+    latencies->push_back(Clock::now() - t0);
+  }
+}
+
+double Millis(Clock::duration d) {
+  return std::chrono::duration<double, std::milli>(d).count();
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  absl::SetProgramUsageMessage(
+      "Streams synthetic 1brc rows into aggregator_server and reports the "
+      "rate.\n"
+      "Usage: load_generator [flags]");
+  absl::ParseCommandLine(argc, argv);
+
+  const std::string address = absl::GetFlag(FLAGS_address);
+  const int n_streams = absl::GetFlag(FLAGS_streams) > 0
+                            ? absl::GetFlag(FLAGS_streams)
+                            : std::thread::hardware_concurrency();
+  CHECK_GT(absl::GetFlag(FLAGS_batches), 0);
+  CHECK_GT(absl::GetFlag(FLAGS_batch_size), 0u);
+
+  g5::brc::SyntheticOptions options;
+  options.stations = absl::GetFlag(FLAGS_stations);
+  options.seed = absl::GetFlag(FLAGS_seed);
+  const g5::brc::SyntheticStations stations(options);
+  const std::vector<Batch> batches =
+      MakeBatches(stations, absl::GetFlag(FLAGS_batches),
+                  absl::GetFlag(FLAGS_batch_size), options.seed);
+
+  std::vector<StreamResult> results(n_streams);
+  std::vector<Clock::duration> latencies;
+  const auto t0 = Clock::now();
+  const auto deadline =
+      t0 + std::chrono::duration_cast<Clock::duration>(
+               std::chrono::duration<double>(absl::GetFlag(FLAGS_seconds)));
+  {
+    std::vector<std::jthread> threads;
+    for (int i = 0; i < n_streams; ++i) {
+      threads.emplace_back([&, i] {
+        agrpc::GrpcContext context;
+        Aggregator::Stub stub(NewChannel(address));
+        asio::co_spawn(context,
+                       Stream(context, stub, batches,
+                              i * batches.size() / n_streams, deadline,
+                              &results[i]),
+                       asio::detached);
+        context.run();
+      });
+    }
+    if (const int interval = absl::GetFlag(FLAGS_query_interval_ms)) {
+      threads.emplace_back([&, interval] {
+        agrpc::GrpcContext context;
+        Aggregator::Stub stub(NewChannel(address));
+        asio::co_spawn(context,
+                       QueryLoop(context, stub,
+                                 std::chrono::milliseconds(interval), deadline,
+                                 &latencies),
+                       asio::detached);
+        context.run();
+      });
+    }
+  }
+  const double seconds =
+      std::chrono::duration<double>(Clock::now() - t0).count();
+
+  StreamResult total;
+  for (const StreamResult& result : results) {
+    total.rows += result.rows;
+    total.bytes += result.bytes;
+  }
+  std::cout << std::format(
+      "{} streams: {} rows, {:.1f} MiB in {:.2f}s, {:.2f}M rows/s, "
+      "{:.1f} MiB/s\n",
+      n_streams, total.rows, total.bytes / 1048576.0, seconds,
+      total.rows / seconds / 1e6, total.bytes / 1048576.0 / seconds);
+  if (!latencies.empty()) {
+    std::ranges::sort(latencies);
+    std::cout << std::format(
+        "{} queries: p50 {:.2f}ms, p99 {:.2f}ms, max {:.2f}ms\n",
+        latencies.size(), Millis(latencies[latencies.size() / 2]),
+        Millis(latencies[latencies.size() * 99 / 100]),
+        Millis(latencies.back()));
+  }
+  return 0;
+}
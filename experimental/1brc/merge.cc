@@ -0,0 +1,69 @@
+// Combines partial aggregates written by `1brc --partial_out` and prints the
+// totals like 1brc does.
+//
+// Partials are read and summed in parallel, one accumulator per thread, and
+// the accumulators are combined at the end. Stations are matched by name, so
+// partials of any station set merge.
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/usage.h"
+#include "absl/log/check.h"
+#include "experimental/1brc/checkpoint.h"
+#include "experimental/1brc/histogram.h"
+#include "experimental/1brc/partial.h"
+#include "experimental/1brc/print.h"
+
+ABSL_FLAG(bool, percentiles, false,
+          "Also report the exact median, 95th and 99th percentile per "
+          "station. All partials must have been written with --percentiles");
+
+ABSL_FLAG(int, threads, 0, "Reader threads, 0 for all cores");
+
+int main(int argc, char* argv[]) {
+  absl::SetProgramUsageMessage(
+      "Combines 1brc partial aggregates and prints the totals.\n"
+      "Usage: merge [flags] partial...");
+  const std::vector<char*> args = absl::ParseCommandLine(argc, argv);
+  CHECK_GT(args.size(), 1) << "No partials given";
+  const std::vector<std::string> paths(args.begin() + 1, args.end());
+
+  const bool percentiles = absl::GetFlag(FLAGS_percentiles);
+  const int n_threads = std::min<int>(
+      absl::GetFlag(FLAGS_threads) > 0 ? absl::GetFlag(FLAGS_threads)
+                                       : std::thread::hardware_concurrency(),
+      paths.size());
+
+  std::deque<g5::brc::Checkpoint> totals;
+  for (int tid = 0; tid < n_threads; ++tid) {
+    totals.emplace_back(percentiles);
+  }
+  std::atomic<size_t> next = 0;
+  {
+    std::vector<std::jthread> threads;
+    for (int tid = 0; tid < n_threads; ++tid) {
+      threads.emplace_back([&, tid] {
+        for (size_t i = next++; i < paths.size(); i = next++) {
+          g5::brc::ReadPartial(paths[i], &totals[tid]);
+        }
+      });
+    }
+  }
+
+  for (int tid = 1; tid < n_threads; ++tid) {
+    const auto results = totals[tid].results();
+    for (int i = 0; i < results.size(); ++i) {
+      totals[0].Add(results[i].first, results[i].second,
+                    percentiles ? &totals[tid].histogram(i) : nullptr);
+    }
+  }
+  g5::brc::PrintTotals(totals[0]);
+  return 0;
+}
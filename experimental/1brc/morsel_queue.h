@@ -0,0 +1,129 @@
+// Work-stealing distribution of newline-aligned morsels of an in-memory input.
+//
+// The input is cut into fixed-size morsels whose boundaries are moved forward
+// to the next line start. Every worker owns a contiguous range of morsel
+// indices, which it consumes from the front; workers that run dry steal half
+// of the remaining range of another worker from the back. Ranges are packed
+// into a single atomic word, so both operations are one compare-and-swap.
+
+#ifndef EXPERIMENTAL_1BRC_MORSEL_QUEUE_H_
+#define EXPERIMENTAL_1BRC_MORSEL_QUEUE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+#include "absl/log/check.h"
+
+namespace g5::brc {
+
+class MorselQueue {
+ public:
+  // A morsel covers the complete lines in [begin, end).
+  struct Morsel {
+    const char* begin;
+    const char* end;
+  };
+
+  MorselQueue(const char* data, size_t size, size_t morsel_size, int n_workers)
+      : data_(data),
+        size_(size),
+        morsel_size_(std::max<size_t>(morsel_size, 1)),
+        n_workers_(n_workers),
+        workers_(std::make_unique<Worker[]>(n_workers)) {
+    const uint64_t n_morsels = (size_ + morsel_size_ - 1) / morsel_size_;
+    CHECK_LE(n_morsels, UINT32_MAX) << "Morsel size too small";
+    for (int w = 0; w < n_workers_; ++w) {
+      workers_[w].range.store(Pack(n_morsels * w / n_workers_,
+                                   n_morsels * (w + 1) / n_workers_),
+                              std::memory_order_relaxed);
+    }
+  }
+
+  // Returns the next morsel for `worker`, stealing from other workers once
+  // its own range is exhausted. Returns false when no work is left.
+  bool Next(int worker, Morsel* morsel) {
+    uint32_t index;
+    if (!Pop(worker, &index) && !Steal(worker, &index)) {
+      return false;
+    }
+    morsel->begin = LineStart(uint64_t{index} * morsel_size_);
+    morsel->end = LineStart((uint64_t{index} + 1) * morsel_size_);
+    return true;
+  }
+
+  // Returns number of successful steals by `worker`.
+  int steals(int worker) const { return workers_[worker].steals; }
+
+ private:
+  struct alignas(64) Worker {
+    // Morsel indices [lo, hi) as (hi << 32) | lo.
+    std::atomic<uint64_t> range;
+    // Only touched by the owning worker.
+    int steals = 0;
+  };
+
+  static uint64_t Pack(uint32_t lo, uint32_t hi) {
+    return (uint64_t{hi} << 32) | lo;
+  }
+  static uint32_t Lo(uint64_t range) { return range; }
+  static uint32_t Hi(uint64_t range) { return range >> 32; }
+
+  // Returns the first line start at or after `offset`.
+  const char* LineStart(uint64_t offset) const {
+    if (offset == 0) {
+      return data_;
+    }
+    if (offset >= size_) {
+      return data_ + size_;
+    }
+    const void* nl = memchr(data_ + offset - 1, '\n', size_ - offset + 1);
+    return nl ? static_cast<const char*>(nl) + 1 : data_ + size_;
+  }
+
+  bool Pop(int worker, uint32_t* index) {
+    auto& range = workers_[worker].range;
+    uint64_t r = range.load(std::memory_order_relaxed);
+    while (Lo(r) < Hi(r)) {
+      if (range.compare_exchange_weak(r, Pack(Lo(r) + 1, Hi(r)),
+                                      std::memory_order_relaxed)) {
+        *index = Lo(r);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool Steal(int thief, uint32_t* index) {
+    for (int i = 1; i < n_workers_; ++i) {
+      auto& range = workers_[(thief + i) % n_workers_].range;
+      uint64_t r = range.load(std::memory_order_relaxed);
+      while (Lo(r) < Hi(r)) {
+        const uint32_t split = Hi(r) - (Hi(r) - Lo(r) + 1) / 2;
+        if (range.compare_exchange_weak(r, Pack(Lo(r), split),
+                                        std::memory_order_relaxed)) {
+          // Keep the first stolen morsel and publish the rest as our own.
+          workers_[thief].range.store(Pack(split + 1, Hi(r)),
+                                      std::memory_order_relaxed);
+          workers_[thief].steals += 1;
+          *index = split;
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  const char* data_;
+  size_t size_;
+  size_t morsel_size_;
+  int n_workers_;
+  std::unique_ptr<Worker[]> workers_;
+};
+
+}  // namespace g5::brc
+
+#endif  // EXPERIMENTAL_1BRC_MORSEL_QUEUE_H_
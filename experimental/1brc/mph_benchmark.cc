@@ -0,0 +1,243 @@
+// Benchmarks of the runtime perfect hash of mph_runtime.h against the
+// constexpr one that city_id() uses and against absl::flat_hash_map: the cost
+// to build each from a key set, and the cost of a lookup once built.
+//
+// Station keys are the o1hash() of the built-in names, looked up in the order
+// of synthetic rows. Larger sets are random 64-bit keys, looked up in random
+// order, one at a time or in batches.
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "benchmark/benchmark.h"
+#include "experimental/1brc/mph_runtime.h"
+#include "experimental/1brc/stations.h"
+#include "experimental/1brc/synthetic.h"
+
+namespace g5::brc {
+namespace {
+
+using StationHash = g5::mph::perfect_hash<uint32_t, uint16_t>;
+using KeyHash = g5::mph::perfect_hash<uint64_t, uint32_t>;
+
+constexpr size_t kProbes = 1 << 16;
+
+std::vector<uint32_t> StationKeys() {
+  std::vector<uint32_t> keys;
+  for (size_t i = 0; i < city_count(); ++i) {
+    const std::string_view name = city_name(i);
+    keys.push_back(o1hash(name.data(), name.size()));
+  }
+  return keys;
+}
+
+// Returns the station names of `kProbes` synthetic rows.
+std::vector<std::string> StationProbes() {
+  const SyntheticStations stations(SyntheticOptions{});
+  std::string input;
+  stations.AppendRows(/*seed=*/42, /*chunk=*/0, kProbes, &input);
+  std::vector<std::string> names;
+  for (size_t pos = 0; pos < input.size();) {
+    const size_t semicolon = input.find(';', pos);
+    names.emplace_back(input, pos, semicolon - pos);
+    pos = input.find('\n', semicolon) + 1;
+  }
+  return names;
+}
+
+// Returns `n` unique random keys mapped to their index.
+std::vector<std::pair<uint64_t, uint32_t>> RandomEntries(size_t n) {
+  std::mt19937_64 rng(n);
+  absl::flat_hash_map<uint64_t, uint32_t> seen;
+  std::vector<std::pair<uint64_t, uint32_t>> entries;
+  while (entries.size() < n) {
+    const uint64_t key = rng();
+    if (seen.emplace(key, entries.size()).second) {
+      entries.emplace_back(key, entries.size());
+    }
+  }
+  return entries;
+}
+
+// Returns `kProbes` keys of `entries` in random order.
+std::vector<uint64_t> RandomProbes(
+    const std::vector<std::pair<uint64_t, uint32_t>>& entries) {
+  std::mt19937_64 rng(entries.size() + 1);
+  std::uniform_int_distribution<size_t> index(0, entries.size() - 1);
+  std::vector<uint64_t> probes(kProbes);
+  for (uint64_t& probe : probes) {
+    probe = entries[index(rng)].first;
+  }
+  return probes;
+}
+
+void BM_BuildStationsRuntime(benchmark::State& state) {
+  const std::vector<uint32_t> keys = StationKeys();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(StationHash::build(keys));
+  }
+  state.SetItemsProcessed(keys.size() * state.iterations());
+}
+
+void BM_BuildStationsFlatHashMap(benchmark::State& state) {
+  const std::vector<uint32_t> keys = StationKeys();
+  for (auto _ : state) {
+    absl::flat_hash_map<uint32_t, uint16_t> map;
+    map.reserve(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+      map.emplace(keys[i], i);
+    }
+    benchmark::DoNotOptimize(map);
+  }
+  state.SetItemsProcessed(keys.size() * state.iterations());
+}
+
+void BM_LookupStationsConstexpr(benchmark::State& state) {
+  const std::vector<std::string> probes = StationProbes();
+  for (auto _ : state) {
+    for (const std::string& name : probes) {
+      benchmark::DoNotOptimize(city_id(name.data(), name.size()));
+    }
+  }
+  state.SetItemsProcessed(probes.size() * state.iterations());
+}
+
+void BM_LookupStationsRuntime(benchmark::State& state) {
+  const std::vector<std::string> probes = StationProbes();
+  const auto hash = StationHash::build(StationKeys());
+  state.counters["bucket_size"] = hash->bucket_size();
+  for (auto _ : state) {
+    for (const std::string& name : probes) {
+      benchmark::DoNotOptimize(
+          hash->lookup(o1hash(name.data(), name.size())));
+    }
+  }
+  state.SetItemsProcessed(probes.size() * state.iterations());
+}
+
+void BM_LookupStationsFlatHashMap(benchmark::State& state) {
+  const std::vector<std::string> probes = StationProbes();
+  const std::vector<uint32_t> keys = StationKeys();
+  absl::flat_hash_map<uint32_t, uint16_t> map;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    map.emplace(keys[i], i);
+  }
+  for (auto _ : state) {
+    for (const std::string& name : probes) {
+      benchmark::DoNotOptimize(
+          map.find(o1hash(name.data(), name.size()))->second);
+    }
+  }
+  state.SetItemsProcessed(probes.size() * state.iterations());
+}
+
+void BM_BuildRuntime(benchmark::State& state) {
+  const auto entries = RandomEntries(state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(KeyHash::build(entries));
+  }
+  state.SetItemsProcessed(entries.size() * state.iterations());
+}
+
+void BM_BuildFlatHashMap(benchmark::State& state) {
+  const auto entries = RandomEntries(state.range(0));
+  for (auto _ : state) {
+    absl::flat_hash_map<uint64_t, uint32_t> map(entries.begin(),
+                                                entries.end());
+    benchmark::DoNotOptimize(map);
+  }
+  state.SetItemsProcessed(entries.size() * state.iterations());
+}
+
+void BM_FindRuntime(benchmark::State& state) {
+  const auto entries = RandomEntries(state.range(0));
+  const std::vector<uint64_t> probes = RandomProbes(entries);
+  const auto hash = KeyHash::build(entries);
+  state.counters["bucket_size"] = hash->bucket_size();
+  state.counters["slots"] = hash->slots();
+  for (auto _ : state) {
+    for (const uint64_t key : probes) {
+      benchmark::DoNotOptimize(*hash->find(key));
+    }
+  }
+  state.SetItemsProcessed(probes.size() * state.iterations());
+}
+
+void BM_FindFlatHashMap(benchmark::State& state) {
+  const auto entries = RandomEntries(state.range(0));
+  const std::vector<uint64_t> probes = RandomProbes(entries);
+  const absl::flat_hash_map<uint64_t, uint32_t> map(entries.begin(),
+                                                    entries.end());
+  for (auto _ : state) {
+    for (const uint64_t key : probes) {
+      benchmark::DoNotOptimize(map.find(key)->second);
+    }
+  }
+  state.SetItemsProcessed(probes.size() * state.iterations());
+}
+
+// Looks up the probes in batches of state.range(0) keys, from a set of
+// state.range(1) keys.
+void BM_LookupBatch(benchmark::State& state) {
+  const size_t batch = state.range(0);
+  const auto entries = RandomEntries(state.range(1));
+  const std::vector<uint64_t> probes = RandomProbes(entries);
+  const auto hash = KeyHash::build(entries);
+  std::vector<uint32_t> ids(probes.size());
+  for (auto _ : state) {
+    for (size_t i = 0; i < probes.size(); i += batch) {
+      hash->lookup(std::span(probes).subspan(i, batch),
+                   std::span(ids).subspan(i, batch));
+    }
+    benchmark::DoNotOptimize(ids.data());
+    benchmark::ClobberMemory();
+  }
+  state.counters["ns_per_key"] = benchmark::Counter(
+      probes.size() * 1e-9,
+      benchmark::Counter::kIsIterationInvariantRate |
+          benchmark::Counter::kInvert);
+  state.SetItemsProcessed(probes.size() * state.iterations());
+}
+
+void BM_FindBatch(benchmark::State& state) {
+  const size_t batch = state.range(0);
+  const auto entries = RandomEntries(state.range(1));
+  const std::vector<uint64_t> probes = RandomProbes(entries);
+  const auto hash = KeyHash::build(entries);
+  std::vector<KeyHash::result_type> ids(probes.size());
+  for (auto _ : state) {
+    for (size_t i = 0; i < probes.size(); i += batch) {
+      hash->find(std::span(probes).subspan(i, batch),
+                 std::span(ids).subspan(i, batch));
+    }
+    benchmark::DoNotOptimize(ids.data());
+    benchmark::ClobberMemory();
+  }
+  state.counters["ns_per_key"] = benchmark::Counter(
+      probes.size() * 1e-9,
+      benchmark::Counter::kIsIterationInvariantRate |
+          benchmark::Counter::kInvert);
+  state.SetItemsProcessed(probes.size() * state.iterations());
+}
+
+BENCHMARK(BM_BuildStationsRuntime);
+BENCHMARK(BM_BuildStationsFlatHashMap);
+BENCHMARK(BM_LookupStationsConstexpr);
+BENCHMARK(BM_LookupStationsRuntime);
+BENCHMARK(BM_LookupStationsFlatHashMap);
+BENCHMARK(BM_BuildRuntime)->RangeMultiplier(8)->Range(1 << 10, 1 << 19);
+BENCHMARK(BM_BuildFlatHashMap)->RangeMultiplier(8)->Range(1 << 10, 1 << 19);
+BENCHMARK(BM_FindRuntime)->RangeMultiplier(8)->Range(1 << 10, 1 << 19);
+BENCHMARK(BM_FindFlatHashMap)->RangeMultiplier(8)->Range(1 << 10, 1 << 19);
+BENCHMARK(BM_LookupBatch)->ArgsProduct({{1, 4, 8, 16}, {413, 1 << 19}});
+BENCHMARK(BM_FindBatch)->ArgsProduct({{1, 4, 8, 16}, {413, 1 << 19}});
+
+}  // namespace
+}  // namespace g5::brc
@@ -0,0 +1,455 @@
+// Runtime [minimal] perfect hash, an extension of the vendored mph.h kept out
+// of third_party/mph so that updating mph leaves it alone. It follows the
+// idiom of mph.h and builds on its helpers.
+//
+// mph::lookup and mph::find take their keys as a constexpr array, so a key
+// set that is only known at startup cannot use them. g5::mph::perfect_hash
+// runs the same greedy mask search on such a set when it is built, and answers with the same branch-free probe: pext(key, mask) indexes
+// a table whose slot either holds the key or no key of the set at all.
+//
+// A mask that maps every key to its own slot needs about 2 * log2(n) bits for
+// random keys, so its table grows with n^2 and is out of reach well before
+// 100k keys. The search then allows up to 2, 4, 8 and at most 16 keys per
+// slot, the way find$simd does, and the probe compares the whole bucket at
+// once. Tiny sets with small values get the magic LUT of lookup$magic_lut.
+//
+// Batch lookups hash up to 16 keys and prefetch their slots before reading
+// any of them, so the table misses of a batch overlap instead of queueing
+// behind each other.
+//
+// Without BMI2 the pext of a runtime mask is emulated with one table lookup
+// per key byte that the mask covers, instead of the bit loop of detail::pext.
+
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "third_party/mph/mph.h"
+
+namespace g5::mph {
+
+using ::mph::conditional;
+using ::mph::optional;
+using ::mph::to;
+using ::mph::u32;
+using ::mph::u64;
+using ::mph::u8;
+
+template<class TKey, class TMapped>
+  requires (std::is_unsigned_v<TKey> and sizeof(TKey) <= sizeof(u64))
+class perfect_hash {
+ public:
+  using key_type = TKey;
+  using mapped_type = TMapped;
+  using result_type = optional<mapped_type>;
+
+  static constexpr u32 max_bucket_size = 16u;
+  static constexpr u32 max_batch_size = 16u;
+
+  /**
+   * Builds a perfect hash of key/value pairs
+   * @param entries pairs with unique keys
+   * @param max_slots_per_key largest table, relative to the number of keys,
+   *        worth keeping a smaller bucket size for
+   * @return nullopt if there are no keys, which no table can miss for every
+   *         probe, or they are not unique
+   */
+  [[nodiscard]] static auto build(std::span<const std::pair<key_type, mapped_type>> entries,
+                                  const u32 max_slots_per_key = 8u) -> std::optional<perfect_hash> {
+    if (entries.empty()) {
+      return std::nullopt;
+    }
+    std::vector<key_type> keys(entries.size());
+    for (auto i = 0u; i < entries.size(); ++i) {
+      keys[i] = entries[i].first;
+    }
+    {
+      auto sorted = keys;
+      std::ranges::sort(sorted);
+      if (std::ranges::adjacent_find(sorted) != sorted.end()) {
+        return std::nullopt;
+      }
+    }
+
+    perfect_hash ph{};
+    if constexpr (requires (mapped_type v) { u64(v); }) {
+      ph.search_magic(entries);
+    }
+
+    // Grows the bucket until the table fits, starting from the bits on which
+    // keys differ at all.
+    const auto max_slots = std::max<u64>(u64(max_slots_per_key) * keys.size(), 1u << 16u);
+    key_type mask{};
+    for (const auto k : keys) {
+      mask |= k ^ keys.front();
+    }
+    for (u32 bucket_size = 1u;; bucket_size <<= 1u) {
+      const auto max_bits = bucket_size == max_bucket_size ? u32(size) : u32(std::bit_width(max_slots / bucket_size)) - 1u;
+      if (const auto found = search_mask(keys, bucket_size, mask, max_bits)) {
+        ph.mask_ = *found;
+        ph.bucket_size_ = bucket_size;
+        break;
+      }
+    }
+    ph.fill(entries);
+    return ph;
+  }
+
+  /**
+   * Builds a perfect hash which maps the i-th key to i
+   * @param keys unique keys, at least one
+   */
+  [[nodiscard]] static auto build(std::span<const key_type> keys, const u32 max_slots_per_key = 8u)
+    -> std::optional<perfect_hash> {
+    std::vector<std::pair<key_type, mapped_type>> entries(keys.size());
+    for (auto i = 0u; i < keys.size(); ++i) {
+      entries[i] = {keys[i], mapped_type(i)};
+    }
+    return build(entries, max_slots_per_key);
+  }
+
+  /**
+   * Returns the value of a key of the set; any value for other keys
+   */
+  [[nodiscard]] [[gnu::always_inline]] auto lookup(const auto& key) const noexcept -> mapped_type {
+    const auto k = to<key_type>(key);
+    if (magic_) {
+      return mapped_type((magic_lut_ >> (key_type(k * magic_) >> magic_shift_)) & magic_mask_);
+    }
+    switch (bucket_size_) {
+      case 1u: return values_[extract(k)];
+      case 2u: return values_[bucket<2u>(k).first];
+      case 4u: return values_[bucket<4u>(k).first];
+      case 8u: return values_[bucket<8u>(k).first];
+      default: return values_[bucket<16u>(k).first];
+    }
+  }
+
+  /**
+   * Returns the value of a key, or `ts...` if it is not in the set
+   */
+  template<u8 probability = 50u> requires (probability >= 0u and probability <= 100u)
+  [[nodiscard]] [[gnu::always_inline]] auto find(const auto& key, const auto&... ts) const noexcept
+    -> result_type {
+    const auto k = to<key_type>(key);
+    const auto [index, found] = [&] {
+      switch (bucket_size_) {
+        case 1u: return bucket<1u>(k);
+        case 2u: return bucket<2u>(k);
+        case 4u: return bucket<4u>(k);
+        case 8u: return bucket<8u>(k);
+        default: return bucket<16u>(k);
+      }
+    }();
+    return conditional<probability>(found, result_type(values_[index]), result_type(ts...));
+  }
+
+  /**
+   * Looks up keys of the set, like lookup(keys[i]) into out[i]. Up to
+   * max_batch_size keys are hashed and their slots prefetched before the
+   * first one is read, so their table misses overlap.
+   * @param keys integers, or strings of up to sizeof(key_type) bytes
+   */
+  template<class T>
+  void lookup(std::span<const T> keys, std::span<mapped_type> out) const noexcept {
+    if (magic_) {
+      for (std::size_t i = 0u; i < keys.size(); ++i) {
+        out[i] = lookup(keys[i]);
+      }
+      return;
+    }
+    const auto store = [&](std::size_t i, std::size_t slot, bool) { out[i] = values_[slot]; };
+    switch (bucket_size_) {
+      case 1u: return batch<1u>(keys, store);
+      case 2u: return batch<2u>(keys, store);
+      case 4u: return batch<4u>(keys, store);
+      case 8u: return batch<8u>(keys, store);
+      default: return batch<16u>(keys, store);
+    }
+  }
+
+  /**
+   * Finds keys, like find(keys[i]) into out[i], with the slots of up to
+   * max_batch_size keys prefetched at once as in the batch lookup
+   */
+  template<class T>
+  void find(std::span<const T> keys, std::span<result_type> out) const noexcept {
+    const auto store = [&](std::size_t i, std::size_t slot, bool found) {
+      out[i] = found ? result_type(values_[slot]) : result_type();
+    };
+    switch (bucket_size_) {
+      case 1u: return batch<1u, true>(keys, store);
+      case 2u: return batch<2u, true>(keys, store);
+      case 4u: return batch<4u, true>(keys, store);
+      case 8u: return batch<8u, true>(keys, store);
+      default: return batch<16u, true>(keys, store);
+    }
+  }
+
+  [[nodiscard]] auto mask() const noexcept -> key_type { return mask_; }
+  [[nodiscard]] auto bucket_size() const noexcept -> u32 { return bucket_size_; }
+  [[nodiscard]] auto slots() const noexcept -> std::size_t { return keys_.size(); }
+  [[nodiscard]] auto uses_magic_lut() const noexcept -> bool { return magic_ != 0u; }
+
+ private:
+  static constexpr auto size = key_type(sizeof(key_type) * __CHAR_BIT__);
+
+  // Clears bits of `mask` from the top while no more than `bucket_size` keys
+  // agree on the remaining ones, like detail::mask. Runs of bits are tried at
+  // once and split only when that fails, which gives the same mask as trying
+  // them one by one in far fewer passes over the keys. Returns nullopt once
+  // more than `max_bits` bits have to stay.
+  [[nodiscard]] static auto search_mask(const std::vector<key_type>& keys, const u32 bucket_size,
+                                        const key_type mask, const u32 max_bits) -> std::optional<key_type> {
+    // Open addressing over (masked key, count), stamped with the pass
+    // instead of cleared for every one.
+    auto log2_slots = 1u;
+    while ((std::size_t(1) << log2_slots) < 2u * keys.size()) {
+      ++log2_slots;
+    }
+    struct slot {
+      key_type masked;
+      u32 count;
+      u32 pass;
+    };
+    std::vector<slot> slots(std::size_t(1) << log2_slots);
+    const auto slot_mask = slots.size() - 1u;
+    u32 pass = 0u;
+    const auto fits = [&](const key_type candidate) {
+      ++pass;
+      for (const auto k : keys) {
+        const key_type masked = k & candidate;
+        auto s = std::size_t((u64(masked) * 0x9e3779b97f4a7c15u) >> (64u - log2_slots));
+        while (slots[s].pass == pass and slots[s].masked != masked) {
+          s = (s + 1u) & slot_mask;
+        }
+        if (slots[s].pass != pass) {
+          slots[s] = {masked, 0u, pass};
+        }
+        if (++slots[s].count > bucket_size) {
+          return false;
+        }
+      }
+      return true;
+    };
+
+    // Runs still to try, the upper half of a split run on top. Their bits
+    // stay set until their turn.
+    key_type kept{};
+    key_type rest = mask;
+    std::vector<key_type> runs;
+    if (mask) {
+      runs.push_back(mask);
+    }
+    while (not runs.empty()) {
+      const auto run = runs.back();
+      runs.pop_back();
+      rest &= ~run;
+      if (fits(kept | rest)) {
+        continue;
+      }
+      rest |= run;
+      if (__builtin_popcountll(run) == 1) {
+        rest &= ~run;
+        kept |= run;
+        if (u32(__builtin_popcountll(kept)) > max_bits) {
+          return std::nullopt;
+        }
+        continue;
+      }
+      key_type upper = run;
+      for (auto n = __builtin_popcountll(run) / 2; n > 0; --n) {
+        upper &= upper - 1u;
+      }
+      runs.push_back(run & ~upper);
+      runs.push_back(upper);
+    }
+    return kept;
+  }
+
+  // Searches for a magic multiplier that shifts every value out of one
+  // integer, as lookup$magic_lut.
+  void search_magic(std::span<const std::pair<key_type, mapped_type>> entries, u32 max_attempts = 100'000u) {
+    if (entries.size() < 2u) {
+      return;
+    }
+    u64 max{};
+    for (const auto& [_, v] : entries) {
+      max = std::max<u64>(max, u64(v));
+    }
+    const auto nbits = max ? 64u - __builtin_clzll(max) : 0u;
+    if (nbits == 0u or nbits * entries.size() > size) {
+      return;
+    }
+    const auto value_mask = key_type((u64(1) << nbits) - 1u);
+    const auto shift = key_type(size - nbits);
+    ::mph::random::pcg random{};
+    while (max_attempts--) {
+      const auto magic = key_type(random());
+      key_type lut{};
+      auto ok = true;
+      for (const auto& [k, v] : entries) {
+        const auto shl = key_type(k * magic) >> shift;
+        if (shl >= size) {
+          ok = false;
+          break;
+        }
+        lut |= key_type(v) << shl;
+      }
+      for (auto i = 0u; ok and i < entries.size(); ++i) {
+        const auto& [k, v] = entries[i];
+        ok = ((lut >> (key_type(k * magic) >> shift)) & value_mask) == key_type(v);
+      }
+      if (ok and magic) {
+        magic_ = magic;
+        magic_lut_ = lut;
+        magic_mask_ = value_mask;
+        magic_shift_ = shift;
+        return;
+      }
+    }
+  }
+
+  // Lays out the table. An empty slot of bucket b holds the key with bits
+  // b ^ 1 under the mask, so it never matches a probe of b; the only bucket
+  // of an empty mask gets a key outside the set instead.
+  void fill(std::span<const std::pair<key_type, mapped_type>> entries) {
+    #ifndef __BMI2__
+    init_byte_luts();
+    #endif
+    const auto buckets = std::size_t(1) << __builtin_popcountll(mask_);
+    keys_.assign(buckets * bucket_size_, key_type{});
+    values_.assign(buckets * bucket_size_, mapped_type{});
+
+    if (buckets == 1u) {
+      std::vector<key_type> sorted;
+      for (const auto& [k, _] : entries) {
+        sorted.push_back(k);
+      }
+      std::ranges::sort(sorted);
+      key_type outside{};
+      for (const auto k : sorted) {
+        if (k != outside) break;
+        ++outside;
+      }
+      std::ranges::fill(keys_, outside);
+    } else {
+      // Visits the submasks of mask_ in order, which are the keys with bits
+      // 0, 1, 2, ... under it.
+      key_type bits{};
+      for (std::size_t b = 0u; b < buckets; ++b, bits = (bits - mask_) & mask_) {
+        std::fill_n(keys_.begin() + (b ^ 1u) * bucket_size_, bucket_size_, bits);
+      }
+    }
+
+    std::vector<u8> used(buckets);
+    for (const auto& [k, v] : entries) {
+      const auto b = extract(k);
+      const auto slot = b * bucket_size_ + used[b]++;
+      keys_[slot] = k;
+      values_[slot] = v;
+    }
+  }
+
+  // Without BMI2 the pext of mask_ is the OR of one table per key byte that
+  // the mask touches.
+  void init_byte_luts() {
+    n_bytes_ = 0u;
+    byte_luts_.clear();
+    for (u32 shift = 0u; shift < size; shift += __CHAR_BIT__) {
+      if (not u8(mask_ >> shift)) {
+        continue;
+      }
+      byte_shifts_[n_bytes_++] = shift;
+      for (u32 v = 0u; v < 256u; ++v) {
+        byte_luts_.push_back(::mph::detail::pext(key_type(key_type(v) << shift), mask_));
+      }
+    }
+  }
+
+  [[nodiscard]] [[gnu::always_inline]] auto extract(const key_type key) const noexcept -> key_type {
+    #ifdef __BMI2__
+    return ::mph::detail::pext(key, mask_);
+    #else
+    key_type result{};
+    for (u32 i = 0u; i < n_bytes_; ++i) {
+      result |= byte_luts_[i * 256u + u8(key >> byte_shifts_[i])];
+    }
+    return result;
+    #endif
+  }
+
+  // Returns the slot of `key` in its bucket, and whether it is there.
+  template<u32 BucketSize>
+  [[nodiscard]] [[gnu::always_inline]] auto bucket(const key_type key) const noexcept -> std::pair<std::size_t, bool> {
+    return match<BucketSize>(key, BucketSize * std::size_t(extract(key)));
+  }
+
+  // Returns the slot of `key` in the bucket at `index`, and whether it is
+  // there.
+  template<u32 BucketSize>
+  [[nodiscard]] [[gnu::always_inline]] auto match(const key_type key, const std::size_t index) const noexcept
+    -> std::pair<std::size_t, bool> {
+    if constexpr (BucketSize == 1u) {
+      return {index, keys_[index] == key};
+    } else {
+      const auto* keys = keys_.data() + index;
+      u32 matches{};
+      for (u32 i = 0u; i < BucketSize; ++i) {
+        matches |= u32(keys[i] == key) << i;
+      }
+      return {index + (__builtin_ctz(matches | (1u << BucketSize)) & (BucketSize - 1u)), matches != 0u};
+    }
+  }
+
+  // Calls `fn(i, slot, found)` for every key, a group of max_batch_size keys
+  // at a time: all of a group are hashed and prefetched first, then matched.
+  // Lookups match buckets of one slot without reading keys.
+  template<u32 BucketSize, bool Find = false>
+  [[gnu::always_inline]] void batch(const auto keys, const auto& fn) const noexcept {
+    key_type ks[max_batch_size];
+    std::size_t index[max_batch_size];
+    for (std::size_t first = 0u; first < keys.size(); first += max_batch_size) {
+      const auto n = std::min<std::size_t>(keys.size() - first, max_batch_size);
+      for (std::size_t i = 0u; i < n; ++i) {
+        ks[i] = to<key_type>(keys[first + i]);
+        index[i] = BucketSize * std::size_t(extract(ks[i]));
+        if constexpr (Find or BucketSize > 1u) {
+          __builtin_prefetch(keys_.data() + index[i]);
+        }
+        __builtin_prefetch(values_.data() + index[i]);
+      }
+      for (std::size_t i = 0u; i < n; ++i) {
+        if constexpr (Find or BucketSize > 1u) {
+          const auto [slot, found] = match<BucketSize>(ks[i], index[i]);
+          fn(first + i, slot, found);
+        } else {
+          fn(first + i, index[i], true);
+        }
+      }
+    }
+  }
+
+  key_type mask_{};
+  u32 bucket_size_{1u};
+  std::vector<key_type> keys_;
+  std::vector<mapped_type> values_;
+
+  u32 n_bytes_{};
+  u8 byte_shifts_[sizeof(key_type)]{};
+  std::vector<key_type> byte_luts_;
+
+  key_type magic_{};
+  key_type magic_lut_{};
+  key_type magic_mask_{};
+  key_type magic_shift_{};
+};
+
+} // namespace g5::mph
@@ -0,0 +1,91 @@
+// Microbenchmark of the 1brc line parsers, reported in rows per cycle.
+//
+// Cycles are reference cycles of the invariant timer, so rows per cycle is
+// comparable across runs on one host, not across hosts.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <format>
+#include <random>
+#include <string>
+
+#include "benchmark/benchmark.h"
+#include "experimental/1brc/record.h"
+#include "hwy/highway.h"
+#include "hwy/timer.h"
+
+// Static target only, see 1brc --report_targets for the others.
+#include "experimental/1brc/scan-inl.h"
+
+namespace g5::brc {
+namespace {
+
+// Returns `n_rows` lines with names of 3 to `max_name_len` bytes and
+// temperatures uniform in [-99.9, 99.9], so every format branch is hit.
+std::string MakeInput(int n_rows, int max_name_len) {
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> len(3, max_name_len);
+  std::uniform_int_distribution<int> letter('a', 'z');
+  std::uniform_int_distribution<int> temp(-999, 999);
+
+  std::string input;
+  for (int i = 0; i < n_rows; ++i) {
+    for (int j = len(rng); j > 0; --j) {
+      input.push_back(letter(rng));
+    }
+    const int t = temp(rng);
+    input += std::format(";{}{}.{}\n", t < 0 ? "-" : "", std::abs(t) / 10,
+                         std::abs(t) % 10);
+  }
+  return input;
+}
+
+template <typename Kernel>
+void BM_Parser(benchmark::State& state, Kernel kernel) {
+  const int n_rows = state.range(0);
+  std::string input = MakeInput(n_rows, state.range(1));
+  const size_t size = input.size();
+  // Tail room for the vector loads past the last line.
+  input.append(128, '\0');
+
+  // Keep the lookup trivial, the parsers are what is measured.
+  Record records[256];
+  auto lookup = [&](const char* name, size_t) -> Record& {
+    return records[static_cast<uint8_t>(name[0])];
+  };
+
+  uint64_t ticks = 0;
+  for (auto _ : state) {
+    std::ranges::fill(records, kEmptyRecord);
+    const uint64_t t0 = hwy::timer::Start();
+    kernel(input.data(), input.data() + size, lookup);
+    ticks += hwy::timer::Stop() - t0;
+    benchmark::DoNotOptimize(records);
+  }
+
+  const double rows = static_cast<double>(n_rows) * state.iterations();
+  state.counters["rows/cycle"] = rows / ticks;
+  state.counters["rows/s"] =
+      benchmark::Counter(rows, benchmark::Counter::kIsRate);
+  state.SetBytesProcessed(size * state.iterations());
+}
+
+void BM_Branchy(benchmark::State& state) {
+  BM_Parser(state, [](const char* data, const char* end, auto& lookup) {
+    HWY_NAMESPACE::ProcessChunk(data, end, lookup);
+  });
+}
+
+void BM_Swar(benchmark::State& state) {
+  BM_Parser(state, [](const char* data, const char* end, auto& lookup) {
+    HWY_NAMESPACE::ProcessChunkSwar(data, end, lookup);
+  });
+}
+
+// Args: rows, longest name.
+BENCHMARK(BM_Branchy)->ArgsProduct({{1 << 16, 1 << 20}, {16, 26}});
+BENCHMARK(BM_Swar)->ArgsProduct({{1 << 16, 1 << 20}, {16, 26}});
+
+}  // namespace
+}  // namespace g5::brc
@@ -0,0 +1,82 @@
+#include "experimental/1brc/partial.h"
+
+#include <cstdint>
+#include <string>
+
+#include "absl/log/check.h"
+#include "experimental/1brc/checkpoint.h"
+#include "experimental/1brc/histogram.h"
+#include "experimental/1brc/partial.pb.h"
+#include "experimental/1brc/record.h"
+#include "riegeli/bytes/fd_reader.h"
+#include "riegeli/bytes/fd_writer.h"
+#include "riegeli/records/record_reader.h"
+#include "riegeli/records/record_writer.h"
+
+namespace g5::brc {
+namespace {
+
+constexpr uint32_t kVersion = 1;
+
+}  // namespace
+
+void WritePartial(const std::string& path, const Checkpoint& totals) {
+  Partial partial;
+  partial.set_version(kVersion);
+  partial.set_percentiles(totals.percentiles());
+  const auto results = totals.results();
+  for (int i = 0; i < results.size(); ++i) {
+    const auto& [name, rec] = results[i];
+    Station& station = *partial.add_stations();
+    station.set_name(name);
+    station.set_sum(rec.sum);
+    station.set_count(rec.count);
+    station.set_min(rec.min);
+    station.set_max(rec.max);
+    if (totals.percentiles()) {
+      totals.histogram(i).ForEach([&](int val, uint64_t count) {
+        station.add_values(val);
+        station.add_counts(count);
+      });
+    }
+  }
+
+  riegeli::RecordWriter<riegeli::FdWriter<>> writer(riegeli::Maker(path));
+  CHECK(writer.WriteRecord(partial)) << writer.status();
+  CHECK(writer.Close()) << writer.status();
+}
+
+void ReadPartial(const std::string& path, Checkpoint* totals) {
+  riegeli::RecordReader<riegeli::FdReader<>> reader(riegeli::Maker(path));
+  Partial partial;
+  CHECK(reader.ReadRecord(partial))
+      << "Failed to read " << path << ": " << reader.status();
+  CHECK(reader.Close()) << reader.status();
+  CHECK_EQ(partial.version(), kVersion)
+      << "Unsupported partial version in " << path;
+  CHECK(partial.percentiles() || !totals->percentiles())
+      << path << " was written without --percentiles";
+
+  for (const Station& station : partial.stations()) {
+    WideRecord rec;
+    rec.sum = station.sum();
+    rec.count = station.count();
+    rec.min = station.min();
+    rec.max = station.max();
+    Histogram histogram;
+    if (totals->percentiles()) {
+      CHECK_EQ(station.values_size(), station.counts_size())
+          << "Corrupt partial " << path;
+      for (int i = 0; i < station.values_size(); ++i) {
+        const int val = station.values(i);
+        CHECK(Histogram::kMinValue <= val && val <= Histogram::kMaxValue)
+            << "Corrupt partial " << path;
+        histogram.Add(val, station.counts(i));
+      }
+    }
+    totals->Add(station.name(), rec,
+                totals->percentiles() ? &histogram : nullptr);
+  }
+}
+
+}  // namespace g5::brc
@@ -0,0 +1,25 @@
+// Partial aggregates of 1brc, for splitting a run across processes or hosts.
+//
+// A partial holds the totals of every station of its share of the input,
+// keyed by name so that runs with --dynamic_stations merge too. It is a
+// riegeli record file with a single Partial message, see partial.proto.
+
+#ifndef EXPERIMENTAL_1BRC_PARTIAL_H_
+#define EXPERIMENTAL_1BRC_PARTIAL_H_
+
+#include <string>
+
+#include "experimental/1brc/checkpoint.h"
+
+namespace g5::brc {
+
+// Writes the totals, with histograms if they keep them, to `path`.
+void WritePartial(const std::string& path, const Checkpoint& totals);
+
+// Adds the stations of the partial at `path` to `totals`. With percentiles,
+// the partial must have been written with them too.
+void ReadPartial(const std::string& path, Checkpoint* totals);
+
+}  // namespace g5::brc
+
+#endif  // EXPERIMENTAL_1BRC_PARTIAL_H_
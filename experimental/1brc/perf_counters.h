@@ -0,0 +1,132 @@
+// Hardware counters and page faults of the calling thread, for --stats.
+//
+// The counters are read with perf_event_open, user space only, so that they
+// work under the default perf_event_paranoid. Events the host or its
+// permissions don't allow are reported as missing rather than failing the
+// run, which is the common case in containers and VMs.
+
+#ifndef EXPERIMENTAL_1BRC_PERF_COUNTERS_H_
+#define EXPERIMENTAL_1BRC_PERF_COUNTERS_H_
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <utility>
+
+namespace g5::brc {
+
+class PerfCounters {
+ public:
+  enum Event { kCycles, kInstructions, kBranchMisses, kLlcMisses, kEvents };
+
+  // Names of the events, as reported.
+  static constexpr std::array<const char*, kEvents> kNames = {
+      "cycles", "instructions", "branch_misses", "llc_misses"};
+
+  struct Values {
+    // Counts of each event, if it could be opened.
+    std::array<std::optional<uint64_t>, kEvents> events;
+    uint64_t minor_faults = 0;
+    uint64_t major_faults = 0;
+  };
+
+  // Opens the counters of the calling thread, stopped. They count only on
+  // this thread.
+  PerfCounters() {
+    for (int i = 0; i < kEvents; ++i) {
+      struct perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.disabled = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      switch (i) {
+        case kCycles:
+          attr.type = PERF_TYPE_HARDWARE;
+          attr.config = PERF_COUNT_HW_CPU_CYCLES;
+          break;
+        case kInstructions:
+          attr.type = PERF_TYPE_HARDWARE;
+          attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+          break;
+        case kBranchMisses:
+          attr.type = PERF_TYPE_HARDWARE;
+          attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+          break;
+        case kLlcMisses:
+          attr.type = PERF_TYPE_HW_CACHE;
+          attr.config = PERF_COUNT_HW_CACHE_LL |
+                        (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+          break;
+      }
+      fds_[i] = syscall(SYS_perf_event_open, &attr, /*pid=*/0, /*cpu=*/-1,
+                        /*group_fd=*/-1, PERF_FLAG_FD_CLOEXEC);
+    }
+  }
+
+  ~PerfCounters() {
+    for (const int fd : fds_) {
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+  }
+
+  PerfCounters(const PerfCounters&) = delete;
+  PerfCounters& operator=(const PerfCounters&) = delete;
+
+  // Resets and starts the counters.
+  void Start() {
+    for (const int fd : fds_) {
+      if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+      }
+    }
+    start_faults_ = Faults();
+  }
+
+  // Stops the counters and returns their counts since Start().
+  Values Stop() {
+    Values values;
+    const auto [minor, major] = Faults();
+    values.minor_faults = minor - start_faults_.first;
+    values.major_faults = major - start_faults_.second;
+    for (int i = 0; i < kEvents; ++i) {
+      if (fds_[i] < 0) {
+        continue;
+      }
+      ioctl(fds_[i], PERF_EVENT_IOC_DISABLE, 0);
+      uint64_t count;
+      if (read(fds_[i], &count, sizeof(count)) == sizeof(count)) {
+        values.events[i] = count;
+      }
+    }
+    return values;
+  }
+
+ private:
+  // Returns minor and major page faults of the calling thread so far.
+  static std::pair<uint64_t, uint64_t> Faults() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_THREAD, &usage) != 0) {
+      return {0, 0};
+    }
+    return {usage.ru_minflt, usage.ru_majflt};
+  }
+
+  std::array<int, kEvents> fds_;
+  std::pair<uint64_t, uint64_t> start_faults_;
+};
+
+}  // namespace g5::brc
+
+#endif  // EXPERIMENTAL_1BRC_PERF_COUNTERS_H_
@@ -0,0 +1,78 @@
+// Topology-aware placement of 1brc worker threads.
+
+#ifndef EXPERIMENTAL_1BRC_PLACEMENT_H_
+#define EXPERIMENTAL_1BRC_PLACEMENT_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <tuple>
+#include <vector>
+
+#include "hwy/contrib/thread_pool/topology.h"
+
+namespace g5::brc {
+
+struct WorkerPlacement {
+  // Logical processor the worker is pinned to.
+  int lp;
+  // Package of `lp`. Workers of one package share a NUMA node on our hosts,
+  // so their partial results are merged before crossing the interconnect.
+  int group;
+};
+
+// Returns placements for `n_workers` workers: one per physical core first,
+// taking the packages in turn so that every package gets a share of the
+// workers, then the SMT siblings in the same order. Without topology
+// information every worker gets its own logical processor in one group.
+inline std::vector<WorkerPlacement> PlaceWorkers(size_t n_workers) {
+  struct Candidate {
+    int smt;
+    // Position among the candidates of the same package and `smt`.
+    int rank;
+    WorkerPlacement placement;
+  };
+  std::vector<Candidate> candidates;
+
+  const hwy::Topology topology;
+  if (topology.HasPackages()) {
+    for (size_t p = 0; p < topology.packages.size(); ++p) {
+      for (const auto& cluster : topology.packages[p].clusters) {
+        cluster.lps.Foreach([&](size_t lp) {
+          candidates.push_back({topology.lps[lp].smt, 0,
+                                {static_cast<int>(lp), static_cast<int>(p)}});
+        });
+      }
+    }
+  }
+  if (candidates.size() < n_workers) {
+    candidates.clear();
+    for (size_t lp = 0; lp < n_workers; ++lp) {
+      candidates.push_back({0, 0, {static_cast<int>(lp), 0}});
+    }
+  }
+
+  std::ranges::sort(candidates, {}, [](const Candidate& c) {
+    return std::tuple(c.smt, c.placement.group, c.placement.lp);
+  });
+  for (size_t i = 1; i < candidates.size(); ++i) {
+    const Candidate& prev = candidates[i - 1];
+    if (candidates[i].smt == prev.smt &&
+        candidates[i].placement.group == prev.placement.group) {
+      candidates[i].rank = prev.rank + 1;
+    }
+  }
+  // Round-robin over the packages.
+  std::ranges::sort(candidates, {}, [](const Candidate& c) {
+    return std::tuple(c.smt, c.rank, c.placement.group);
+  });
+
+  std::vector<WorkerPlacement> placements;
+  for (size_t i = 0; i < n_workers; ++i) {
+    placements.push_back(candidates[i].placement);
+  }
+  return placements;
+}
+
+}  // namespace g5::brc
+
+#endif  // EXPERIMENTAL_1BRC_PLACEMENT_H_
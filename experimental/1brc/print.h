@@ -0,0 +1,68 @@
+// Standard output of 1brc: `{name=min/mean/max, ...}`, sorted by name.
+
+#ifndef EXPERIMENTAL_1BRC_PRINT_H_
+#define EXPERIMENTAL_1BRC_PRINT_H_
+
+#include <algorithm>
+#include <format>
+#include <iostream>
+#include <numeric>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "experimental/1brc/checkpoint.h"
+#include "experimental/1brc/histogram.h"
+#include "experimental/1brc/record.h"
+
+namespace g5::brc {
+
+// Prints `{name=min/mean/max, ...}` for all stations with at least one row,
+// of Records or WideRecords. With `histograms`, one per result, `/p50/p95/p99`
+// follows the maximum.
+template <typename Rec>
+void PrintResults(const std::vector<std::pair<std::string_view, Rec>>& results,
+                  const std::vector<const Histogram*>& histograms = {}) {
+  std::vector<int> order(results.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::ranges::sort(order, {}, [&](int i) { return results[i].first; });
+
+  std::cout << "{";
+
+  bool is_first = true;
+  for (const int i : order) {
+    const auto& [name, rec] = results[i];
+    if (rec.count == 0) {
+      continue;
+    }
+    std::cout << std::format("{}{}={:.1f}/{:.1f}/{:.1f}", is_first ? "" : ", ",
+                             name, -rec.min / 10.0, rec.sum / 10.0 / rec.count,
+                             rec.max / 10.0);
+    if (!histograms.empty()) {
+      const auto& histogram = *histograms[i];
+      std::cout << std::format("/{:.1f}/{:.1f}/{:.1f}",
+                               histogram.Quantile(0.5) / 10.0,
+                               histogram.Quantile(0.95) / 10.0,
+                               histogram.Quantile(0.99) / 10.0);
+    }
+    is_first = false;
+  }
+
+  std::cout << "}" << std::endl;
+}
+
+// Prints the results of `totals`, with percentiles if it keeps histograms.
+inline void PrintTotals(const Checkpoint& totals) {
+  const auto results = totals.results();
+  std::vector<const Histogram*> histograms;
+  if (totals.percentiles()) {
+    for (int i = 0; i < results.size(); ++i) {
+      histograms.push_back(&totals.histogram(i));
+    }
+  }
+  PrintResults(results, histograms);
+}
+
+}  // namespace g5::brc
+
+#endif  // EXPERIMENTAL_1BRC_PRINT_H_
@@ -0,0 +1,32 @@
+#!/bin/bash
+# Checks that merging the partials of adjacent --range splits of one input
+# prints the same totals as a whole run, with cuts inside lines.
+
+set -euo pipefail
+
+brc="$1"
+merge="$2"
+generate="$3"
+dir="${TEST_TMPDIR:-$(mktemp -d)}"
+
+"${generate}" --rows=200000 --chunk_rows=4096 "${dir}/measurements.txt"
+size=$(stat -c %s "${dir}/measurements.txt")
+cuts=(0 $((size / 3 + 5)) $((size / 2 + 11)) $((size - 3)) "")
+
+# Args: flags of merge, then further flags of 1brc.
+check() {
+  local merge_flags="$1"
+  shift
+  "${brc}" ${merge_flags} "$@" "${dir}/measurements.txt" >"${dir}/whole.out"
+  local partials=()
+  for ((i = 0; i + 1 < ${#cuts[@]}; ++i)); do
+    "${brc}" ${merge_flags} "$@" --range="${cuts[i]}:${cuts[i + 1]}" \
+      --partial_out="${dir}/part${i}" "${dir}/measurements.txt"
+    partials+=("${dir}/part${i}")
+  done
+  "${merge}" ${merge_flags} "${partials[@]}" >"${dir}/merged.out"
+  diff "${dir}/whole.out" "${dir}/merged.out"
+}
+
+check ""
+check "--percentiles" --dynamic_stations
@@ -0,0 +1,74 @@
+// Per-station aggregate of 1brc temperatures, in tenths of a degree.
+
+#ifndef EXPERIMENTAL_1BRC_RECORD_H_
+#define EXPERIMENTAL_1BRC_RECORD_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+namespace g5::brc {
+
+// Largest temperature magnitude of the input, 99.9 degrees.
+inline constexpr int kMaxAbsTemperature = 999;
+
+// Accumulators of the hot path. The 32-bit sum only takes kRecordSafeRows
+// rows, after which it has to be flushed into a WideRecord.
+struct Record {
+  int sum;
+  int count;
+  int min;  // Negated, so that both bounds are updated with std::max.
+  int max;
+};
+
+inline constexpr Record kEmptyRecord{0, 0, std::numeric_limits<int>::min(),
+                                     std::numeric_limits<int>::min()};
+
+// Rows a Record takes before its sum could overflow.
+inline constexpr int64_t kRecordSafeRows =
+    std::numeric_limits<int>::max() / kMaxAbsTemperature;
+
+// Totals of a station over any number of rows.
+struct WideRecord {
+  int64_t sum;
+  int64_t count;
+  int min;  // Negated, like Record::min.
+  int max;
+};
+
+inline constexpr WideRecord kEmptyWideRecord{
+    0, 0, std::numeric_limits<int>::min(), std::numeric_limits<int>::min()};
+
+// Adds one temperature to `rec`.
+inline void Update(Record& rec, int val) {
+  rec.max = std::max(rec.max, val);
+  rec.min = std::max(rec.min, -val);
+  rec.sum += val;
+  rec.count += 1;
+}
+
+// Merges partial aggregate `src` into `dst`.
+inline void Merge(Record& dst, const Record& src) {
+  dst.count += src.count;
+  dst.sum += src.sum;
+  dst.max = std::max(dst.max, src.max);
+  dst.min = std::max(dst.min, src.min);
+}
+
+inline void Merge(WideRecord& dst, const Record& src) {
+  dst.count += src.count;
+  dst.sum += src.sum;
+  dst.max = std::max(dst.max, src.max);
+  dst.min = std::max(dst.min, src.min);
+}
+
+inline void Merge(WideRecord& dst, const WideRecord& src) {
+  dst.count += src.count;
+  dst.sum += src.sum;
+  dst.max = std::max(dst.max, src.max);
+  dst.min = std::max(dst.min, src.min);
+}
+
+}  // namespace g5::brc
+
+#endif  // EXPERIMENTAL_1BRC_RECORD_H_
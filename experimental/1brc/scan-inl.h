@@ -0,0 +1,212 @@
+// Scan kernels of 1brc: split `name;temperature\n` lines and aggregate them.
+//
+// Both kernels call `lookup(name, len)` once per line to get the Record the
+// temperature goes into, so the same kernel serves the compile-time and the
+// runtime station sets. `lookup` may return any type with an `Update(T&, int)`
+// overload found by argument-dependent lookup, see ScanRows in scan.cc.
+//
+// Compiled once per Highway target, see scan.cc for the dispatched entry
+// points.
+
+// Per-target include guard.
+#if defined(EXPERIMENTAL_1BRC_SCAN_INL_H_) == defined(HWY_TARGET_TOGGLE)
+#ifdef EXPERIMENTAL_1BRC_SCAN_INL_H_
+#undef EXPERIMENTAL_1BRC_SCAN_INL_H_
+#else
+#define EXPERIMENTAL_1BRC_SCAN_INL_H_
+#endif
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "experimental/1brc/record.h"
+#include "experimental/1brc/scan_stats.h"
+#include "hwy/highway.h"
+
+HWY_BEFORE_NAMESPACE();
+namespace g5::brc {
+namespace HWY_NAMESPACE {
+
+namespace hn = hwy::HWY_NAMESPACE;
+
+inline constexpr hn::ScalableTag<uint8_t> kTag;
+
+// Parses the temperature starting at `data`, returns the start of the next
+// line.
+inline const char* ParseTemperature(const char* data, int* val) {
+  if (data[1] == '.') {
+    *val = data[0] * 10 + data[2] - '0' * 11;
+    return data + 4;
+  } else if (data[2] == '.') {
+    if (data[0] == '-') {
+      *val = -(data[1] * 10 + data[3] - '0' * 11);
+    } else {
+      *val = data[0] * 100 + data[1] * 10 + data[3] - '0' * 111;
+    }
+    return data + 5;
+  } else {
+    *val = -(data[1] * 100 + data[2] * 10 + data[4] - '0' * 111);
+    return data + 6;
+  }
+}
+
+// Aggregates the lines in [data, end) into the records returned by
+// `lookup(name, len)`. `data` and `end` must be line boundaries. Counts the
+// slow paths taken into `stats` if not null; rows are left to `lookup`.
+template <typename Lookup>
+void ProcessChunk(const char* data, const char* end, Lookup&& lookup,
+                  ScanStats* stats = nullptr) {
+  const auto broadcasted = hn::Set(kTag, ';');
+
+  // Parses one line whose name ends at `pos`, returns the next line.
+  auto parse_line = [&](const char* line, size_t pos) {
+    int val;
+    const char* next = ParseTemperature(line + pos + 1, &val);
+    Update(lookup(line, pos), val);
+    return next;
+  };
+
+  while (data < end) {
+    auto mask = hn::Eq(broadcasted,
+                       hn::LoadU(kTag, reinterpret_cast<const uint8_t*>(data)));
+
+    auto pos = hn::FindFirstTrue(kTag, mask);
+    if (pos < 0) {
+      // Probe one more vector to find the end of city name.
+      if (stats != nullptr) {
+        stats->second_vector_probes += 1;
+      }
+      mask = hn::Eq(broadcasted,
+                    hn::LoadU(kTag, reinterpret_cast<const uint8_t*>(
+                                        data + hn::Lanes(kTag))));
+      pos = hn::FindFirstTrue(kTag, mask);
+      if (pos >= 0) {
+        pos += hn::Lanes(kTag);
+      } else {
+        // Names longer than two vectors of the current target.
+        if (stats != nullptr) {
+          stats->memchr_fallbacks += 1;
+        }
+        const char* probe_end = data + 2 * hn::Lanes(kTag);
+        const char* sep =
+            probe_end < end ? static_cast<const char*>(
+                                  memchr(probe_end, ';', end - probe_end))
+                            : nullptr;
+        if (sep == nullptr) {
+          break;
+        }
+        pos = sep - data;
+      }
+
+      // The mask does not line up with `data` any more, reload after this
+      // line.
+      data = parse_line(data, pos);
+      continue;
+    }
+
+    for (;;) {
+      const char* next = parse_line(data, pos);
+      const size_t offset = next - data;
+      data = next;
+      if (data >= end || offset >= hn::Lanes(kTag)) {
+        break;
+      }
+
+      mask = hn::SlideMaskDownLanes(kTag, mask, offset);
+      pos = hn::FindFirstTrue(kTag, mask);
+      if (pos < 0) {
+        break;
+      }
+    }
+  }
+}
+
+// Parses the temperature starting at `data` without branches. Reads 8 bytes,
+// which may extend past the end of the line.
+inline int ParseTemperatureSwar(const char* data) {
+  uint64_t word;
+  memcpy(&word, data, sizeof(word));
+  // Digits have bit 4 set, '.' does not. It is at byte 1, 2 or 3.
+  const int dot = std::countr_zero(~word & 0x10101000);
+  // All ones for a leading '-', which has bit 4 clear as well.
+  const int64_t sign = static_cast<int64_t>(~word << 59) >> 63;
+  // Drop the sign, align the digits to fixed bytes and combine them with one
+  // multiplication: 100 * hundreds + 10 * tens + ones.
+  const uint64_t digits =
+      ((word & ~(sign & 0xFF)) << (28 - dot)) & 0x0F000F0F00;
+  const int abs = ((digits * 0x640a0001) >> 32) & 0x3FF;
+  return (abs ^ sign) - sign;
+}
+
+// Bytes covered by one step of ProcessChunkSwar, one bit each in a uint64_t.
+inline constexpr size_t kSwarWindow = 64;
+
+// Sets bit i of `semicolons` / `newlines` if data[i] is ';' / '\n', for the
+// kSwarWindow bytes at `data`.
+inline void FindSeparators(const char* data, uint64_t* semicolons,
+                           uint64_t* newlines) {
+  const hn::CappedTag<uint8_t, kSwarWindow> d;
+  const auto semicolon = hn::Set(d, ';');
+  const auto newline = hn::Set(d, '\n');
+  uint8_t semicolon_bits[kSwarWindow / 8];
+  uint8_t newline_bits[kSwarWindow / 8];
+  for (size_t i = 0; i < kSwarWindow; i += hn::Lanes(d)) {
+    const auto v = hn::LoadU(d, reinterpret_cast<const uint8_t*>(data + i));
+    hn::StoreMaskBits(d, hn::Eq(v, semicolon), semicolon_bits + i / 8);
+    hn::StoreMaskBits(d, hn::Eq(v, newline), newline_bits + i / 8);
+  }
+  memcpy(semicolons, semicolon_bits, sizeof(*semicolons));
+  memcpy(newlines, newline_bits, sizeof(*newlines));
+}
+
+// Same as ProcessChunk, but finds the separators of all lines in a window at
+// once and parses temperatures with ParseTemperatureSwar. The only remaining
+// branch per line is the loop condition.
+template <typename Lookup>
+void ProcessChunkSwar(const char* data, const char* end, Lookup&& lookup,
+                      ScanStats* stats = nullptr) {
+  while (data < end) {
+    uint64_t semicolons, newlines;
+    FindSeparators(data, &semicolons, &newlines);
+
+    if (newlines == 0) [[unlikely]] {
+      // Line longer than the window, or a last line without its '\n'.
+      if (stats != nullptr) {
+        stats->memchr_fallbacks += 1;
+      }
+      const char* sep =
+          static_cast<const char*>(memchr(data, ';', end - data));
+      if (sep == nullptr) {
+        break;
+      }
+      Update(lookup(data, sep - data), ParseTemperatureSwar(sep + 1));
+      const char* eol =
+          static_cast<const char*>(memchr(sep, '\n', end - sep));
+      if (eol == nullptr) {
+        break;
+      }
+      data = eol + 1;
+      continue;
+    }
+
+    // `data` is a line start, so the k-th ';' and the k-th '\n' in the window
+    // belong to the same line.
+    const char* line = data;
+    do {
+      const char* sep = data + std::countr_zero(semicolons);
+      Update(lookup(line, sep - line), ParseTemperatureSwar(sep + 1));
+      line = data + std::countr_zero(newlines) + 1;
+      semicolons &= semicolons - 1;
+      newlines &= newlines - 1;
+    } while (newlines != 0 && line < end);
+    data = line;
+  }
+}
+
+}  // namespace HWY_NAMESPACE
+}  // namespace g5::brc
+HWY_AFTER_NAMESPACE();
+
+#endif  // EXPERIMENTAL_1BRC_SCAN_INL_H_
@@ -0,0 +1,265 @@
+#include "experimental/1brc/scan.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "experimental/1brc/accumulators.h"
+#include "experimental/1brc/histogram.h"
+#include "experimental/1brc/record.h"
+#include "experimental/1brc/scan_stats.h"
+#include "experimental/1brc/station_table.h"
+#include "experimental/1brc/stations.h"
+
+namespace g5::brc {
+// Adds the kernels of one target to SupportedScanTargets(), once per target
+// at static initialization.
+bool RegisterScanTarget(const ScanTarget& target);
+}  // namespace g5::brc
+
+#undef HWY_TARGET_INCLUDE
+#define HWY_TARGET_INCLUDE "experimental/1brc/scan.cc"
+#include "hwy/foreach_target.h"  // IWYU pragma: keep
+#include "hwy/highway.h"
+
+// Must come after foreach_target.h.
+#include "experimental/1brc/scan-inl.h"
+
+HWY_BEFORE_NAMESPACE();
+namespace g5::brc {
+namespace HWY_NAMESPACE {
+
+template <typename Lookup>
+void Scan(const char* begin, const char* end, Parser parser, Lookup&& lookup,
+          ScanStats* stats = nullptr) {
+  if (stats != nullptr) {
+    // Rows are counted by a lookup of its own, so that the kernels without
+    // stats stay as they are.
+    uint64_t rows = 0;
+    auto counted = [&](const char* name, size_t len) -> decltype(auto) {
+      rows += 1;
+      return lookup(name, len);
+    };
+    if (parser == Parser::kSwar) {
+      ProcessChunkSwar(begin, end, counted, stats);
+    } else {
+      ProcessChunk(begin, end, counted, stats);
+    }
+    stats->rows += rows;
+    return;
+  }
+
+  if (parser == Parser::kSwar) {
+    ProcessChunkSwar(begin, end, lookup);
+  } else {
+    ProcessChunk(begin, end, lookup);
+  }
+}
+
+// Stands in for a Record in the kernels with --percentiles: updating it
+// updates both the record and the histogram of the station.
+struct RecordAndHistogram {
+  Record* rec;
+  Histogram* histogram;
+};
+
+inline void Update(RecordAndHistogram& sink, int val) {
+  g5::brc::Update(*sink.rec, val);
+  sink.histogram->Add(val);
+}
+
+void ScanStatic(const char* begin, const char* end, Parser parser,
+                Record* records, Histogram* histograms, ScanStats* stats) {
+  if (histograms == nullptr) {
+    Scan(
+        begin, end, parser,
+        [records](const char* name, size_t len) -> Record& {
+          return records[city_id(name, len)];
+        },
+        stats);
+    return;
+  }
+
+  RecordAndHistogram sink;
+  Scan(begin, end, parser,
+       [&](const char* name, size_t len) -> RecordAndHistogram& {
+         const int id = city_id(name, len);
+         sink = {&records[id], &histograms[id]};
+         return sink;
+       },
+       stats);
+}
+
+void ScanDynamic(const char* begin, const char* end, Parser parser,
+                 StationTable* table, std::vector<Record>* records,
+                 std::vector<Histogram>* histograms, ScanStats* stats) {
+  if (histograms == nullptr) {
+    Scan(
+        begin, end, parser,
+        [&](const char* name, size_t len) -> Record& {
+          const int id = table->FindOrInsert(name, len);
+          if (id >= std::ssize(*records)) [[unlikely]] {
+            records->resize(id + 1, kEmptyRecord);
+          }
+          return (*records)[id];
+        },
+        stats);
+    return;
+  }
+
+  RecordAndHistogram sink;
+  Scan(begin, end, parser,
+       [&](const char* name, size_t len) -> RecordAndHistogram& {
+         const int id = table->FindOrInsert(name, len);
+         if (id >= std::ssize(*records)) [[unlikely]] {
+           records->resize(id + 1, kEmptyRecord);
+         }
+         if (id >= std::ssize(*histograms)) [[unlikely]] {
+           histograms->resize(id + 1);
+         }
+         sink = {&(*records)[id], &(*histograms)[id]};
+         return sink;
+       },
+       stats);
+}
+
+// Stands in for a Record in the kernels with struct-of-arrays accumulators.
+struct ColumnSink {
+  HotColumns* columns;
+  int id;
+};
+
+inline void Update(ColumnSink& sink, int val) {
+  sink.columns->Update(sink.id, val);
+}
+
+void ScanStaticColumns(const char* begin, const char* end, Parser parser,
+                       HotColumns* columns, ScanStats* stats) {
+  ColumnSink sink{columns, 0};
+  Scan(
+      begin, end, parser,
+      [&](const char* name, size_t len) -> ColumnSink& {
+        sink.id = city_id(name, len);
+        return sink;
+      },
+      stats);
+}
+
+void ScanDynamicColumns(const char* begin, const char* end, Parser parser,
+                        StationTable* table, HotColumns* columns,
+                        ScanStats* stats) {
+  ColumnSink sink{columns, 0};
+  Scan(
+      begin, end, parser,
+      [&](const char* name, size_t len) -> ColumnSink& {
+        sink.id = table->FindOrInsert(name, len);
+        if (sink.id >= std::ssize(*columns)) [[unlikely]] {
+          columns->Resize(sink.id + 1);
+        }
+        return sink;
+      },
+      stats);
+}
+
+// Stands in for a Record in the kernels: updating it appends the row to the
+// columns instead of aggregating it.
+struct RowSink {
+  int id;
+  std::vector<uint16_t>* ids;
+  std::vector<int16_t>* temperatures;
+};
+
+inline void Update(RowSink& sink, int val) {
+  sink.ids->push_back(sink.id);
+  sink.temperatures->push_back(val);
+}
+
+void ScanRows(const char* begin, const char* end, Parser parser,
+              StationTable* table, std::vector<uint16_t>* ids,
+              std::vector<int16_t>* temperatures) {
+  RowSink sink{0, ids, temperatures};
+  Scan(begin, end, parser, [&](const char* name, size_t len) -> RowSink& {
+    sink.id = table->FindOrInsert(name, len);
+    return sink;
+  });
+}
+
+const char* ScanTargetName() { return hwy::TargetName(HWY_TARGET); }
+
+[[maybe_unused]] const bool kRegistered =
+    RegisterScanTarget({HWY_TARGET, &ScanStatic, &ScanDynamic});
+
+}  // namespace HWY_NAMESPACE
+}  // namespace g5::brc
+HWY_AFTER_NAMESPACE();
+
+#if HWY_ONCE
+namespace g5::brc {
+
+// Filled by the per-target sections above before main().
+static std::vector<ScanTarget>& ScanTargets() {
+  static auto* targets = new std::vector<ScanTarget>();
+  return *targets;
+}
+
+bool RegisterScanTarget(const ScanTarget& target) {
+  ScanTargets().push_back(target);
+  return true;
+}
+
+std::vector<ScanTarget> SupportedScanTargets() {
+  std::vector<ScanTarget> targets;
+  for (const ScanTarget& target : ScanTargets()) {
+    if ((hwy::SupportedTargets() & target.target) != 0) {
+      targets.push_back(target);
+    }
+  }
+  // Better targets have lower bits.
+  std::ranges::sort(targets, {}, &ScanTarget::target);
+  return targets;
+}
+
+HWY_EXPORT(ScanStatic);
+HWY_EXPORT(ScanDynamic);
+HWY_EXPORT(ScanStaticColumns);
+HWY_EXPORT(ScanDynamicColumns);
+HWY_EXPORT(ScanRows);
+HWY_EXPORT(ScanTargetName);
+
+void ScanStatic(const char* begin, const char* end, Parser parser,
+                Record* records, Histogram* histograms, ScanStats* stats) {
+  HWY_DYNAMIC_DISPATCH(ScanStatic)(begin, end, parser, records, histograms,
+                                   stats);
+}
+
+void ScanDynamic(const char* begin, const char* end, Parser parser,
+                 StationTable* table, std::vector<Record>* records,
+                 std::vector<Histogram>* histograms, ScanStats* stats) {
+  HWY_DYNAMIC_DISPATCH(ScanDynamic)(begin, end, parser, table, records,
+                                    histograms, stats);
+}
+
+void ScanStaticColumns(const char* begin, const char* end, Parser parser,
+                       HotColumns* columns, ScanStats* stats) {
+  HWY_DYNAMIC_DISPATCH(ScanStaticColumns)(begin, end, parser, columns, stats);
+}
+
+void ScanDynamicColumns(const char* begin, const char* end, Parser parser,
+                        StationTable* table, HotColumns* columns,
+                        ScanStats* stats) {
+  HWY_DYNAMIC_DISPATCH(ScanDynamicColumns)(begin, end, parser, table, columns,
+                                           stats);
+}
+
+void ScanRows(const char* begin, const char* end, Parser parser,
+              StationTable* table, std::vector<uint16_t>* ids,
+              std::vector<int16_t>* temperatures) {
+  HWY_DYNAMIC_DISPATCH(ScanRows)(begin, end, parser, table, ids, temperatures);
+}
+
+const char* ScanTargetName() {
+  return HWY_DYNAMIC_DISPATCH(ScanTargetName)();
+}
+
+}  // namespace g5::brc
+#endif  // HWY_ONCE
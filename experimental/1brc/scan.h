@@ -0,0 +1,81 @@
+// Runtime-dispatched scan kernels of 1brc.
+//
+// Every entry point runs the kernels of scan-inl.h compiled for the best
+// Highway target of the host, picked on first call.
+
+#ifndef EXPERIMENTAL_1BRC_SCAN_H_
+#define EXPERIMENTAL_1BRC_SCAN_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "experimental/1brc/accumulators.h"
+#include "experimental/1brc/histogram.h"
+#include "experimental/1brc/record.h"
+#include "experimental/1brc/scan_stats.h"
+#include "experimental/1brc/station_table.h"
+
+namespace g5::brc {
+
+enum class Parser {
+  // One ';' at a time, branches on the temperature format.
+  kBranchy,
+  // All separators of a 64-byte window at once, branchless temperatures.
+  kSwar,
+};
+
+// Aggregates the lines in [begin, end) into `records`, and `histograms` if
+// not null, indexed by the ids of the built-in station set. `begin` and `end`
+// must be line boundaries. Adds the counters of the scan to `stats` if not
+// null.
+void ScanStatic(const char* begin, const char* end, Parser parser,
+                Record* records, Histogram* histograms = nullptr,
+                ScanStats* stats = nullptr);
+
+// Aggregates the lines in [begin, end) into `records`, and `histograms` if
+// not null, indexed by the ids of `table`. New stations are added to `table`
+// and both vectors grow with it. Neither is shrunk, so `histograms` may cover
+// more stations than `records` already. Adds the counters of the scan to
+// `stats` if not null.
+void ScanDynamic(const char* begin, const char* end, Parser parser,
+                 StationTable* table, std::vector<Record>* records,
+                 std::vector<Histogram>* histograms = nullptr,
+                 ScanStats* stats = nullptr);
+
+// Like ScanStatic() and ScanDynamic(), into struct-of-arrays accumulators.
+// `columns` must be sized to the built-in station set for the former and
+// grows with `table` for the latter.
+void ScanStaticColumns(const char* begin, const char* end, Parser parser,
+                       HotColumns* columns, ScanStats* stats = nullptr);
+void ScanDynamicColumns(const char* begin, const char* end, Parser parser,
+                        StationTable* table, HotColumns* columns,
+                        ScanStats* stats = nullptr);
+
+// Appends the station id, as assigned by `table`, and the temperature of every
+// line in [begin, end) to `ids` and `temperatures`.
+void ScanRows(const char* begin, const char* end, Parser parser,
+              StationTable* table, std::vector<uint16_t>* ids,
+              std::vector<int16_t>* temperatures);
+
+// Returns name of the Highway target the entry points dispatch to.
+const char* ScanTargetName();
+
+// ScanStatic() and ScanDynamic() compiled for one Highway target, to compare
+// targets without changing the one the entry points dispatch to.
+struct ScanTarget {
+  int64_t target;
+  void (*scan_static)(const char* begin, const char* end, Parser parser,
+                      Record* records, Histogram* histograms,
+                      ScanStats* stats);
+  void (*scan_dynamic)(const char* begin, const char* end, Parser parser,
+                       StationTable* table, std::vector<Record>* records,
+                       std::vector<Histogram>* histograms, ScanStats* stats);
+};
+
+// Returns the kernels of every target both compiled in and supported by the
+// host, best first.
+std::vector<ScanTarget> SupportedScanTargets();
+
+}  // namespace g5::brc
+
+#endif  // EXPERIMENTAL_1BRC_SCAN_H_
@@ -0,0 +1,22 @@
+// Counters of the 1brc scan kernels, collected with --stats.
+
+#ifndef EXPERIMENTAL_1BRC_SCAN_STATS_H_
+#define EXPERIMENTAL_1BRC_SCAN_STATS_H_
+
+#include <cstdint>
+
+namespace g5::brc {
+
+struct ScanStats {
+  uint64_t rows = 0;
+  // Lines whose ';' was past the first vector of the branchy parser, so that
+  // a second one was loaded.
+  uint64_t second_vector_probes = 0;
+  // Lines too long for two vectors of the branchy parser or the window of the
+  // swar parser, split with memchr.
+  uint64_t memchr_fallbacks = 0;
+};
+
+}  // namespace g5::brc
+
+#endif  // EXPERIMENTAL_1BRC_SCAN_STATS_H_
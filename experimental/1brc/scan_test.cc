@@ -0,0 +1,68 @@
+#include "experimental/1brc/scan.h"
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "experimental/1brc/record.h"
+#include "experimental/1brc/station_table.h"
+#include "gtest/gtest.h"
+#include "hwy/targets.h"
+
+namespace g5::brc {
+namespace {
+
+// Tail room behind the last line, for the vector loads of the kernels.
+constexpr size_t kTailRoom = 256;
+
+// Runs every compiled target with every parser over `input`, and expects
+// `count` rows of station `name` with temperatures summing to `sum`.
+void ExpectStation(const std::string& input, std::string_view name, int count,
+                   int sum) {
+  std::string padded = input;
+  padded.append(kTailRoom, '\0');
+  for (const ScanTarget& target : SupportedScanTargets()) {
+    for (const Parser parser : {Parser::kBranchy, Parser::kSwar}) {
+      SCOPED_TRACE(hwy::TargetName(target.target));
+      SCOPED_TRACE(parser == Parser::kSwar ? "swar" : "branchy");
+      StationTable table;
+      std::vector<Record> records;
+      target.scan_dynamic(padded.data(), padded.data() + input.size(), parser,
+                          &table, &records, nullptr, nullptr);
+      Record rec = kEmptyRecord;
+      for (int id = 0; id < std::ssize(table); ++id) {
+        if (table.name(id) == name) {
+          rec = records[id];
+        }
+      }
+      EXPECT_EQ(rec.count, count);
+      EXPECT_EQ(rec.sum, sum);
+    }
+  }
+}
+
+TEST(ScanTest, UnterminatedLastLine) {
+  const std::string input = "ab;1.2\nxyz;-34.5";
+  ExpectStation(input, "ab", 1, 12);
+  ExpectStation(input, "xyz", 1, -345);
+}
+
+// Longer than the SWAR window and two vectors of any target, so that the
+// kernels fall back to memchr on it.
+TEST(ScanTest, LongUnterminatedLastLine) {
+  const std::string name(100, 'x');
+  const std::string input = "ab;1.2\n" + name + ";-34.5";
+  ExpectStation(input, "ab", 1, 12);
+  ExpectStation(input, name, 1, -345);
+}
+
+TEST(ScanTest, LongLines) {
+  const std::string name(100, 'x');
+  const std::string input = name + ";5.0\nab;1.2\n" + name + ";-4.5\n";
+  ExpectStation(input, "ab", 1, 12);
+  ExpectStation(input, name, 2, 5);
+}
+
+}  // namespace
+}  // namespace g5::brc
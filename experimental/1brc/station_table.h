@@ -0,0 +1,154 @@
+// Runtime station table for 1brc inputs whose station set is not known at
+// compile time.
+//
+// Open-addressing hash table with cache-line sized buckets. Each bucket holds
+// 16 one-byte tags next to the 16 station ids they guard, so a probe is a
+// single SIMD compare of the tags followed by a full name comparison on the
+// (usually unique) candidate.
+
+#ifndef EXPERIMENTAL_1BRC_STATION_TABLE_H_
+#define EXPERIMENTAL_1BRC_STATION_TABLE_H_
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "absl/log/check.h"
+#include "hwy/highway.h"
+
+namespace g5::brc {
+
+namespace hn = hwy::HWY_NAMESPACE;
+
+class StationTable {
+ public:
+  // Maximum number of distinct stations, bounded by the 16-bit slot ids.
+  static constexpr size_t kMaxStations = UINT16_MAX;
+
+  explicit StationTable(size_t expected_stations = 1024) {
+    size_t n_buckets = 1;
+    while (n_buckets * kMaxLoad < expected_stations) {
+      n_buckets *= 2;
+    }
+    buckets_.resize(n_buckets);
+    bucket_mask_ = n_buckets - 1;
+  }
+
+  // Returns id for given station name, assigning the next free id on first
+  // sight. Ids are dense and start from 0.
+  int FindOrInsert(const char* name, size_t len) {
+    const uint64_t hash = Hash(name, len);
+    const uint8_t tag = Tag(hash);
+    for (size_t i = hash & bucket_mask_;; i = (i + 1) & bucket_mask_) {
+      const Bucket& bucket = buckets_[i];
+      const auto tags = hn::Load(kBucketTag, bucket.tags);
+      for (uint32_t matches = Bits(hn::Eq(tags, hn::Set(kBucketTag, tag)));
+           matches; matches &= matches - 1) {
+        const int id = bucket.ids[std::countr_zero(matches)];
+        if (names_[id] == std::string_view(name, len)) {
+          return id;
+        }
+      }
+
+      // Slots are filled in order and never freed, so a bucket with an empty
+      // slot ends the probe sequence.
+      if (const uint32_t empty = Bits(hn::Eq(tags, hn::Zero(kBucketTag)))) {
+        return Insert(i, std::countr_zero(empty), hash, name, len);
+      }
+    }
+  }
+
+  // Returns name for given station id.
+  std::string_view name(int id) const { return names_[id]; }
+
+  // Returns total number of stations seen so far.
+  size_t size() const { return names_.size(); }
+
+ private:
+  static constexpr size_t kBucketSlots = 16;
+  // Rehash once buckets are 7/8 full on average.
+  static constexpr size_t kMaxLoad = kBucketSlots * 7 / 8;
+
+  struct alignas(64) Bucket {
+    // 0 marks an empty slot, otherwise 0x80 | top 7 bits of the hash.
+    uint8_t tags[kBucketSlots] = {};
+    uint16_t ids[kBucketSlots] = {};
+  };
+  static_assert(sizeof(Bucket) == 64);
+
+  using BucketTag = hn::FixedTag<uint8_t, kBucketSlots>;
+  static constexpr BucketTag kBucketTag{};
+
+  static uint64_t Hash(const char* name, size_t len) {
+    uint64_t head = 0, tail = 0;
+    if (len >= sizeof(uint64_t)) {
+      memcpy(&head, name, sizeof(head));
+      memcpy(&tail, name + len - sizeof(tail), sizeof(tail));
+    } else {
+      memcpy(&head, name, len);
+    }
+    const uint64_t h = (head ^ std::rotl(tail, 29) ^ len) * 0x9E3779B97F4A7C15;
+    return h ^ (h >> 32);
+  }
+
+  static uint8_t Tag(uint64_t hash) { return 0x80 | (hash >> 57); }
+
+  static uint32_t Bits(hn::Mask<BucketTag> mask) {
+    uint8_t bits[8] = {};
+    hn::StoreMaskBits(kBucketTag, mask, bits);
+    return bits[0] | (bits[1] << 8);
+  }
+
+  [[gnu::noinline]] int Insert(size_t bucket, int slot, uint64_t hash,
+                               const char* name, size_t len) {
+    CHECK_LT(names_.size(), kMaxStations) << "Too many stations";
+
+    const int id = names_.size();
+    storage_.emplace_back(name, len);
+    names_.push_back(storage_.back());
+    hashes_.push_back(hash);
+
+    if (names_.size() > buckets_.size() * kMaxLoad) {
+      Rehash(buckets_.size() * 2);
+    } else {
+      buckets_[bucket].tags[slot] = Tag(hash);
+      buckets_[bucket].ids[slot] = id;
+    }
+    return id;
+  }
+
+  void Rehash(size_t n_buckets) {
+    buckets_.assign(n_buckets, Bucket{});
+    bucket_mask_ = n_buckets - 1;
+    for (size_t id = 0; id < hashes_.size(); ++id) {
+      for (size_t i = hashes_[id] & bucket_mask_;; i = (i + 1) & bucket_mask_) {
+        Bucket& bucket = buckets_[i];
+        const size_t slot = std::ranges::find(bucket.tags, 0) - bucket.tags;
+        if (slot < kBucketSlots) {
+          bucket.tags[slot] = Tag(hashes_[id]);
+          bucket.ids[slot] = id;
+          break;
+        }
+      }
+    }
+  }
+
+  std::vector<Bucket> buckets_;
+  size_t bucket_mask_;
+
+  // Indexed by station id. `names_` views into `storage_`, whose elements
+  // never move.
+  std::deque<std::string> storage_;
+  std::vector<std::string_view> names_;
+  std::vector<uint64_t> hashes_;
+};
+
+}  // namespace g5::brc
+
+#endif  // EXPERIMENTAL_1BRC_STATION_TABLE_H_
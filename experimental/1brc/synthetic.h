@@ -0,0 +1,147 @@
+// Reproducible synthetic 1brc inputs, for the generator and the benchmarks.
+//
+// A station set is drawn once from a seed; rows are then generated in chunks
+// that each have their own seed, so any chunk can be produced independently
+// and in parallel, and the output does not depend on the number of threads.
+
+#ifndef EXPERIMENTAL_1BRC_SYNTHETIC_H_
+#define EXPERIMENTAL_1BRC_SYNTHETIC_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "absl/log/check.h"
+#include "experimental/1brc/stations.h"
+
+namespace g5::brc {
+
+enum class NameLengths {
+  // Uniform in [min_name_len, max_name_len].
+  kUniform,
+  // Geometric from min_name_len with mean +4 bytes, capped at max_name_len,
+  // close to the skew of real place names.
+  kGeometric,
+};
+
+struct SyntheticOptions {
+  // Number of distinct stations.
+  int stations = 413;
+  // Take names from the built-in station list instead of random letters.
+  bool builtin_names = true;
+  // Byte lengths of random names.
+  int min_name_len = 3;
+  int max_name_len = 26;
+  NameLengths name_lengths = NameLengths::kUniform;
+  uint64_t seed = 42;
+};
+
+class SyntheticStations {
+ public:
+  explicit SyntheticStations(const SyntheticOptions& options) {
+    CHECK_GT(options.stations, 0);
+    std::mt19937_64 rng(options.seed);
+    std::uniform_real_distribution<double> mean(-30.0, 40.0);
+
+    if (options.builtin_names) {
+      CHECK_LE(static_cast<size_t>(options.stations), city_count())
+          << "Only " << city_count() << " built-in stations";
+      for (int i = 0; i < options.stations; ++i) {
+        names_.emplace_back(city_name(i));
+      }
+    } else {
+      CHECK(1 <= options.min_name_len &&
+            options.min_name_len <= options.max_name_len &&
+            options.max_name_len <= 100)
+          << "Name lengths must be within [1, 100]";
+      // Distinct names of the allowed lengths, counted up to `stations`.
+      size_t name_space = 0;
+      for (int len = options.min_name_len;
+           len <= options.max_name_len &&
+           name_space < static_cast<size_t>(options.stations);
+           ++len) {
+        size_t names_of_len = 1;
+        for (int i = 0;
+             i < len && names_of_len < static_cast<size_t>(options.stations);
+             ++i) {
+          names_of_len *= 26;
+        }
+        name_space += names_of_len;
+      }
+      CHECK_GE(name_space, static_cast<size_t>(options.stations))
+          << "Only " << name_space << " distinct names of "
+          << options.min_name_len << " to " << options.max_name_len
+          << " letters";
+      std::uniform_int_distribution<int> uniform(options.min_name_len,
+                                                 options.max_name_len);
+      std::geometric_distribution<int> geometric(0.2);
+      std::uniform_int_distribution<int> letter('a', 'z');
+      std::unordered_set<std::string> seen;
+      while (names_.size() < static_cast<size_t>(options.stations)) {
+        const int len = options.name_lengths == NameLengths::kUniform
+                            ? uniform(rng)
+                            : std::min(options.min_name_len + geometric(rng),
+                                       options.max_name_len);
+        std::string name(len, '\0');
+        for (char& c : name) {
+          c = letter(rng);
+        }
+        if (seen.insert(name).second) {
+          names_.push_back(std::move(name));
+        }
+      }
+    }
+
+    for (size_t i = 0; i < names_.size(); ++i) {
+      means_.push_back(mean(rng));
+    }
+  }
+
+  size_t size() const { return names_.size(); }
+  std::string_view name(int i) const { return names_[i]; }
+
+  // Appends `n_rows` lines of chunk `chunk` to `out`. Stations are uniform,
+  // temperatures normal around the station mean, in tenths of a degree.
+  void AppendRows(uint64_t seed, uint64_t chunk, size_t n_rows,
+                  std::string* out) const {
+    std::seed_seq seq{seed, chunk};
+    std::mt19937_64 rng(seq);
+    std::uniform_int_distribution<int> station(0, names_.size() - 1);
+    std::normal_distribution<double> noise(0.0, 10.0);
+
+    for (size_t i = 0; i < n_rows; ++i) {
+      const int s = station(rng);
+      const int t = std::clamp<int>(std::lround((means_[s] + noise(rng)) * 10),
+                                    -999, 999);
+      out->append(names_[s]);
+      out->push_back(';');
+      if (t < 0) {
+        out->push_back('-');
+      }
+      const int a = std::abs(t);
+      if (a >= 100) {
+        out->push_back('0' + a / 100);
+      }
+      out->push_back('0' + a / 10 % 10);
+      out->push_back('.');
+      out->push_back('0' + a % 10);
+      out->push_back('\n');
+    }
+  }
+
+ private:
+  std::vector<std::string> names_;
+  std::vector<double> means_;
+};
+
+}  // namespace g5::brc
+
+#endif  // EXPERIMENTAL_1BRC_SYNTHETIC_H_
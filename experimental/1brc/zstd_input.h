@@ -0,0 +1,198 @@
+// zstd compressed input for 1brc.
+//
+// Input of several zstd frames, as written by pzstd or the seekable format,
+// is decompressed frame-parallel: every worker takes the next frame into a
+// buffer of its own and parses the complete lines in it. The partial lines
+// at the edges of the frames are kept aside and stitched together at the end.
+// A single frame can't be split, it is decompressed by the reader thread of a
+// BlockReader while the workers parse the blocks it is done with.
+
+#ifndef EXPERIMENTAL_1BRC_ZSTD_INPUT_H_
+#define EXPERIMENTAL_1BRC_ZSTD_INPUT_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/log/check.h"
+#include "experimental/1brc/block_reader.h"
+#include "riegeli/bytes/fd_handle.h"
+#include "riegeli/bytes/fd_reader.h"
+#include "riegeli/bytes/read_all.h"
+#include "riegeli/bytes/reader.h"
+#include "riegeli/bytes/string_reader.h"
+#include "riegeli/zstd/zstd_reader.h"
+
+namespace g5::brc {
+
+inline constexpr uint32_t kZstdMagic = 0xFD2FB528;
+
+// Returns the zstd frames of the `size` bytes at `data`, without skippable
+// frames such as the seek table of the seekable format. Only walks the frame
+// and block headers, nothing is decompressed.
+inline std::vector<std::string_view> SplitZstdFrames(const char* data,
+                                                     size_t size) {
+  auto load_le = [&](size_t pos, size_t n) {
+    CHECK_LE(pos + n, size) << "Truncated zstd input";
+    uint64_t value = 0;
+    memcpy(&value, data + pos, n);  // Little endian hosts only.
+    return value;
+  };
+
+  std::vector<std::string_view> frames;
+  for (size_t pos = 0; pos < size;) {
+    const uint32_t magic = load_le(pos, 4);
+    if ((magic & 0xFFFFFFF0) == 0x184D2A50) {
+      // Skippable frame: magic, 4-byte size, content.
+      pos += 8 + load_le(pos + 4, 4);
+      continue;
+    }
+    CHECK_EQ(magic, kZstdMagic) << "Not a zstd frame at byte " << pos;
+
+    const size_t begin = pos;
+    const uint8_t descriptor = load_le(pos + 4, 1);
+    const int fcs_flag = descriptor >> 6;
+    const bool single_segment = descriptor & 0x20;
+    const bool checksum = descriptor & 0x04;
+    constexpr int kDictIdBytes[] = {0, 1, 2, 4};
+    constexpr int kContentSizeBytes[] = {0, 2, 4, 8};
+    pos += 5 + (single_segment ? 0 : 1) + kDictIdBytes[descriptor & 0x03] +
+           (fcs_flag == 0 && single_segment ? 1 : kContentSizeBytes[fcs_flag]);
+
+    for (bool last = false; !last;) {
+      const uint32_t header = load_le(pos, 3);
+      last = header & 1;
+      const int type = (header >> 1) & 3;
+      CHECK_NE(type, 3) << "Corrupt zstd block at byte " << pos;
+      // RLE blocks hold a single byte, whatever size they expand to.
+      pos += 3 + (type == 1 ? 1 : header >> 3);
+    }
+    pos += checksum ? 4 : 0;
+    CHECK_LE(pos, size) << "Truncated zstd input";
+    frames.emplace_back(data + begin, pos - begin);
+  }
+  return frames;
+}
+
+// Hands out zstd frames to workers, decompressed.
+class ZstdFrameQueue {
+ public:
+  // Tail room behind the lines handed out, for the vector loads of the
+  // kernels past the last line.
+  static constexpr size_t kTailRoom = 256;
+
+  explicit ZstdFrameQueue(std::vector<std::string_view> frames)
+      : frames_(std::move(frames)), edges_(frames_.size()) {}
+
+  // Decompresses the next frame into `buffer`, which is reused across calls,
+  // and sets [*begin, *end) to the complete lines in it. Returns false once
+  // all frames are taken.
+  bool Next(std::string* buffer, const char** begin, const char** end) {
+    const size_t i = next_.fetch_add(1, std::memory_order_relaxed);
+    if (i >= frames_.size()) {
+      return false;
+    }
+
+    riegeli::ZstdReader<riegeli::StringReader<>> reader(
+        riegeli::Maker(frames_[i]));
+    CHECK(riegeli::ReadAll(reader, *buffer).ok())
+        << "Failed to decompress frame " << i << ": " << reader.status();
+    const size_t size = buffer->size();
+    bytes_.fetch_add(size, std::memory_order_relaxed);
+    buffer->resize(size + kTailRoom);
+
+    // The lines before the first and after the last newline continue in the
+    // neighbouring frames.
+    const char* data = buffer->data();
+    const char* first = static_cast<const char*>(memchr(data, '\n', size));
+    Edges& edges = edges_[i];
+    if (first == nullptr) {
+      edges.head.assign(data, size);
+      edges.whole = true;
+      *begin = *end = data;
+      return true;
+    }
+    const char* last = static_cast<const char*>(memrchr(data, '\n', size));
+    edges.head.assign(data, first + 1);
+    edges.tail.assign(last + 1, data + size);
+    *begin = first + 1;
+    *end = last + 1;
+    return true;
+  }
+
+  // Stitches the partial lines at the edges of the frames into `buffer`, and
+  // sets [*begin, *end) to them. Only once all frames are done.
+  void Seams(std::string* buffer, const char** begin, const char** end) const {
+    buffer->clear();
+    std::string carry;
+    for (const Edges& edges : edges_) {
+      carry += edges.head;
+      if (!edges.whole) {
+        *buffer += carry;
+        carry = edges.tail;
+      }
+    }
+    if (!carry.empty()) {
+      *buffer += carry;
+      *buffer += '\n';
+    }
+    const size_t size = buffer->size();
+    buffer->resize(size + kTailRoom);
+    *begin = buffer->data();
+    *end = buffer->data() + size;
+  }
+
+  // Returns number of decompressed bytes so far.
+  uint64_t bytes() const { return bytes_.load(std::memory_order_relaxed); }
+
+ private:
+  struct Edges {
+    // Up to and including the first newline, or all of a frame without one.
+    std::string head;
+    // After the last newline.
+    std::string tail;
+    bool whole = false;
+  };
+
+  const std::vector<std::string_view> frames_;
+  // Written by the worker that took the frame only.
+  std::vector<Edges> edges_;
+  std::atomic<size_t> next_ = 0;
+  std::atomic<uint64_t> bytes_ = 0;
+};
+
+// Returns a BlockReader source that decompresses all frames read from `src`.
+template <typename Src>
+BlockReader::Source ZstdReaderSource(Src src) {
+  auto reader = std::make_shared<riegeli::ZstdReader<Src>>(
+      std::move(src), riegeli::ZstdReaderBase::Options().set_concatenate(true));
+  return [reader](char* dest, size_t size) -> size_t {
+    size_t n = 0;
+    if (!reader->Read(size, dest, &n)) {
+      CHECK(reader->ok()) << "Failed to decompress input: "
+                          << reader->status();
+    }
+    return n;
+  };
+}
+
+// Returns a BlockReader source that decompresses zstd read from `fd`.
+inline BlockReader::Source ZstdSource(int fd) {
+  return ZstdReaderSource(
+      riegeli::FdReader<riegeli::UnownedFd>(riegeli::UnownedFd(fd)));
+}
+
+// Returns a BlockReader source that decompresses the zstd in `data`.
+inline BlockReader::Source ZstdSource(std::string_view data) {
+  return ZstdReaderSource(riegeli::StringReader<>(data));
+}
+
+}  // namespace g5::brc
+
+#endif  // EXPERIMENTAL_1BRC_ZSTD_INPUT_H_
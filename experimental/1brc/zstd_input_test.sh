@@ -0,0 +1,24 @@
+#!/bin/bash
+# Checks that a .zst input of many frames prints the same totals as the plain
+# text, including the rows split across frames.
+
+set -euo pipefail
+
+brc="$1"
+generate="$2"
+dir="${TEST_TMPDIR:-$(mktemp -d)}"
+
+# One frame per chunk of rows.
+"${generate}" --rows=200000 --chunk_rows=4096 "${dir}/measurements.txt"
+"${generate}" --rows=200000 --chunk_rows=4096 "${dir}/measurements.txt.zst"
+
+check() {
+  "${brc}" "$@" "${dir}/measurements.txt" >"${dir}/text.out"
+  "${brc}" "$@" "${dir}/measurements.txt.zst" >"${dir}/zstd.out"
+  diff "${dir}/text.out" "${dir}/zstd.out"
+}
+
+check
+check --percentiles
+check --dynamic_stations
+check --dynamic_stations --percentiles
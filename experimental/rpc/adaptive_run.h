@@ -0,0 +1,202 @@
+// Adaptive busy-polling run loop for agrpc::GrpcContext.
+//
+// agrpc::run() parks the thread in the completion queue after five empty
+// polls, for up to MAX_LATENCY, and GrpcContext::run() parks it as soon as
+// there is no work. The first event after an idle period then pays for waking
+// the thread up, which dominates the tail latency of small RPCs.
+//
+// RunAdaptive() instead keeps polling without blocking, with a CPU pause
+// between two polls, for a busy-poll window before it parks. The window
+// follows the observed gap between events: while events come closer than
+// the longest window, it spins for twice their average gap so that the next
+// one is caught spinning. Events further apart than that would only have the
+// thread burn a core, so it parks after the shortest window.
+
+#ifndef EXPERIMENTAL_RPC_ADAPTIVE_RUN_H_
+#define EXPERIMENTAL_RPC_ADAPTIVE_RUN_H_
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include "third_party/agrpc/grpc_context.hpp"
+#include "third_party/agrpc/run.hpp"
+
+namespace g5::rpc {
+
+// Run traits of RunAdaptive(). Like agrpc::DefaultRunTraits, whose poll(),
+// run_for() and is_stopped() of the other execution context it inherits;
+// custom traits derive from it in turn.
+struct AdaptiveRunTraits : agrpc::DefaultRunTraits {
+  // Longest time parked in the completion queue, which is also the longest
+  // the other execution context waits for its next poll.
+  static constexpr std::chrono::microseconds MAX_LATENCY{250};
+
+  // Longest busy-poll window. Zero parks as soon as there is no work.
+  static constexpr std::chrono::nanoseconds MAX_BUSY_POLL{
+      std::chrono::microseconds(100)};
+
+  // Busy-poll window while events are rare.
+  static constexpr std::chrono::nanoseconds MIN_BUSY_POLL{
+      std::chrono::microseconds(2)};
+
+  // CPU pauses between two empty polls, ~40ns each on recent x86 cores.
+  static constexpr int PAUSES_PER_POLL = 4;
+};
+
+// Counters of RunAdaptive(). Only written by the running thread, may be read
+// from any.
+struct AdaptiveRunStats {
+  // Non-blocking polls of the completion queue, and the ones that found no
+  // work.
+  std::atomic<uint64_t> polls = 0;
+  std::atomic<uint64_t> empty_polls = 0;
+  // Blocking waits in the completion queue, and the ones that timed out.
+  std::atomic<uint64_t> parks = 0;
+  std::atomic<uint64_t> idle_parks = 0;
+  // Polls and parks that handled work of either context.
+  std::atomic<uint64_t> events = 0;
+};
+
+namespace internal {
+
+inline void CpuPause() {
+#if defined(__x86_64__) || defined(__i386__)
+  _mm_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
+inline void Bump(std::atomic<uint64_t>& counter) {
+  counter.store(counter.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+}
+
+// Busy-poll window from the average gap between events.
+template <class Traits>
+class BusyPollWindow {
+ public:
+  using Duration = std::chrono::nanoseconds;
+
+  // Takes the time from the end of the previous event to the next one.
+  void Observe(Duration gap) {
+    // Exponential moving average over ~8 events.
+    average_gap_ += (gap - average_gap_) / 8;
+    window_ = average_gap_ <= kLongest
+                  ? std::clamp<Duration>(2 * average_gap_, kShortest, kLongest)
+                  : kShortest;
+  }
+
+  Duration get() const { return window_; }
+
+ private:
+  static constexpr Duration kLongest = Traits::MAX_BUSY_POLL;
+  static constexpr Duration kShortest =
+      std::min<Duration>(Traits::MIN_BUSY_POLL, Traits::MAX_BUSY_POLL);
+
+  Duration average_gap_ = Traits::MAX_BUSY_POLL;
+  Duration window_ = Traits::MAX_BUSY_POLL;
+};
+
+// Stands in for the other execution context when there is none.
+struct NoExecutionContext {
+  std::size_t poll() { return 0; }
+
+  template <class Rep, class Period>
+  std::size_t run_for(std::chrono::duration<Rep, Period>) {
+    return 0;
+  }
+
+  bool stopped() const { return true; }
+};
+
+template <bool IsMultithreaded, class Traits, class ExecutionContext,
+          class StopCondition>
+void RunAdaptive(agrpc::GrpcContext& grpc_context,
+                 ExecutionContext& execution_context,
+                 StopCondition stop_condition, AdaptiveRunStats* stats) {
+  using Clock = std::chrono::steady_clock;
+  using ResolvedTraits = agrpc::detail::ResolvedRunTraits<Traits>;
+  namespace detail = agrpc::detail;
+
+  AdaptiveRunStats unused;
+  AdaptiveRunStats& s = stats != nullptr ? *stats : unused;
+  detail::GrpcContextThreadContextImpl<IsMultithreaded> thread_context{
+      grpc_context};
+  detail::IsGrpcContextStopped is_grpc_context_stopped{};
+  BusyPollWindow<Traits> window;
+  auto idle_since = Clock::now();
+  while (!stop_condition() && (!is_grpc_context_stopped(grpc_context) ||
+                               !ResolvedTraits::is_stopped(execution_context))) {
+    if (is_grpc_context_stopped) {
+      ResolvedTraits::run_for(execution_context, ResolvedTraits::MAX_LATENCY);
+      continue;
+    }
+
+    bool processed = ResolvedTraits::poll(execution_context);
+    const auto now = Clock::now();
+    const bool park = !processed && now - idle_since >= window.get();
+    Bump(park ? s.parks : s.polls);
+    processed |= static_cast<bool>(detail::GrpcContextDoOne::poll(
+        thread_context,
+        park ? detail::gpr_timespec_from_now(ResolvedTraits::MAX_LATENCY)
+             : detail::GrpcContextImplementation::TIME_ZERO));
+
+    if (processed) {
+      Bump(s.events);
+      const auto done = Clock::now();
+      window.Observe(done - idle_since);
+      idle_since = done;
+    } else if (park) {
+      Bump(s.idle_parks);
+    } else {
+      Bump(s.empty_polls);
+      for (int i = 0; i < Traits::PAUSES_PER_POLL; ++i) {
+        CpuPause();
+      }
+    }
+  }
+}
+
+}  // namespace internal
+
+// Runs `grpc_context` and `execution_context` like agrpc::run(), until
+// `stop_condition` returns true or both are stopped, but busy-polls for an
+// adaptive window before parking. Adds to `stats` if not null.
+template <class Traits = AdaptiveRunTraits, class ExecutionContext,
+          class StopCondition = agrpc::detail::AlwaysFalseCondition>
+void RunAdaptive(agrpc::GrpcContext& grpc_context,
+                 ExecutionContext& execution_context,
+                 StopCondition stop_condition = {},
+                 AdaptiveRunStats* stats = nullptr) {
+  if (agrpc::detail::GrpcContextImplementation::is_multithreaded(
+          grpc_context)) {
+    internal::RunAdaptive<true, Traits>(grpc_context, execution_context,
+                                        std::move(stop_condition), stats);
+  } else {
+    internal::RunAdaptive<false, Traits>(grpc_context, execution_context,
+                                         std::move(stop_condition), stats);
+  }
+}
+
+// Runs `grpc_context` alone like GrpcContext::run(), until it is stopped, but
+// busy-polls for an adaptive window before parking. Adds to `stats` if not
+// null.
+inline void RunAdaptive(agrpc::GrpcContext& grpc_context,
+                        AdaptiveRunStats* stats = nullptr) {
+  internal::NoExecutionContext none;
+  RunAdaptive(grpc_context, none, agrpc::detail::AlwaysFalseCondition{},
+              stats);
+}
+
+}  // namespace g5::rpc
+
+#endif  // EXPERIMENTAL_RPC_ADAPTIVE_RUN_H_
@@ -0,0 +1,196 @@
+// Ping-pong latency and CPU use of RunAdaptive() against agrpc::run() with
+// DefaultRunTraits, over localhost.
+//
+// A client thread sends one unary Ping at a time to a server thread, waiting
+// `gap_us` on an alarm before each, so that both sides go idle in between.
+// gRPC alarms have millisecond resolution. Both threads run their GrpcContext
+// together with an asio::io_context, in the mode under test:
+//
+//   - kDefault: agrpc::run() with DefaultRunTraits.
+//   - kAdaptive: RunAdaptive() with AdaptiveRunTraits.
+//   - kBusyPoll: RunAdaptive() with a fixed 10ms busy-poll window, which
+//     spins through all gaps.
+//
+// Reports percentiles of the round trips, and the CPU time of each thread
+// per second of the run.
+
+#include <time.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "absl/log/check.h"
+#include "asio/awaitable.hpp"
+#include "asio/co_spawn.hpp"
+#include "asio/detached.hpp"
+#include "asio/io_context.hpp"
+#include "asio/use_awaitable.hpp"
+#include "benchmark/benchmark.h"
+#include "experimental/rpc/adaptive_run.h"
+#include "experimental/rpc/benchmark.grpc.pb.h"
+#include "experimental/rpc/benchmark.pb.h"
+#include "experimental/rpc/benchmark_util.h"
+#include "grpcpp/client_context.h"
+#include "third_party/agrpc/asio_grpc.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using g5::rpc::Benchmark;
+using g5::rpc::Payload;
+using g5::rpc::PingClientRPC;
+
+enum class Mode { kDefault, kAdaptive, kBusyPoll };
+
+struct BusyPollTraits : g5::rpc::AdaptiveRunTraits {
+  static constexpr std::chrono::nanoseconds MAX_BUSY_POLL{
+      std::chrono::milliseconds(10)};
+  static constexpr std::chrono::nanoseconds MIN_BUSY_POLL = MAX_BUSY_POLL;
+};
+
+// CPU and wall time of the calling thread from construction on.
+class ThreadTimer {
+ public:
+  ThreadTimer() : cpu_(CpuTime()), wall_(Clock::now()) {}
+
+  // Returns CPU seconds per second so far.
+  double Utilization() const {
+    const double wall =
+        std::chrono::duration<double>(Clock::now() - wall_).count();
+    return (CpuTime() - cpu_) / wall;
+  }
+
+ private:
+  static double CpuTime() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+  }
+
+  double cpu_;
+  Clock::time_point wall_;
+};
+
+// Runs the contexts in `mode` until `stop` is set.
+void Run(Mode mode, agrpc::GrpcContext& grpc_context,
+         asio::io_context& io_context, const std::atomic<bool>& stop,
+         g5::rpc::AdaptiveRunStats* stats) {
+  auto stop_condition = [&stop] {
+    return stop.load(std::memory_order_relaxed);
+  };
+  switch (mode) {
+    case Mode::kDefault:
+      agrpc::run(grpc_context, io_context, stop_condition);
+      break;
+    case Mode::kAdaptive:
+      g5::rpc::RunAdaptive(grpc_context, io_context, stop_condition, stats);
+      break;
+    case Mode::kBusyPoll:
+      g5::rpc::RunAdaptive<BusyPollTraits>(grpc_context, io_context,
+                                           stop_condition, stats);
+      break;
+  }
+}
+
+asio::awaitable<void> PingLoop(agrpc::GrpcContext& grpc_context,
+                               Benchmark::Stub& stub, int pings,
+                               std::chrono::microseconds gap,
+                               std::vector<Clock::duration>* latencies,
+                               std::atomic<bool>* done) {
+  agrpc::Alarm alarm(grpc_context);
+  const Payload request = g5::rpc::PingRequest();
+  Payload response;
+  for (int i = 0; i < pings; ++i) {
+    if (gap.count() > 0) {
+      co_await alarm.wait(std::chrono::system_clock::now() + gap,
+                          asio::use_awaitable);
+    }
+    grpc::ClientContext client_context;
+    const auto t0 = Clock::now();
+    const grpc::Status status = co_await PingClientRPC::request(
+        grpc_context, stub, client_context, request, response,
+        asio::use_awaitable);
+    latencies->push_back(Clock::now() - t0);
+    CHECK(status.ok()) << status.error_message();
+  }
+  done->store(true, std::memory_order_relaxed);
+}
+
+template <Mode mode>
+void BM_PingPong(benchmark::State& state) {
+  const std::chrono::microseconds gap(state.range(0));
+  const int pings = state.range(1);
+
+  g5::rpc::BenchmarkServer server;
+  agrpc::GrpcContext server_context(server.builder().AddCompletionQueue());
+  server.Start();
+  agrpc::register_awaitable_rpc_handler<g5::rpc::PingServerRPC>(
+      server_context, server.service(), &g5::rpc::EchoPing, asio::detached);
+
+  agrpc::GrpcContext client_context;
+  const std::unique_ptr<Benchmark::Stub> stub = server.NewStub();
+
+  std::vector<Clock::duration> latencies;
+  latencies.reserve(pings);
+  std::atomic<bool> client_done = false;
+  std::atomic<bool> server_done = false;
+  g5::rpc::AdaptiveRunStats server_stats;
+  double server_cpu = 0;
+  double client_cpu = 0;
+  for (auto _ : state) {
+    const auto t0 = Clock::now();
+    {
+      std::jthread server_thread([&] {
+        asio::io_context io_context;
+        const ThreadTimer timer;
+        Run(mode, server_context, io_context, server_done, &server_stats);
+        server_cpu = timer.Utilization();
+      });
+      std::jthread client_thread([&] {
+        asio::io_context io_context;
+        asio::co_spawn(client_context,
+                       PingLoop(client_context, *stub, pings, gap, &latencies,
+                                &client_done),
+                       asio::detached);
+        const ThreadTimer timer;
+        Run(mode, client_context, io_context, client_done, nullptr);
+        client_cpu = timer.Utilization();
+      });
+      client_thread.join();
+      server_done = true;
+    }
+    state.SetIterationTime(
+        std::chrono::duration<double>(Clock::now() - t0).count());
+  }
+  server.Shutdown();
+
+  state.SetItemsProcessed(latencies.size());
+  g5::rpc::Percentiles(latencies, {0.5, 0.99, 0.999}, state);
+  state.counters["server_cpu"] = server_cpu;
+  state.counters["client_cpu"] = client_cpu;
+  if (mode != Mode::kDefault) {
+    state.counters["empty_polls_per_ping"] =
+        static_cast<double>(server_stats.empty_polls) / pings;
+    state.counters["parks_per_ping"] =
+        static_cast<double>(server_stats.parks) / pings;
+    state.counters["events_per_ping"] =
+        static_cast<double>(server_stats.events) / pings;
+  }
+}
+
+void PingPongArgs(benchmark::internal::Benchmark* b) {
+  // Fewer pings with longer gaps, all take a few seconds.
+  b->ArgNames({"gap_us", "pings"});
+  b->Args({0, 20000})->Args({1000, 5000})->Args({5000, 1000});
+  g5::rpc::RunOnce(b);
+}
+
+BENCHMARK(BM_PingPong<Mode::kDefault>)->Apply(PingPongArgs);
+BENCHMARK(BM_PingPong<Mode::kAdaptive>)->Apply(PingPongArgs);
+BENCHMARK(BM_PingPong<Mode::kBusyPoll>)->Apply(PingPongArgs);
+
+}  // namespace
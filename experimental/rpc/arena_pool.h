@@ -0,0 +1,190 @@
+// Recycled protobuf Arenas for the messages of server RPCs.
+//
+// agrpc pools its own operation states, but the request and response messages
+// of every RPC still come from the heap: a new message, and its strings and
+// submessages, per call. WithArena() instead gives every RPC an Arena leased
+// from an ArenaPool, which the handler builds its messages on, and which is
+// reset and returned to the pool once the RPC completed. Every Arena of the
+// pool keeps its first block across RPCs, so that the messages of a small RPC
+// cost no allocation at all; larger ones spill into blocks of the heap,
+// freed on reset.
+//
+// Use one pool per GrpcContext, like GrpcContextPool does per shard: the lock
+// of a pool is only ever contended by the threads of a multithreaded context.
+
+#ifndef EXPERIMENTAL_RPC_ARENA_POOL_H_
+#define EXPERIMENTAL_RPC_ARENA_POOL_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "asio/awaitable.hpp"
+#include "google/protobuf/arena.h"
+
+namespace g5::rpc {
+
+struct ArenaPoolOptions {
+  // Size of the first block of every Arena, kept across RPCs.
+  size_t block_size = 8 << 10;
+  // Arenas kept for reuse. Those returned beyond are freed.
+  size_t max_cached = 1024;
+};
+
+// Counters of an ArenaPool, may be read from any thread.
+struct ArenaPoolStats {
+  // Arenas leased, and created because none was cached.
+  std::atomic<uint64_t> leases = 0;
+  std::atomic<uint64_t> created = 0;
+  // Leases that outgrew the first block.
+  std::atomic<uint64_t> spilled = 0;
+};
+
+class ArenaPool;
+
+// An Arena leased from an ArenaPool for one RPC, returned on destruction.
+// Also serves as the request message factory of agrpc, which creates the
+// initial request on it.
+class RpcArena {
+ public:
+  RpcArena(RpcArena&& other) noexcept
+      : pool_(std::exchange(other.pool_, nullptr)),
+        entry_(std::exchange(other.entry_, nullptr)) {}
+  RpcArena& operator=(RpcArena&&) = delete;
+
+  inline ~RpcArena();
+
+  google::protobuf::Arena& arena() { return *entry_->arena; }
+
+  template <class Message>
+  Message& create() {
+    return *google::protobuf::Arena::Create<Message>(entry_->arena.get());
+  }
+
+ private:
+  friend class ArenaPool;
+
+  struct Entry {
+    std::unique_ptr<char[]> block;
+    std::unique_ptr<google::protobuf::Arena> arena;
+  };
+
+  RpcArena(ArenaPool* pool, Entry* entry) : pool_(pool), entry_(entry) {}
+
+  ArenaPool* pool_;
+  Entry* entry_;
+};
+
+class ArenaPool {
+ public:
+  explicit ArenaPool(const ArenaPoolOptions& options = {})
+      : options_(options) {}
+
+  ArenaPool(const ArenaPool&) = delete;
+  ArenaPool& operator=(const ArenaPool&) = delete;
+
+  // Leases an Arena, which has to be returned before the pool is destroyed.
+  RpcArena Acquire() {
+    stats_.leases.fetch_add(1, std::memory_order_relaxed);
+    {
+      std::lock_guard lock(mu_);
+      if (!free_.empty()) {
+        RpcArena::Entry* entry = free_.back().release();
+        free_.pop_back();
+        return RpcArena(this, entry);
+      }
+    }
+    stats_.created.fetch_add(1, std::memory_order_relaxed);
+    auto* entry = new RpcArena::Entry;
+    entry->block.reset(new char[options_.block_size]);
+    google::protobuf::ArenaOptions arena_options;
+    arena_options.initial_block = entry->block.get();
+    arena_options.initial_block_size = options_.block_size;
+    entry->arena = std::make_unique<google::protobuf::Arena>(arena_options);
+    return RpcArena(this, entry);
+  }
+
+  const ArenaPoolStats& stats() const { return stats_; }
+
+ private:
+  friend class RpcArena;
+
+  void Release(RpcArena::Entry* entry) {
+    std::unique_ptr<RpcArena::Entry> owned(entry);
+    if (owned->arena->Reset() > options_.block_size) {
+      stats_.spilled.fetch_add(1, std::memory_order_relaxed);
+    }
+    std::lock_guard lock(mu_);
+    if (free_.size() < options_.max_cached) {
+      free_.push_back(std::move(owned));
+    }
+  }
+
+  const ArenaPoolOptions options_;
+  ArenaPoolStats stats_;
+
+  std::mutex mu_;
+  std::vector<std::unique_ptr<RpcArena::Entry>> free_;
+};
+
+RpcArena::~RpcArena() {
+  if (entry_ != nullptr) {
+    pool_->Release(entry_);
+  }
+}
+
+// RPC handler that calls `RPCHandler` with an Arena of the pool as its last
+// argument, see WithArena().
+template <class RPCHandler>
+class ArenaRPCHandler {
+ public:
+  ArenaRPCHandler(ArenaPool& pool, RPCHandler handler)
+      : pool_(&pool), handler_(std::move(handler)) {}
+
+  // Taken by agrpc for RPCs with an initial request, which it creates on the
+  // Arena and passes to the handler together with it. The Arena is returned
+  // after the handler completed.
+  RpcArena request_message_factory() { return pool_->Acquire(); }
+
+  // Unary and server-streaming RPCs.
+  template <class RPC, class Request>
+  decltype(auto) operator()(RPC& rpc, Request& request, RpcArena& arena) {
+    return std::invoke(handler_, rpc, request, arena.arena());
+  }
+
+  // Client-streaming and bidirectional-streaming RPCs, awaitable handlers
+  // only.
+  template <class RPC>
+  asio::awaitable<void> operator()(RPC& rpc) {
+    RpcArena arena = pool_->Acquire();
+    co_await std::invoke(handler_, rpc, arena.arena());
+  }
+
+ private:
+  ArenaPool* pool_;
+  RPCHandler handler_;
+};
+
+// Wraps `handler` for any of agrpc's register_*_rpc_handler(), to be called
+// with a recycled Arena of `pool` after its other arguments:
+//
+//   handler(rpc, request, arena)  // Unary and server-streaming RPCs.
+//   handler(rpc, arena)           // Client and bidi streaming RPCs.
+//
+// The request is on the Arena already. The handler creates its responses and
+// further requests on it with google::protobuf::Arena::Create(), and must not
+// keep any of them once it completed. Nothing is freed before, so streams
+// reuse their messages rather than create one per read or write.
+template <class RPCHandler>
+ArenaRPCHandler<RPCHandler> WithArena(ArenaPool& pool, RPCHandler handler) {
+  return {pool, std::move(handler)};
+}
+
+}  // namespace g5::rpc
+
+#endif  // EXPERIMENTAL_RPC_ARENA_POOL_H_
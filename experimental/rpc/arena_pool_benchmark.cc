@@ -0,0 +1,235 @@
+// Allocations and throughput of a server whose handlers build their messages
+// on the heap, or on recycled Arenas of an ArenaPool, over localhost.
+//
+// One server thread runs a GrpcContext with the handlers of Ping, which
+// copies the request into a new response, and of Echo, which does so for
+// every message of a stream. A client thread keeps kCalls Pings, or Echo
+// streams of kMessagesPerStream round trips, outstanding for kDuration.
+//
+// Reports the calls to operator new on the server thread per RPC, or per
+// message of a stream. Every payload has kItems submessages, which is where
+// Arenas save allocations: the buffers of string and bytes fields come from
+// the heap either way.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <thread>
+
+#include "absl/log/check.h"
+#include "asio/awaitable.hpp"
+#include "asio/co_spawn.hpp"
+#include "asio/detached.hpp"
+#include "asio/use_awaitable.hpp"
+#include "benchmark/benchmark.h"
+#include "experimental/rpc/arena_pool.h"
+#include "experimental/rpc/benchmark.grpc.pb.h"
+#include "experimental/rpc/benchmark.pb.h"
+#include "experimental/rpc/benchmark_util.h"
+#include "google/protobuf/arena.h"
+#include "grpcpp/client_context.h"
+#include "third_party/agrpc/asio_grpc.hpp"
+
+namespace {
+
+thread_local uint64_t allocations = 0;
+
+}  // namespace
+
+void* operator new(size_t size) {
+  ++allocations;
+  if (void* p = std::malloc(size != 0 ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+
+void operator delete(void* p) noexcept { std::free(p); }
+
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+void operator delete[](void* p) noexcept { std::free(p); }
+
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using google::protobuf::Arena;
+using g5::rpc::Benchmark;
+using g5::rpc::Payload;
+using g5::rpc::PingClientRPC;
+using g5::rpc::PingServerRPC;
+
+using EchoServerRPC = agrpc::ServerRPC<&Benchmark::AsyncService::RequestEcho>;
+using EchoClientRPC = agrpc::ClientRPC<&Benchmark::Stub::PrepareAsyncEcho>;
+
+constexpr int kItems = 16;
+constexpr int kCalls = 32;
+constexpr int kMessagesPerStream = 100;
+constexpr auto kDuration = std::chrono::seconds(2);
+
+enum class Messages { kHeap, kArena };
+enum class Kind { kUnary, kStreaming };
+
+asio::awaitable<void> Ping(PingServerRPC& rpc, Payload& request) {
+  Payload response;
+  response = request;
+  co_await rpc.finish(response, grpc::Status::OK, asio::use_awaitable);
+}
+
+asio::awaitable<void> PingOnArena(PingServerRPC& rpc, Payload& request,
+                                  Arena& arena) {
+  Payload& response = *Arena::Create<Payload>(&arena);
+  response = request;
+  co_await rpc.finish(response, grpc::Status::OK, asio::use_awaitable);
+}
+
+asio::awaitable<void> EchoOnHeap(EchoServerRPC& rpc) {
+  Payload request;
+  Payload response;
+  while (co_await rpc.read(request, asio::use_awaitable)) {
+    response = request;
+    if (!co_await rpc.write(response, asio::use_awaitable)) {
+      co_return;
+    }
+  }
+  co_await rpc.finish(grpc::Status::OK, asio::use_awaitable);
+}
+
+asio::awaitable<void> EchoOnArena(EchoServerRPC& rpc, Arena& arena) {
+  Payload& request = *Arena::Create<Payload>(&arena);
+  Payload& response = *Arena::Create<Payload>(&arena);
+  while (co_await rpc.read(request, asio::use_awaitable)) {
+    response = request;
+    if (!co_await rpc.write(response, asio::use_awaitable)) {
+      co_return;
+    }
+  }
+  co_await rpc.finish(grpc::Status::OK, asio::use_awaitable);
+}
+
+Payload MakeRequest() {
+  Payload request = g5::rpc::PingRequest();
+  for (int i = 0; i < kItems; ++i) {
+    Payload::Item& item = *request.add_items();
+    item.set_key(i);
+    item.set_value(-i);
+  }
+  return request;
+}
+
+asio::awaitable<void> PingLoop(agrpc::GrpcContext& context,
+                               Benchmark::Stub& stub,
+                               Clock::time_point deadline, uint64_t* items) {
+  const Payload request = MakeRequest();
+  Payload response;
+  while (Clock::now() < deadline) {
+    grpc::ClientContext client_context;
+    const grpc::Status status = co_await PingClientRPC::request(
+        context, stub, client_context, request, response,
+        asio::use_awaitable);
+    CHECK(status.ok()) << status.error_message();
+    ++*items;
+  }
+}
+
+asio::awaitable<void> EchoLoop(agrpc::GrpcContext& context,
+                               Benchmark::Stub& stub,
+                               Clock::time_point deadline, uint64_t* items) {
+  const Payload request = MakeRequest();
+  Payload response;
+  while (Clock::now() < deadline) {
+    EchoClientRPC rpc(context);
+    CHECK(co_await rpc.start(stub, asio::use_awaitable));
+    for (int i = 0; i < kMessagesPerStream; ++i) {
+      CHECK(co_await rpc.write(request, asio::use_awaitable));
+      CHECK(co_await rpc.read(response, asio::use_awaitable));
+      ++*items;
+    }
+    CHECK(co_await rpc.writes_done(asio::use_awaitable));
+    const grpc::Status status = co_await rpc.finish(asio::use_awaitable);
+    CHECK(status.ok()) << status.error_message();
+  }
+}
+
+template <Messages messages, Kind kind>
+void BM_Server(benchmark::State& state) {
+  g5::rpc::BenchmarkServer server;
+  // Before the context, so that the RPCs it destroys can return their Arenas.
+  g5::rpc::ArenaPool arenas;
+  agrpc::GrpcContext server_context(server.builder().AddCompletionQueue());
+  server.Start();
+  Benchmark::AsyncService& service = server.service();
+
+  if constexpr (kind == Kind::kStreaming) {
+    if constexpr (messages == Messages::kArena) {
+      agrpc::register_awaitable_rpc_handler<EchoServerRPC>(
+          server_context, service, g5::rpc::WithArena(arenas, &EchoOnArena),
+          asio::detached);
+    } else {
+      agrpc::register_awaitable_rpc_handler<EchoServerRPC>(
+          server_context, service, &EchoOnHeap, asio::detached);
+    }
+  } else {
+    if constexpr (messages == Messages::kArena) {
+      agrpc::register_awaitable_rpc_handler<PingServerRPC>(
+          server_context, service, g5::rpc::WithArena(arenas, &PingOnArena),
+          asio::detached);
+    } else {
+      agrpc::register_awaitable_rpc_handler<PingServerRPC>(
+          server_context, service, &Ping, asio::detached);
+    }
+  }
+
+  uint64_t items = 0;
+  uint64_t server_allocations = 0;
+  for (auto _ : state) {
+    const auto t0 = Clock::now();
+    std::jthread server_thread([&] {
+      const uint64_t before = allocations;
+      server_context.run();
+      server_allocations = allocations - before;
+    });
+    {
+      agrpc::GrpcContext client_context;
+      const std::unique_ptr<Benchmark::Stub> stub = server.NewStub();
+      const auto deadline = Clock::now() + kDuration;
+      for (int i = 0; i < kCalls; ++i) {
+        asio::co_spawn(
+            client_context,
+            kind == Kind::kStreaming
+                ? EchoLoop(client_context, *stub, deadline, &items)
+                : PingLoop(client_context, *stub, deadline, &items),
+            asio::detached);
+      }
+      client_context.run();
+    }
+    state.SetIterationTime(
+        std::chrono::duration<double>(Clock::now() - t0).count());
+    server.Shutdown();
+  }
+
+  state.SetItemsProcessed(items);
+  state.counters["allocs_per_item"] =
+      static_cast<double>(server_allocations) / items;
+  if (messages == Messages::kArena) {
+    state.counters["arenas"] = arenas.stats().created.load();
+    state.counters["spilled"] = arenas.stats().spilled.load();
+    state.counters["leases"] = arenas.stats().leases.load();
+  }
+}
+
+BENCHMARK(BM_Server<Messages::kHeap, Kind::kUnary>)->Apply(g5::rpc::RunOnce);
+BENCHMARK(BM_Server<Messages::kArena, Kind::kUnary>)->Apply(g5::rpc::RunOnce);
+BENCHMARK(BM_Server<Messages::kHeap, Kind::kStreaming>)
+    ->Apply(g5::rpc::RunOnce);
+BENCHMARK(BM_Server<Messages::kArena, Kind::kStreaming>)
+    ->Apply(g5::rpc::RunOnce);
+
+}  // namespace
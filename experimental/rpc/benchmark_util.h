@@ -0,0 +1,146 @@
+// Fixture shared by the RPC benchmarks: a server of the Benchmark service on
+// localhost, the unary Ping on both sides, and the latency counters they
+// report.
+
+#ifndef EXPERIMENTAL_RPC_BENCHMARK_UTIL_H_
+#define EXPERIMENTAL_RPC_BENCHMARK_UTIL_H_
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <format>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/log/check.h"
+#include "asio/awaitable.hpp"
+#include "asio/use_awaitable.hpp"
+#include "benchmark/benchmark.h"
+#include "experimental/rpc/benchmark.grpc.pb.h"
+#include "experimental/rpc/benchmark.pb.h"
+#include "grpcpp/client_context.h"
+#include "grpcpp/create_channel.h"
+#include "grpcpp/security/credentials.h"
+#include "grpcpp/security/server_credentials.h"
+#include "grpcpp/server.h"
+#include "grpcpp/server_builder.h"
+#include "third_party/agrpc/asio_grpc.hpp"
+
+namespace g5::rpc {
+
+using PingServerRPC = agrpc::ServerRPC<&Benchmark::AsyncService::RequestPing>;
+using PingClientRPC = agrpc::ClientRPC<&Benchmark::Stub::PrepareAsyncPing>;
+
+// Bytes of `data` in the Payload of a Ping.
+inline constexpr size_t kPayloadBytes = 32;
+
+// Server of the Benchmark service on localhost, built in two steps so that
+// GrpcContexts can take completion queues from builder() in between.
+//
+// Declare it before those GrpcContexts. A GrpcContext drains its completion
+// queue when it is destroyed, which still refers to the server, so the
+// contexts have to go first.
+class BenchmarkServer {
+ public:
+  // Listens on `port`, or on a free one if 0.
+  explicit BenchmarkServer(int port = 0) : port_(port) {
+    builder_.AddListeningPort("localhost:" + std::to_string(port),
+                              grpc::InsecureServerCredentials(), &port_);
+    builder_.RegisterService(&service_);
+  }
+
+  BenchmarkServer(const BenchmarkServer&) = delete;
+  BenchmarkServer& operator=(const BenchmarkServer&) = delete;
+
+  // Valid until Start().
+  grpc::ServerBuilder& builder() { return builder_; }
+
+  Benchmark::AsyncService& service() { return service_; }
+
+  void Start() {
+    server_ = builder_.BuildAndStart();
+    CHECK(server_ != nullptr);
+  }
+
+  // Cancels the RPCs still running and stops accepting new ones.
+  void Shutdown() { server_->Shutdown(std::chrono::system_clock::now()); }
+
+  // Valid after Start().
+  int port() const { return port_; }
+  std::string address() const { return "localhost:" + std::to_string(port_); }
+
+  // Returns a stub on a channel of its own.
+  std::unique_ptr<Benchmark::Stub> NewStub() const {
+    return Benchmark::NewStub(
+        grpc::CreateChannel(address(), grpc::InsecureChannelCredentials()));
+  }
+
+ private:
+  Benchmark::AsyncService service_;
+  grpc::ServerBuilder builder_;
+  int port_;
+  std::unique_ptr<grpc::Server> server_;
+};
+
+// Answers a Ping with its request.
+inline asio::awaitable<void> EchoPing(PingServerRPC& rpc, Payload& request) {
+  co_await rpc.finish(request, grpc::Status::OK, asio::use_awaitable);
+}
+
+// Returns the request of a Ping.
+inline Payload PingRequest() {
+  Payload request;
+  request.set_data(std::string(kPayloadBytes, 'x'));
+  return request;
+}
+
+// Pings until `deadline`, one at a time, and appends the round trips to
+// `latencies`.
+inline asio::awaitable<void> PingLoop(
+    agrpc::GrpcContext& context, Benchmark::Stub& stub,
+    std::chrono::steady_clock::time_point deadline,
+    std::vector<std::chrono::steady_clock::duration>* latencies) {
+  const Payload request = PingRequest();
+  Payload response;
+  while (std::chrono::steady_clock::now() < deadline) {
+    grpc::ClientContext client_context;
+    const auto t0 = std::chrono::steady_clock::now();
+    const grpc::Status status = co_await PingClientRPC::request(
+        context, stub, client_context, request, response,
+        asio::use_awaitable);
+    latencies->push_back(std::chrono::steady_clock::now() - t0);
+    CHECK(status.ok()) << status.error_message();
+  }
+}
+
+// Sorts `latencies` and sets a counter of `state` in microseconds per
+// percentile in `percentiles`, named after its digits: p50_us for 0.5,
+// p999_us for 0.999.
+inline void Percentiles(
+    std::vector<std::chrono::steady_clock::duration>& latencies,
+    std::initializer_list<double> percentiles, benchmark::State& state) {
+  CHECK(!latencies.empty());
+  std::ranges::sort(latencies);
+  for (const double p : percentiles) {
+    std::string digits = std::format("{}", p).substr(2);
+    if (digits.size() < 2) {
+      digits += '0';
+    }
+    const auto latency =
+        latencies[static_cast<size_t>(p * (latencies.size() - 1))];
+    state.counters["p" + digits + "_us"] =
+        std::chrono::duration<double, std::micro>(latency).count();
+  }
+}
+
+// Runs a benchmark once, timed by its own SetIterationTime(), as the RPC
+// benchmarks time their server and client threads rather than the loop.
+inline void RunOnce(benchmark::internal::Benchmark* b) {
+  b->Iterations(1)->UseManualTime()->Unit(benchmark::kMillisecond);
+}
+
+}  // namespace g5::rpc
+
+#endif  // EXPERIMENTAL_RPC_BENCHMARK_UTIL_H_
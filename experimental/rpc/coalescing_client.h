@@ -0,0 +1,438 @@
+// Client that coalesces small unary calls into batches on one bidirectional
+// stream.
+//
+// Every unary RPC costs a call of its own: HTTP/2 headers and frames, a few
+// completion queue tags and the allocations of a ClientContext. A
+// CoalescingClient instead queues the calls it is given, and writes them as
+// one batch message to a stream it keeps open once the oldest has waited for
+// `window`, or once `max_batch` are queued. The server answers every batch
+// with a batch of the responses, in order, and the client completes every
+// call with its own response.
+//
+// Writes go out one at a time, so the calls that arrive while a batch is on
+// its way are coalesced even without a window. At most `max_in_flight` calls
+// are sent and not answered yet; the others stay queued.
+
+#ifndef EXPERIMENTAL_RPC_COALESCING_CLIENT_H_
+#define EXPERIMENTAL_RPC_COALESCING_CLIENT_H_
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "absl/log/check.h"
+#include "asio/any_completion_handler.hpp"
+#include "asio/associated_cancellation_slot.hpp"
+#include "asio/associated_executor.hpp"
+#include "asio/async_result.hpp"
+#include "asio/cancellation_signal.hpp"
+#include "asio/post.hpp"
+#include "grpcpp/support/status.h"
+#include "third_party/agrpc/asio_grpc.hpp"
+
+namespace g5::rpc {
+
+struct CoalescingClientOptions {
+  // Longest a call is queued before it is sent. Zero sends the queued calls
+  // as soon as the GrpcContext has run the work at hand. gRPC alarms have
+  // millisecond resolution.
+  std::chrono::milliseconds window{0};
+  // Calls per batch. A full batch is sent without waiting for the window.
+  size_t max_batch = 64;
+  // Calls sent and not answered yet.
+  size_t max_in_flight = 1024;
+};
+
+// Counters of a CoalescingClient, read on the thread of its GrpcContext.
+struct CoalescingClientStats {
+  // Calls started, cancelled by their caller, and batches sent.
+  uint64_t calls = 0;
+  uint64_t cancelled = 0;
+  uint64_t batches = 0;
+  // Streams opened.
+  uint64_t streams = 0;
+};
+
+// Coalesces the calls of a unary method into batches on the bidirectional
+// streaming method `PrepareAsyncBatches`, whose request and response are
+// batch messages with the calls in a repeated field `calls`:
+//
+//   rpc PingBatches(stream PingBatch) returns (stream PingBatch);
+//
+//   message PingBatch {
+//     repeated Payload calls = 1;
+//   }
+//
+// Not thread-safe: all calls, and the completions, happen on the thread of
+// the GrpcContext, which runs the client. Has to be closed with Close()
+// before it is destroyed, once it was used.
+template <auto PrepareAsyncBatches>
+class CoalescingClient {
+  using StreamRPC = agrpc::ClientRPC<PrepareAsyncBatches>;
+  using RequestBatch = typename StreamRPC::Request;
+  using ResponseBatch = typename StreamRPC::Response;
+
+ public:
+  using Stub = typename StreamRPC::Stub;
+  using Request = std::remove_cvref_t<
+      decltype(std::declval<const RequestBatch&>().calls(0))>;
+  using Response = std::remove_cvref_t<
+      decltype(std::declval<const ResponseBatch&>().calls(0))>;
+
+  CoalescingClient(agrpc::GrpcContext& context, Stub& stub,
+                   const CoalescingClientOptions& options = {})
+      : options_(options), context_(context), stub_(stub), alarm_(context) {
+    CHECK_GT(options_.max_batch, 0u);
+    CHECK_GT(options_.max_in_flight, 0u);
+  }
+
+  CoalescingClient(const CoalescingClient&) = delete;
+  CoalescingClient& operator=(const CoalescingClient&) = delete;
+
+  ~CoalescingClient() {
+    CHECK(rpc_ == nullptr && !timer_pending_)
+        << "CoalescingClient destroyed before Close() completed";
+  }
+
+  // Sends `request` in the next batch and completes with the status of the
+  // call, after `response` was filled in on success. Both have to stay valid
+  // until then, like with agrpc::ClientRPC::request(). The completion
+  // signature is `void(grpc::Status)`.
+  //
+  // Fails with the status of the stream if it broke. Cancellation through
+  // the cancellation slot of the completion handler completes the call with
+  // CANCELLED right away; a call that was sent already is still answered by
+  // the server, but its response is dropped.
+  template <class CompletionToken>
+  auto Call(const Request& request, Response& response,
+            CompletionToken&& token) {
+    return asio::async_initiate<CompletionToken, void(grpc::Status)>(
+        [this, &request, &response](auto handler) {
+          CHECK(!closing_) << "Call() during Close()";
+          ++stats_.calls;
+          auto pending = std::make_unique<Pending>();
+          pending->request = &request;
+          pending->response = &response;
+          pending->slot = asio::get_associated_cancellation_slot(handler);
+          if (pending->slot.is_connected()) {
+            pending->slot.assign([this, p = pending.get()](
+                                     asio::cancellation_type) { Cancel(*p); });
+          }
+          pending->handler = std::move(handler);
+          queued_.push_back(std::move(pending));
+          ++queued_count_;
+          Flush();
+        },
+        token);
+  }
+
+  // Sends the queued calls, waits for all responses and closes the stream.
+  // The completion signature is `void()`. No calls may be started before it
+  // completed; the client may then be destroyed, or used again.
+  template <class CompletionToken>
+  auto Close(CompletionToken&& token) {
+    return asio::async_initiate<CompletionToken, void()>(
+        [this](auto handler) {
+          CHECK(!closing_) << "Close() twice";
+          closing_ = true;
+          close_handler_ = std::move(handler);
+          due_ = true;
+          if (timer_pending_ && options_.window.count() > 0) {
+            alarm_.cancel();
+          }
+          Flush();
+          MaybeClose();
+        },
+        token);
+  }
+
+  const CoalescingClientStats& stats() const { return stats_; }
+
+ private:
+  struct Pending {
+    const Request* request;
+    Response* response;
+    asio::any_completion_handler<void(grpc::Status)> handler;
+    asio::cancellation_slot slot;
+    // Written to the stream, and completed.
+    bool sent = false;
+    bool done = false;
+  };
+
+  using Batch = std::vector<std::unique_ptr<Pending>>;
+
+  // Completes `pending` with `status` on the executor of its handler.
+  void Complete(Pending& pending, grpc::Status status) {
+    pending.done = true;
+    auto executor =
+        asio::get_associated_executor(pending.handler, context_.get_executor());
+    asio::post(executor, [handler = std::move(pending.handler),
+                          status = std::move(status)]() mutable {
+      std::move(handler)(std::move(status));
+    });
+    // Last, as this destroys the cancellation handler if that is the caller.
+    if (pending.slot.is_connected()) {
+      pending.slot.clear();
+    }
+  }
+
+  void Cancel(Pending& pending) {
+    if (pending.done) {
+      return;
+    }
+    ++stats_.cancelled;
+    if (!pending.sent) {
+      --queued_count_;
+    }
+    Complete(pending, grpc::Status::CANCELLED);
+    MaybeClose();
+  }
+
+  // Sends a batch if the stream is ready for it and one is due, opens the
+  // stream if there is none, or arms the timer of the window.
+  void Flush() {
+    if (rpc_ == nullptr && queued_count_ > 0) {
+      Open();
+    }
+    const size_t budget = options_.max_in_flight - in_flight_;
+    if (started_ && !broken_ && !writing_ && !writes_done_ &&
+        queued_count_ > 0 && budget > 0 &&
+        (due_ || queued_count_ >= options_.max_batch)) {
+      Write(std::min({queued_count_, options_.max_batch, budget}));
+    }
+    // The calls left over were queued before the batch was cut, and stay due.
+    if (queued_count_ == 0) {
+      due_ = false;
+    } else if (!due_ && !timer_pending_) {
+      Arm();
+    }
+  }
+
+  void Arm() {
+    timer_pending_ = true;
+    if (options_.window.count() == 0) {
+      asio::post(context_, [this] { OnTimer(); });
+    } else {
+      alarm_.wait(std::chrono::system_clock::now() + options_.window,
+                  [this](bool) { OnTimer(); });
+    }
+  }
+
+  void OnTimer() {
+    timer_pending_ = false;
+    due_ = true;
+    Flush();
+    MaybeClose();
+  }
+
+  void Open() {
+    ++stats_.streams;
+    rpc_ = std::make_unique<StreamRPC>(context_);
+    rpc_->start(stub_, [this](bool ok) {
+      if (!ok) {
+        broken_ = true;
+        MaybeFinish();
+        return;
+      }
+      started_ = true;
+      Read();
+      Flush();
+      MaybeClose();
+    });
+  }
+
+  // Writes the first `n` queued calls that were not cancelled as a batch.
+  void Write(size_t n) {
+    request_batch_.Clear();
+    Batch batch;
+    batch.reserve(n);
+    while (batch.size() < n) {
+      std::unique_ptr<Pending> pending = std::move(queued_.front());
+      queued_.pop_front();
+      if (pending->done) {
+        continue;
+      }
+      *request_batch_.add_calls() = *pending->request;
+      pending->sent = true;
+      batch.push_back(std::move(pending));
+    }
+    queued_count_ -= n;
+    in_flight_ += n;
+    ++stats_.batches;
+    sent_.push_back(std::move(batch));
+    writing_ = true;
+    rpc_->write(request_batch_, [this](bool ok) {
+      writing_ = false;
+      // The read fails as well, and finishes the stream.
+      broken_ |= !ok;
+      Flush();
+      MaybeClose();
+      MaybeFinish();
+    });
+  }
+
+  void Read() {
+    reading_ = true;
+    rpc_->read(response_batch_, [this](bool ok) {
+      reading_ = false;
+      if (!ok) {
+        broken_ = true;
+        MaybeFinish();
+        return;
+      }
+      Deliver();
+      Read();
+      Flush();
+      MaybeClose();
+    });
+  }
+
+  // Completes the calls of the oldest batch with the responses just read.
+  void Deliver() {
+    if (sent_.empty()) {
+      rpc_->cancel();
+      return;
+    }
+    Batch batch = std::move(sent_.front());
+    sent_.pop_front();
+    in_flight_ -= batch.size();
+    const bool matches =
+        static_cast<size_t>(response_batch_.calls_size()) == batch.size();
+    for (size_t i = 0; i < batch.size(); ++i) {
+      Pending& pending = *batch[i];
+      if (pending.done) {
+        continue;
+      }
+      if (!matches) {
+        Complete(pending,
+                 grpc::Status(grpc::StatusCode::INTERNAL,
+                              "batch of " +
+                                  std::to_string(response_batch_.calls_size()) +
+                                  " responses to " +
+                                  std::to_string(batch.size()) + " calls"));
+        continue;
+      }
+      *pending.response = std::move(*response_batch_.mutable_calls(i));
+      Complete(pending, grpc::Status::OK);
+    }
+    if (!matches) {
+      // The responses of the other batches cannot be told apart either.
+      rpc_->cancel();
+    }
+  }
+
+  // Finishes a broken stream once no other operation is outstanding.
+  void MaybeFinish() {
+    if (!broken_ || writing_ || reading_ || finishing_) {
+      return;
+    }
+    finishing_ = true;
+    rpc_->finish([this](grpc::Status status) { OnFinish(std::move(status)); });
+  }
+
+  // Fails the calls sent on the finished stream, and those queued if it
+  // failed, rather than have them wait for a reconnect. Opens a new stream
+  // for the calls left.
+  void OnFinish(grpc::Status status) {
+    if (status.ok()) {
+      status = grpc::Status(grpc::StatusCode::UNAVAILABLE,
+                            "stream closed with calls in flight");
+    } else {
+      for (const auto& pending : queued_) {
+        if (!pending->done) {
+          Complete(*pending, status);
+        }
+      }
+      queued_.clear();
+      queued_count_ = 0;
+    }
+    for (const auto& batch : sent_) {
+      for (const auto& pending : batch) {
+        if (!pending->done) {
+          Complete(*pending, status);
+        }
+      }
+    }
+    sent_.clear();
+    in_flight_ = 0;
+    // Not from within a completion handler of the RPC.
+    asio::post(context_, [this] {
+      rpc_.reset();
+      started_ = broken_ = writes_done_ = finishing_ = false;
+      Flush();
+      MaybeClose();
+    });
+  }
+
+  // Half-closes the stream once Close() drained it, and completes Close()
+  // once the stream finished.
+  void MaybeClose() {
+    if (!closing_ || queued_count_ > 0 || !sent_.empty()) {
+      return;
+    }
+    if (rpc_ != nullptr) {
+      if (started_ && !broken_ && !writing_ && !writes_done_) {
+        writes_done_ = true;
+        writing_ = true;
+        rpc_->writes_done([this](bool) {
+          writing_ = false;
+          MaybeFinish();
+        });
+      }
+      return;
+    }
+    if (timer_pending_) {
+      return;
+    }
+    closing_ = false;
+    due_ = false;
+    queued_.clear();
+    auto executor =
+        asio::get_associated_executor(close_handler_, context_.get_executor());
+    asio::post(executor, std::move(close_handler_));
+  }
+
+  const CoalescingClientOptions options_;
+  agrpc::GrpcContext& context_;
+  Stub& stub_;
+  CoalescingClientStats stats_;
+
+  // Calls not sent yet, of which `queued_count_` were not cancelled.
+  std::deque<std::unique_ptr<Pending>> queued_;
+  size_t queued_count_ = 0;
+  // Batches sent and not answered yet, in order, of `in_flight_` calls.
+  std::deque<Batch> sent_;
+  size_t in_flight_ = 0;
+
+  // The queued calls are due, or the timer of the window is pending.
+  bool due_ = false;
+  bool timer_pending_ = false;
+  agrpc::Alarm alarm_;
+
+  std::unique_ptr<StreamRPC> rpc_;
+  bool started_ = false;
+  // A write, writes_done or read failed, or a read found the end of the
+  // stream.
+  bool broken_ = false;
+  // A write or writes_done is outstanding, and a read.
+  bool writing_ = false;
+  bool reading_ = false;
+  bool writes_done_ = false;
+  bool finishing_ = false;
+  RequestBatch request_batch_;
+  ResponseBatch response_batch_;
+
+  bool closing_ = false;
+  asio::any_completion_handler<void()> close_handler_;
+};
+
+}  // namespace g5::rpc
+
+#endif  // EXPERIMENTAL_RPC_COALESCING_CLIENT_H_
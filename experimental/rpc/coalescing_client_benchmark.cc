@@ -0,0 +1,332 @@
+// Throughput and latency of small unary Pings, each its own RPC or coalesced
+// by a CoalescingClient into PingBatches, over localhost.
+//
+// One server thread answers both. `callers` closed-loop callers on one client
+// thread keep a Ping each outstanding for kDuration, either as a unary RPC or
+// through a CoalescingClient with a window of `window_ms`, where 0 sends the
+// queued calls once the client thread has run the work at hand. A single
+// caller shows the latency the window adds, many the throughput it gains.
+//
+// Reports percentiles of the round trips of the calls, and for the
+// coalesced ones the calls per batch.
+//
+// BM_CancelAndRestart checks the paths that the closed loops never take. A
+// server that holds every batch for kHeldBatch lets the check cancel calls of
+// a batch before and after it was sent. Then it restarts the server on the
+// same port while a batch is held, and the calls of the broken stream fail.
+// Reports the time from the restart to the first call answered on a new
+// stream, which includes the reconnect backoff of the channel.
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "absl/log/check.h"
+#include "asio/awaitable.hpp"
+#include "asio/bind_cancellation_slot.hpp"
+#include "asio/cancellation_signal.hpp"
+#include "asio/cancellation_type.hpp"
+#include "asio/co_spawn.hpp"
+#include "asio/detached.hpp"
+#include "asio/use_awaitable.hpp"
+#include "benchmark/benchmark.h"
+#include "experimental/rpc/benchmark.grpc.pb.h"
+#include "experimental/rpc/benchmark.pb.h"
+#include "experimental/rpc/benchmark_util.h"
+#include "experimental/rpc/coalescing_client.h"
+#include "grpcpp/support/status.h"
+#include "third_party/agrpc/asio_grpc.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using g5::rpc::Benchmark;
+using g5::rpc::Payload;
+using g5::rpc::PingBatch;
+using g5::rpc::PingServerRPC;
+
+using PingBatchesServerRPC =
+    agrpc::ServerRPC<&Benchmark::AsyncService::RequestPingBatches>;
+using PingClient =
+    g5::rpc::CoalescingClient<&Benchmark::Stub::PrepareAsyncPingBatches>;
+
+constexpr auto kDuration = std::chrono::seconds(2);
+// Calls of the batches of BM_CancelAndRestart, the window its client
+// collects them in, and how long its server holds each batch before it
+// answers.
+constexpr int kCheckCalls = 8;
+constexpr auto kCheckWindow = std::chrono::milliseconds(10);
+constexpr auto kHeldBatch = std::chrono::milliseconds(50);
+
+enum class Mode { kUnary, kCoalesced };
+
+asio::awaitable<void> PingBatches(PingBatchesServerRPC& rpc) {
+  PingBatch batch;
+  while (co_await rpc.read(batch, asio::use_awaitable)) {
+    if (!co_await rpc.write(batch, asio::use_awaitable)) {
+      co_return;
+    }
+  }
+  co_await rpc.finish(grpc::Status::OK, asio::use_awaitable);
+}
+
+// Like PingBatches, but answers every batch only after kHeldBatch.
+asio::awaitable<void> HeldPingBatches(PingBatchesServerRPC& rpc) {
+  agrpc::Alarm alarm(rpc.get_executor());
+  PingBatch batch;
+  while (co_await rpc.read(batch, asio::use_awaitable)) {
+    co_await alarm.wait(std::chrono::system_clock::now() + kHeldBatch,
+                        asio::use_awaitable);
+    if (!co_await rpc.write(batch, asio::use_awaitable)) {
+      co_return;
+    }
+  }
+  co_await rpc.finish(grpc::Status::OK, asio::use_awaitable);
+}
+
+asio::awaitable<void> CoalescedPingLoop(
+    PingClient& client, Clock::time_point deadline,
+    std::vector<Clock::duration>* latencies) {
+  const Payload request = g5::rpc::PingRequest();
+  Payload response;
+  while (Clock::now() < deadline) {
+    const auto t0 = Clock::now();
+    const grpc::Status status =
+        co_await client.Call(request, response, asio::use_awaitable);
+    latencies->push_back(Clock::now() - t0);
+    CHECK(status.ok()) << status.error_message();
+  }
+}
+
+template <Mode mode>
+void BM_Ping(benchmark::State& state) {
+  const int n_callers = state.range(0);
+  g5::rpc::CoalescingClientOptions options;
+  if (mode == Mode::kCoalesced) {
+    options.window = std::chrono::milliseconds(state.range(1));
+  }
+
+  g5::rpc::BenchmarkServer server;
+  agrpc::GrpcContext server_context(server.builder().AddCompletionQueue());
+  server.Start();
+  agrpc::register_awaitable_rpc_handler<PingServerRPC>(
+      server_context, server.service(), &g5::rpc::EchoPing, asio::detached);
+  agrpc::register_awaitable_rpc_handler<PingBatchesServerRPC>(
+      server_context, server.service(), &PingBatches, asio::detached);
+
+  std::vector<Clock::duration> latencies;
+  g5::rpc::CoalescingClientStats stats;
+  for (auto _ : state) {
+    const auto t0 = Clock::now();
+    std::jthread server_thread([&] { server_context.run(); });
+    {
+      agrpc::GrpcContext client_context;
+      const std::unique_ptr<Benchmark::Stub> stub = server.NewStub();
+      PingClient client(client_context, *stub, options);
+      const auto deadline = Clock::now() + kDuration;
+      int callers = n_callers;
+      for (int i = 0; i < n_callers; ++i) {
+        if (mode == Mode::kCoalesced) {
+          asio::co_spawn(client_context,
+                         CoalescedPingLoop(client, deadline, &latencies),
+                         [&](std::exception_ptr) {
+                           if (--callers == 0) {
+                             client.Close(asio::detached);
+                           }
+                         });
+        } else {
+          asio::co_spawn(
+              client_context,
+              g5::rpc::PingLoop(client_context, *stub, deadline, &latencies),
+              asio::detached);
+        }
+      }
+      client_context.run();
+      stats = client.stats();
+    }
+    state.SetIterationTime(
+        std::chrono::duration<double>(Clock::now() - t0).count());
+    server.Shutdown();
+  }
+
+  state.SetItemsProcessed(latencies.size());
+  g5::rpc::Percentiles(latencies, {0.5, 0.99}, state);
+  if (mode == Mode::kCoalesced) {
+    state.counters["calls_per_batch"] =
+        static_cast<double>(stats.calls) / stats.batches;
+  }
+}
+
+// A server that holds every batch, see HeldPingBatches, run on a thread of
+// its own until it is destroyed.
+class HeldBatchServer {
+ public:
+  explicit HeldBatchServer(int port)
+      : server_(port), context_(server_.builder().AddCompletionQueue()) {
+    server_.Start();
+    agrpc::register_awaitable_rpc_handler<PingBatchesServerRPC>(
+        context_, server_.service(), &HeldPingBatches, asio::detached);
+    thread_ = std::jthread([this] { context_.run(); });
+  }
+
+  // Cancels the batches it holds. The thread is joined after this, once the
+  // context ran out of work.
+  ~HeldBatchServer() { server_.Shutdown(); }
+
+  const g5::rpc::BenchmarkServer& server() const { return server_; }
+
+ private:
+  g5::rpc::BenchmarkServer server_;
+  agrpc::GrpcContext context_;
+  std::jthread thread_;
+};
+
+// Waits on `alarm` until `done()`, for at most a few seconds.
+asio::awaitable<void> WaitUntil(agrpc::Alarm& alarm,
+                                std::function<bool()> done) {
+  const auto deadline = Clock::now() + std::chrono::seconds(5);
+  while (!done()) {
+    CHECK(Clock::now() < deadline) << "Calls did not complete";
+    co_await alarm.wait(
+        std::chrono::system_clock::now() + std::chrono::milliseconds(1),
+        asio::use_awaitable);
+  }
+}
+
+// Cancels calls of a held batch before and after it was sent, then restarts
+// the server with `restart` while a batch is held. Sets `recovery` to the time
+// from the restart to the first call answered by the new server.
+asio::awaitable<void> CancelAndRestart(agrpc::GrpcContext& context,
+                                       PingClient& client,
+                                       std::function<void()> restart,
+                                       Clock::duration* recovery) {
+  agrpc::Alarm alarm(context);
+  const Payload request = g5::rpc::PingRequest();
+  Payload response;
+  // Opens the stream, so that the batches below are sent after the window.
+  CHECK(co_await client.Call(request, response, asio::use_awaitable).ok());
+
+  std::vector<Payload> responses(kCheckCalls);
+  std::vector<std::optional<grpc::Status>> statuses(kCheckCalls);
+  std::vector<asio::cancellation_signal> signals(kCheckCalls);
+  auto call_all = [&] {
+    for (int i = 0; i < kCheckCalls; ++i) {
+      statuses[i].reset();
+      responses[i].Clear();
+      client.Call(request, responses[i],
+                  asio::bind_cancellation_slot(
+                      signals[i].slot(), [&statuses, i](grpc::Status status) {
+                        statuses[i] = std::move(status);
+                      }));
+    }
+  };
+  auto all_done = [&] {
+    return std::ranges::all_of(
+        statuses, [](const auto& s) { return s.has_value(); });
+  };
+
+  // Call 0 is cancelled while queued and left out of the batch, calls 1 and
+  // 2 once the server holds it. Their responses are dropped on arrival.
+  call_all();
+  signals[0].emit(asio::cancellation_type::terminal);
+  co_await alarm.wait(std::chrono::system_clock::now() + 2 * kCheckWindow,
+                      asio::use_awaitable);
+  signals[1].emit(asio::cancellation_type::terminal);
+  signals[2].emit(asio::cancellation_type::terminal);
+  co_await WaitUntil(alarm, all_done);
+  for (int i = 0; i < kCheckCalls; ++i) {
+    if (i <= 2) {
+      CHECK_EQ(statuses[i]->error_code(), grpc::StatusCode::CANCELLED);
+    } else {
+      CHECK(statuses[i]->ok()) << statuses[i]->error_message();
+      CHECK_EQ(responses[i].data(), request.data());
+    }
+  }
+  CHECK_EQ(client.stats().cancelled, 3u);
+
+  // The restart breaks the stream under the held batch, which fails all of
+  // its calls.
+  call_all();
+  co_await alarm.wait(std::chrono::system_clock::now() + 2 * kCheckWindow,
+                      asio::use_awaitable);
+  const auto t0 = Clock::now();
+  restart();
+  co_await WaitUntil(alarm, all_done);
+  for (const auto& status : statuses) {
+    CHECK(!status->ok());
+  }
+
+  // The next call opens a new stream, once the channel reconnected.
+  for (;;) {
+    const grpc::Status status =
+        co_await client.Call(request, response, asio::use_awaitable);
+    if (status.ok()) {
+      break;
+    }
+    CHECK_EQ(status.error_code(), grpc::StatusCode::UNAVAILABLE)
+        << status.error_message();
+    CHECK(Clock::now() < t0 + std::chrono::seconds(5))
+        << "No stream to the restarted server";
+    co_await alarm.wait(
+        std::chrono::system_clock::now() + std::chrono::milliseconds(1),
+        asio::use_awaitable);
+  }
+  *recovery = Clock::now() - t0;
+  CHECK_GE(client.stats().streams, 2u);
+  co_await client.Close(asio::use_awaitable);
+}
+
+void BM_CancelAndRestart(benchmark::State& state) {
+  Clock::duration recovery{};
+  uint64_t streams = 0;
+  for (auto _ : state) {
+    auto server = std::make_unique<HeldBatchServer>(0);
+    const int port = server->server().port();
+    {
+      agrpc::GrpcContext client_context;
+      const std::unique_ptr<Benchmark::Stub> stub = server->server().NewStub();
+      PingClient client(client_context, *stub, {.window = kCheckWindow});
+      asio::co_spawn(client_context,
+                     CancelAndRestart(
+                         client_context, client,
+                         [&] {
+                           server.reset();
+                           server = std::make_unique<HeldBatchServer>(port);
+                         },
+                         &recovery),
+                     [](std::exception_ptr e) {
+                       if (e) {
+                         std::rethrow_exception(e);
+                       }
+                     });
+      client_context.run();
+      streams = client.stats().streams;
+    }
+    state.SetIterationTime(std::chrono::duration<double>(recovery).count());
+  }
+  state.counters["streams"] = streams;
+}
+
+void PingArgs(benchmark::internal::Benchmark* b) {
+  b->ArgName("callers")->Arg(1)->Arg(256);
+  g5::rpc::RunOnce(b);
+}
+
+void CoalescedPingArgs(benchmark::internal::Benchmark* b) {
+  b->ArgNames({"callers", "window_ms"});
+  b->ArgsProduct({{1, 256}, {0, 1, 5}});
+  g5::rpc::RunOnce(b);
+}
+
+BENCHMARK(BM_Ping<Mode::kUnary>)->Apply(PingArgs);
+BENCHMARK(BM_Ping<Mode::kCoalesced>)->Apply(CoalescedPingArgs);
+BENCHMARK(BM_CancelAndRestart)->Apply(g5::rpc::RunOnce);
+
+}  // namespace
@@ -0,0 +1,323 @@
+// Pool of per-core GrpcContexts for a gRPC server, which spreads the calls it
+// requests over them by load.
+//
+// A GrpcContext with a concurrency_hint above 1 has all its threads share one
+// completion queue, and takes the multithreaded paths of its queue of local
+// work. The pool instead runs one single-threaded context per core, each on a
+// ServerCompletionQueue of its own and pinned to its core, and registers
+// every RPC handler on all of them.
+//
+// gRPC hands an incoming call to a call requested on the completion queue of
+// its connection if there is one, else to one requested on another queue. A
+// shard only serves the calls it has requested, so the pool balances the
+// shards through the number of requested calls each keeps outstanding: every
+// shard looks at the RPCs in flight on all of them from time to time, and
+// requests more calls while it is below the average, fewer while above.
+
+#ifndef EXPERIMENTAL_RPC_GRPC_CONTEXT_POOL_H_
+#define EXPERIMENTAL_RPC_GRPC_CONTEXT_POOL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/log/check.h"
+#include "asio/awaitable.hpp"
+#include "asio/bind_cancellation_slot.hpp"
+#include "asio/cancellation_signal.hpp"
+#include "asio/co_spawn.hpp"
+#include "asio/detached.hpp"
+#include "asio/use_awaitable.hpp"
+#include "experimental/rpc/adaptive_run.h"
+#include "experimental/rpc/arena_pool.h"
+#include "grpcpp/server_builder.h"
+#include "hwy/contrib/thread_pool/topology.h"
+#include "third_party/agrpc/asio_grpc.hpp"
+
+namespace g5::rpc {
+
+struct GrpcContextPoolOptions {
+  // Shards, each with a thread, a completion queue and a GrpcContext. 0 for
+  // one per logical processor the process may run on.
+  int shards = 0;
+  // Pins the thread of every shard to a logical processor of its own.
+  bool pin = true;
+  // Calls each shard keeps requested per registered method while it has as
+  // many RPCs in flight as the average shard, up to `max_slots` while it has
+  // fewer and down to `min_slots` while it has more.
+  int slots = 4;
+  int min_slots = 1;
+  int max_slots = 16;
+  // How often each shard revises its requested calls. Zero keeps `slots`.
+  // gRPC alarms have millisecond resolution.
+  std::chrono::milliseconds rebalance_interval{1};
+  // Runs the shards with RunAdaptive() instead of GrpcContext::run().
+  bool busy_poll = false;
+  // Arenas of each shard, see RegisterWithArena().
+  ArenaPoolOptions arenas;
+};
+
+// Load of one shard, may be read from any thread.
+struct GrpcContextPoolLoad {
+  // RPCs handled so far, and currently in the handler.
+  uint64_t rpcs = 0;
+  int64_t in_flight = 0;
+  // Calls requested per method, last time the shard revised them.
+  int slots = 0;
+};
+
+class GrpcContextPool {
+ public:
+  // Adds a completion queue per shard to `builder`, which must not be built
+  // yet. The pool has to be destroyed before the server it was built into,
+  // like a GrpcContext.
+  GrpcContextPool(grpc::ServerBuilder& builder,
+                  const GrpcContextPoolOptions& options)
+      : options_(options) {
+    CHECK_GE(options_.min_slots, 1);
+    CHECK_LE(options_.min_slots, options_.slots);
+    CHECK_LE(options_.slots, options_.max_slots);
+    hwy::LogicalProcessorSet allowed;
+    if (hwy::GetThreadAffinity(allowed)) {
+      allowed.Foreach([&](size_t lp) { processors_.push_back(lp); });
+    }
+    const size_t n_shards =
+        options_.shards > 0 ? options_.shards
+        : !processors_.empty()
+            ? processors_.size()
+            : std::max(std::thread::hardware_concurrency(), 1u);
+    for (size_t i = 0; i < n_shards; ++i) {
+      shards_.push_back(std::make_unique<Shard>(builder.AddCompletionQueue(),
+                                                options_.arenas));
+    }
+  }
+
+  GrpcContextPool(const GrpcContextPool&) = delete;
+  GrpcContextPool& operator=(const GrpcContextPool&) = delete;
+
+  ~GrpcContextPool() { Join(); }
+
+  size_t size() const { return shards_.size(); }
+
+  agrpc::GrpcContext& context(size_t shard) { return shards_[shard]->context; }
+
+  GrpcContextPoolLoad load(size_t shard) const {
+    const Shard& s = *shards_[shard];
+    return {s.rpcs.load(std::memory_order_relaxed),
+            s.in_flight.load(std::memory_order_relaxed),
+            s.slots.load(std::memory_order_relaxed)};
+  }
+
+  // Serves `ServerRPC` with `handler` on every shard, like
+  // agrpc::register_awaitable_rpc_handler(). `handler` is copied to each
+  // requested call and invoked on the thread of its shard. Must be called
+  // before Start().
+  template <class ServerRPC, class Service, class RPCHandler>
+  void Register(Service& service, RPCHandler handler) {
+    CHECK(threads_.empty()) << "Register() after Start()";
+    for (const auto& shard : shards_) {
+      AddMethod<ServerRPC>(*shard, service, handler);
+    }
+  }
+
+  // Like Register(), but calls `handler` with a recycled Arena of its shard
+  // after its other arguments, see WithArena().
+  template <class ServerRPC, class Service, class RPCHandler>
+  void RegisterWithArena(Service& service, RPCHandler handler) {
+    CHECK(threads_.empty()) << "RegisterWithArena() after Start()";
+    for (const auto& shard : shards_) {
+      AddMethod<ServerRPC>(*shard, service, WithArena(shard->arenas, handler));
+    }
+  }
+
+  // Starts the threads of the shards, after the server was built.
+  void Start() {
+    CHECK(threads_.empty()) << "Start() twice";
+    for (size_t i = 0; i < shards_.size(); ++i) {
+      threads_.emplace_back([this, i] {
+        if (options_.pin && !processors_.empty()) {
+          hwy::LogicalProcessorSet lps;
+          lps.Set(processors_[i % processors_.size()]);
+          hwy::SetThreadAffinity(lps);
+        }
+        Shard& shard = *shards_[i];
+        Request(shard, options_.slots);
+        if (options_.rebalance_interval.count() > 0) {
+          asio::co_spawn(shard.context, Rebalance(shard), asio::detached);
+        }
+        if (options_.busy_poll) {
+          RunAdaptive(shard.context);
+        } else {
+          shard.context.run();
+        }
+      });
+    }
+  }
+
+  // Waits for the shards to run out of work, which they do once the server is
+  // shut down.
+  void Join() { threads_.clear(); }
+
+ private:
+  // A registration of the handler on a shard, which requests the next call
+  // as soon as one arrives, until its signal was emitted. Shared with the
+  // completion handler of the registration, whose cancellation slot refers
+  // to the signal.
+  struct Registration {
+    asio::cancellation_signal signal;
+    // The registration completed: the server shut down, or a handler threw,
+    // which stops its registration like with register_awaitable_rpc_handler().
+    bool done = false;
+  };
+
+  // Calls requested for one registered method on one shard.
+  struct Method {
+    std::function<void(std::shared_ptr<Registration>)> request;
+    // Registrations not emitted yet. The emitted ones still serve the call
+    // they have requested, if any.
+    std::vector<std::shared_ptr<Registration>> requesting;
+  };
+
+  struct Shard {
+    Shard(std::unique_ptr<grpc::ServerCompletionQueue> cq,
+          const ArenaPoolOptions& arena_options)
+        : arenas(arena_options), context(std::move(cq)) {}
+
+    // Written by the thread of the shard on every RPC, read by all.
+    alignas(64) std::atomic<int64_t> in_flight = 0;
+    std::atomic<uint64_t> rpcs = 0;
+    std::atomic<int> slots = 0;
+    // Only used by the thread of the shard.
+    alignas(64) std::vector<std::unique_ptr<Method>> methods;
+    bool closed = false;
+    ArenaPool arenas;
+    // Last, destroyed with its registrations before the signals and the
+    // arenas.
+    agrpc::GrpcContext context;
+  };
+
+  class InFlight {
+   public:
+    explicit InFlight(Shard& shard) : shard_(shard) {
+      internal::Bump(shard_.rpcs);
+      shard_.in_flight.store(
+          shard_.in_flight.load(std::memory_order_relaxed) + 1,
+          std::memory_order_relaxed);
+    }
+
+    ~InFlight() {
+      shard_.in_flight.store(
+          shard_.in_flight.load(std::memory_order_relaxed) - 1,
+          std::memory_order_relaxed);
+    }
+
+   private:
+    Shard& shard_;
+  };
+
+  // Counts the RPCs of `handler` on its shard.
+  template <class RPCHandler>
+  class CountingHandler {
+   public:
+    CountingHandler(Shard& shard, RPCHandler handler)
+        : shard_(&shard), handler_(std::move(handler)) {}
+
+    // Forwarded to agrpc, see WithArena().
+    auto request_message_factory()
+      requires requires(RPCHandler& h) { h.request_message_factory(); }
+    {
+      return handler_.request_message_factory();
+    }
+
+    template <class... Args>
+    asio::awaitable<void> operator()(Args&... args) {
+      const InFlight in_flight(*shard_);
+      co_await std::invoke(handler_, args...);
+    }
+
+   private:
+    Shard* shard_;
+    RPCHandler handler_;
+  };
+
+  template <class ServerRPC, class Service, class RPCHandler>
+  static void AddMethod(Shard& shard, Service& service, RPCHandler handler) {
+    shard.methods.push_back(std::make_unique<Method>());
+    shard.methods.back()->request = [&service, &shard, handler](
+                                        std::shared_ptr<Registration> r) {
+      asio::cancellation_slot slot = r->signal.slot();
+      agrpc::register_awaitable_rpc_handler<ServerRPC>(
+          shard.context, service, CountingHandler<RPCHandler>(shard, handler),
+          asio::bind_cancellation_slot(
+              slot, [r = std::move(r)](std::exception_ptr) { r->done = true; }));
+    };
+  }
+
+  // Keeps `slots` calls requested for every method of `shard`, until one of
+  // its registrations completed. Called on the thread of the shard only.
+  static void Request(Shard& shard, int slots) {
+    for (const auto& method : shard.methods) {
+      for (const auto& r : method->requesting) {
+        shard.closed |= r->done;
+      }
+    }
+    if (shard.closed) {
+      return;
+    }
+    for (const auto& method : shard.methods) {
+      while (method->requesting.size() < static_cast<size_t>(slots)) {
+        method->requesting.push_back(std::make_shared<Registration>());
+        method->request(method->requesting.back());
+      }
+      while (method->requesting.size() > static_cast<size_t>(slots)) {
+        method->requesting.back()->signal.emit(
+            asio::cancellation_type::terminal);
+        method->requesting.pop_back();
+      }
+    }
+    shard.slots.store(slots, std::memory_order_relaxed);
+  }
+
+  // Calls to keep requested on a shard with `in_flight` RPCs, while the
+  // shards average `mean`.
+  int Slots(int64_t in_flight, double mean) const {
+    const long slots =
+        std::lround(options_.slots * (mean + 1) / (in_flight + 1));
+    return std::clamp<long>(slots, options_.min_slots, options_.max_slots);
+  }
+
+  asio::awaitable<void> Rebalance(Shard& shard) {
+    agrpc::Alarm alarm(shard.context);
+    while (!shard.closed) {
+      co_await alarm.wait(
+          std::chrono::system_clock::now() + options_.rebalance_interval,
+          asio::use_awaitable);
+      int64_t total = 0;
+      for (const auto& s : shards_) {
+        total += s->in_flight.load(std::memory_order_relaxed);
+      }
+      Request(shard,
+              Slots(shard.in_flight.load(std::memory_order_relaxed),
+                    static_cast<double>(total) / shards_.size()));
+    }
+  }
+
+  const GrpcContextPoolOptions options_;
+  // Logical processors the process may run on, to pin the shards to.
+  std::vector<size_t> processors_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+  std::vector<std::jthread> threads_;
+};
+
+}  // namespace g5::rpc
+
+#endif  // EXPERIMENTAL_RPC_GRPC_CONTEXT_POOL_H_
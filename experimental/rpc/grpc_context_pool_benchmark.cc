@@ -0,0 +1,177 @@
+// Throughput and latency of a unary Ping server on 1 to N server threads,
+// over localhost, run in one of three ways:
+//
+//   - kShared: one GrpcContext with a concurrency_hint of the thread count,
+//     run by all threads on one completion queue.
+//   - kPool: a GrpcContextPool with a shard per thread.
+//   - kStaticPool: the same with a fixed number of requested calls per
+//     shard, which leaves the balance to gRPC.
+//
+// The handler spins for kWork before it replies, standing in for the work of
+// a real one. Closed-loop clients on kClientThreads threads of their own keep
+// kCallsPerThread Pings outstanding each, over kChannelsPerThread
+// connections, for kDuration. The clients share the host with the server, so
+// the server threads beyond half of the cores mostly measure contention.
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "asio/awaitable.hpp"
+#include "asio/co_spawn.hpp"
+#include "asio/detached.hpp"
+#include "asio/use_awaitable.hpp"
+#include "benchmark/benchmark.h"
+#include "experimental/rpc/benchmark.grpc.pb.h"
+#include "experimental/rpc/benchmark.pb.h"
+#include "experimental/rpc/benchmark_util.h"
+#include "experimental/rpc/grpc_context_pool.h"
+#include "grpcpp/channel.h"
+#include "grpcpp/create_channel.h"
+#include "grpcpp/security/credentials.h"
+#include "grpcpp/support/channel_arguments.h"
+#include "third_party/agrpc/asio_grpc.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using g5::rpc::Benchmark;
+using g5::rpc::Payload;
+using g5::rpc::PingServerRPC;
+
+constexpr auto kWork = std::chrono::microseconds(5);
+constexpr int kClientThreads = 4;
+constexpr int kChannelsPerThread = 2;
+constexpr int kCallsPerThread = 32;
+constexpr auto kDuration = std::chrono::seconds(2);
+
+enum class Mode { kShared, kPool, kStaticPool };
+
+asio::awaitable<void> Ping(PingServerRPC& rpc, Payload& request) {
+  const auto until = Clock::now() + kWork;
+  while (Clock::now() < until) {
+  }
+  co_await rpc.finish(request, grpc::Status::OK, asio::use_awaitable);
+}
+
+// Opens a channel with a connection of its own, instead of the one shared by
+// all channels to the same server.
+std::shared_ptr<grpc::Channel> NewChannel(const std::string& address) {
+  grpc::ChannelArguments args;
+  args.SetInt(GRPC_ARG_USE_LOCAL_SUBCHANNEL_POOL, 1);
+  return grpc::CreateCustomChannel(
+      address, grpc::InsecureChannelCredentials(), args);
+}
+
+// Runs the clients against `address` for kDuration, returns the round trips.
+std::vector<Clock::duration> RunClients(const std::string& address) {
+  std::vector<std::vector<Clock::duration>> latencies(kClientThreads);
+  const auto deadline = Clock::now() + kDuration;
+  {
+    std::vector<std::jthread> threads;
+    for (int i = 0; i < kClientThreads; ++i) {
+      threads.emplace_back([&, i] {
+        agrpc::GrpcContext context;
+        std::vector<std::unique_ptr<Benchmark::Stub>> stubs;
+        for (int c = 0; c < kChannelsPerThread; ++c) {
+          stubs.push_back(Benchmark::NewStub(NewChannel(address)));
+        }
+        for (int c = 0; c < kCallsPerThread; ++c) {
+          asio::co_spawn(context,
+                         g5::rpc::PingLoop(context, *stubs[c % stubs.size()],
+                                           deadline, &latencies[i]),
+                         asio::detached);
+        }
+        context.run();
+      });
+    }
+  }
+  std::vector<Clock::duration> all;
+  for (const auto& l : latencies) {
+    all.insert(all.end(), l.begin(), l.end());
+  }
+  return all;
+}
+
+template <Mode mode>
+void BM_Server(benchmark::State& state) {
+  const int n_threads = state.range(0);
+  g5::rpc::GrpcContextPoolOptions options;
+  options.shards = n_threads;
+  if (mode == Mode::kStaticPool) {
+    options.rebalance_interval = std::chrono::milliseconds(0);
+  }
+
+  g5::rpc::BenchmarkServer server;
+  std::unique_ptr<agrpc::GrpcContext> shared;
+  std::unique_ptr<g5::rpc::GrpcContextPool> pool;
+  if (mode == Mode::kShared) {
+    shared = std::make_unique<agrpc::GrpcContext>(
+        server.builder().AddCompletionQueue(), n_threads);
+  } else {
+    pool = std::make_unique<g5::rpc::GrpcContextPool>(server.builder(),
+                                                      options);
+  }
+  server.Start();
+
+  std::vector<Clock::duration> latencies;
+  for (auto _ : state) {
+    std::vector<std::jthread> threads;
+    if (mode == Mode::kShared) {
+      // As many requested calls as the pool starts with.
+      for (int i = 0; i < n_threads * options.slots; ++i) {
+        agrpc::register_awaitable_rpc_handler<PingServerRPC>(
+            *shared, server.service(), &Ping, asio::detached);
+      }
+      for (int i = 0; i < n_threads; ++i) {
+        threads.emplace_back([&] { shared->run(); });
+      }
+    } else {
+      pool->Register<PingServerRPC>(server.service(), &Ping);
+      pool->Start();
+    }
+
+    const auto t0 = Clock::now();
+    latencies = RunClients(server.address());
+    state.SetIterationTime(
+        std::chrono::duration<double>(Clock::now() - t0).count());
+    server.Shutdown();
+  }
+
+  if (pool != nullptr) {
+    uint64_t total = 0;
+    uint64_t busiest = 0;
+    for (size_t i = 0; i < pool->size(); ++i) {
+      total += pool->load(i).rpcs;
+      busiest = std::max(busiest, pool->load(i).rpcs);
+    }
+    pool->Join();
+    // Share of the busiest shard over that of the average one.
+    state.counters["imbalance"] =
+        static_cast<double>(busiest) * pool->size() / total;
+  }
+
+  state.SetItemsProcessed(latencies.size());
+  g5::rpc::Percentiles(latencies, {0.5, 0.99}, state);
+}
+
+void ServerArgs(benchmark::internal::Benchmark* b) {
+  const int n = std::max(std::thread::hardware_concurrency(), 1u);
+  b->ArgName("threads");
+  for (int threads = 1; threads < n; threads *= 2) {
+    b->Arg(threads);
+  }
+  b->Arg(n);
+  g5::rpc::RunOnce(b);
+}
+
+BENCHMARK(BM_Server<Mode::kShared>)->Apply(ServerArgs);
+BENCHMARK(BM_Server<Mode::kPool>)->Apply(ServerArgs);
+BENCHMARK(BM_Server<Mode::kStaticPool>)->Apply(ServerArgs);
+
+}  // namespace
@@ -0,0 +1,113 @@
+// Report build performance from a bazel compact execlog: critical path,
+// slowest actions and mnemonics, cache hit rates per runner and input size
+// outliers.
+
+#include <string>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/log/check.h"
+#include "absl/log/initialize.h"
+#include "absl/strings/str_format.h"
+#include "google/protobuf/util/json_util.h"
+#include "riegeli/bytes/fd_reader.h"
+#include "riegeli/zstd/zstd_reader.h"
+#include "tools/execlog_analysis.h"
+#include "tools/execlog_analysis.pb.h"
+#include "tools/execlog_compile_commands.h"
+
+ABSL_FLAG(std::string, execlog, "", "Bazel compact execution log file path");
+
+ABSL_FLAG(std::string, format, "text", "Report format, text or json");
+
+ABSL_FLAG(int, top, 20, "Entries of each list of the report");
+
+ABSL_FLAG(double, outlier_sigmas, 3,
+          "Standard deviations above the mean input size of its mnemonic "
+          "from which an action is an outlier");
+
+namespace {
+
+using g5::tools::execlog_analysis::Action;
+using g5::tools::execlog_analysis::Report;
+
+void PrintAction(const Action& action) {
+  absl::PrintF("  %10.3fs  %-20s %-12s %s%s\n", action.seconds(),
+               action.mnemonic(), action.runner(), action.label(),
+               action.cache_hit() ? " (cached)" : "");
+}
+
+void PrintText(const Report& report) {
+  absl::PrintF("%d actions, %.3fs in total\n", report.actions(),
+               report.seconds());
+
+  absl::PrintF("\nCritical path: %.3fs over %d actions\n",
+               report.critical_path_seconds(), report.critical_path_size());
+  for (const Action& action : report.critical_path()) {
+    PrintAction(action);
+  }
+
+  absl::PrintF("\nSlowest actions:\n");
+  for (const Action& action : report.slowest_actions()) {
+    PrintAction(action);
+  }
+
+  absl::PrintF("\nSlowest mnemonics:\n");
+  absl::PrintF("  %-20s %10s %10s %11s %11s\n", "mnemonic", "actions",
+               "cached", "total", "max");
+  for (const auto& mnemonic : report.slowest_mnemonics()) {
+    absl::PrintF("  %-20s %10d %10d %10.3fs %10.3fs\n", mnemonic.name(),
+                 mnemonic.actions(), mnemonic.cache_hits(), mnemonic.seconds(),
+                 mnemonic.max_seconds());
+  }
+
+  absl::PrintF("\nCache hits by runner:\n");
+  for (const auto& runner : report.runners()) {
+    absl::PrintF("  %-20s %10d of %10d %6.1f%%\n", runner.name(),
+                 runner.cache_hits(), runner.actions(),
+                 100 * runner.cache_hit_rate());
+  }
+
+  absl::PrintF("\nInput size outliers:\n");
+  for (const auto& outlier : report.input_outliers()) {
+    const Action& action = outlier.action();
+    absl::PrintF("  %14d bytes, %5.1f sigmas over %14.0f  %-20s %s\n",
+                 action.input_bytes(), outlier.sigmas(),
+                 outlier.mean_input_bytes(), action.mnemonic(),
+                 action.label());
+  }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  absl::InitializeLog();
+  absl::ParseCommandLine(argc, argv);
+
+  const std::string format = absl::GetFlag(FLAGS_format);
+  CHECK(format == "text" || format == "json")
+      << "--format must be text or json";
+  CHECK_GT(absl::GetFlag(FLAGS_top), 0) << "--top must be positive";
+
+  g5::tools::ExecLogAnalyzer analyzer(
+      {.top = absl::GetFlag(FLAGS_top),
+       .outlier_sigmas = absl::GetFlag(FLAGS_outlier_sigmas)});
+  riegeli::ZstdReader<riegeli::FdReader<>> execlog(
+      riegeli::Maker(absl::GetFlag(FLAGS_execlog)));
+  g5::tools::ReadExecLog(execlog, [&](const bazel::ExecLogEntry& entry) {
+    analyzer.Add(entry);
+  });
+  CHECK(execlog.Close()) << execlog.status();
+
+  const Report report = analyzer.Report();
+  if (format == "json") {
+    google::protobuf::util::JsonPrintOptions options;
+    options.always_print_fields_with_no_presence = true;
+    std::string json_string;
+    CHECK_OK(google::protobuf::util::MessageToJsonString(report, &json_string,
+                                                         options));
+    absl::PrintF("%s\n", json_string);
+  } else {
+    PrintText(report);
+  }
+}
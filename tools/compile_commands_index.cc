@@ -0,0 +1,312 @@
+#include "tools/compile_commands_index.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <ranges>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/log/check.h"
+#include "absl/log/log.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "google/protobuf/util/json_util.h"
+#include "riegeli/bytes/fd_reader.h"
+#include "riegeli/bytes/fd_writer.h"
+#include "riegeli/bytes/read_all.h"
+#include "tools/compilation_database.pb.h"
+#include "tools/execlog_compile_commands.h"
+
+namespace g5::tools {
+namespace {
+
+using compilation_database::Command;
+using compilation_database::CompilationDatabase;
+
+// Layout of the index file: the header, the end offsets of the n_sorted keys
+// of the sorted part, their bytes, and up to the end of the file the log of
+// keys appended since, each a native uint32_t size and the bytes.
+struct IndexHeader {
+  char magic[8];
+  // File status of the compile_commands.json the index was written with.
+  uint64_t json_size;
+  int64_t json_mtime_ns;
+  uint64_t json_inode;
+  uint64_t n_sorted;
+  uint64_t log_offset;
+};
+
+constexpr char kMagic[8] = {'C', 'C', 'I', 'N', 'D', 'E', 'X', '3'};
+
+// The log is folded into the sorted part once it holds more keys than this,
+// or an eighth of the sorted part.
+constexpr size_t kMinLogKeys = 4096;
+
+int64_t MtimeNs(const struct stat& st) {
+  return int64_t{st.st_mtim.tv_sec} * 1'000'000'000 + st.st_mtim.tv_nsec;
+}
+
+IndexHeader MakeHeader(const struct stat& json) {
+  IndexHeader header = {};
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.json_size = json.st_size;
+  header.json_mtime_ns = MtimeNs(json);
+  header.json_inode = json.st_ino;
+  return header;
+}
+
+void PwriteAll(int fd, std::string_view data, uint64_t offset,
+               const std::string& path) {
+  while (!data.empty()) {
+    const ssize_t ret = pwrite(fd, data.data(), data.size(), offset);
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    }
+    PCHECK(ret > 0) << "Failed to write " << path;
+    data.remove_prefix(ret);
+    offset += ret;
+  }
+}
+
+// Returns the end of the last element of the JSON array that ends the `size`
+// bytes of `fd`, or of its '[' if it is empty. That is the offset past the
+// last byte other than whitespace before the closing ']'.
+uint64_t ArrayContentEnd(int fd, uint64_t size, const std::string& path) {
+  bool closed = false;
+  char buffer[64];
+  for (uint64_t end = size; end > 0;) {
+    const uint64_t begin = end - std::min<uint64_t>(end, sizeof(buffer));
+    PCHECK(pread(fd, buffer, end - begin, begin) ==
+           static_cast<ssize_t>(end - begin))
+        << "Failed to read " << path;
+    for (uint64_t pos = end; pos > begin; --pos) {
+      const char c = buffer[pos - 1 - begin];
+      if (absl::ascii_isspace(c)) {
+        continue;
+      }
+      if (closed) {
+        return pos;
+      }
+      CHECK_EQ(c, ']') << path << " does not end in a JSON array";
+      closed = true;
+    }
+    end = begin;
+  }
+  LOG(FATAL) << path << " does not end in a JSON array";
+}
+
+}  // namespace
+
+void CompileCommandsIndex::Unmap::operator()(const char* data) const {
+  PCHECK(munmap(const_cast<char*>(data), size) == 0);
+}
+
+std::string_view CompileCommandsIndex::sorted_key(size_t i) const {
+  const uint64_t begin = i > 0 ? key_ends_[i - 1] : 0;
+  return {key_bytes_ + begin, key_ends_[i] - begin};
+}
+
+CompileCommandsIndex CompileCommandsIndex::Load(const std::string& json_path,
+                                                const std::string& index_path) {
+  CompileCommandsIndex index;
+  struct stat json;
+  if (stat(json_path.c_str(), &json) != 0) {
+    PCHECK(errno == ENOENT) << "Failed to stat " << json_path;
+    return index;
+  }
+  index.json_exists_ = true;
+
+  if (const int fd = open(index_path.c_str(), O_RDONLY); fd >= 0) {
+    struct stat st;
+    PCHECK(fstat(fd, &st) == 0);
+    const IndexHeader expected = MakeHeader(json);
+    IndexHeader header;
+    if (static_cast<size_t>(st.st_size) >= sizeof(header) &&
+        pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+        memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 &&
+        header.json_size == expected.json_size &&
+        header.json_mtime_ns == expected.json_mtime_ns &&
+        header.json_inode == expected.json_inode) {
+      void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      PCHECK(data != MAP_FAILED) << "Failed to map " << index_path;
+      index.mapping_ = {static_cast<const char*>(data),
+                        Unmap{static_cast<size_t>(st.st_size)}};
+      const char* begin = index.mapping_.get();
+      const char* end = begin + st.st_size;
+      index.n_sorted_ = header.n_sorted;
+      index.key_ends_ =
+          reinterpret_cast<const uint64_t*>(begin + sizeof(header));
+      index.key_bytes_ =
+          reinterpret_cast<const char*>(index.key_ends_ + header.n_sorted);
+      CHECK(header.log_offset <= static_cast<uint64_t>(st.st_size) &&
+            index.key_bytes_ <= begin + header.log_offset &&
+            (header.n_sorted == 0 ||
+             index.key_bytes_ + index.key_ends_[header.n_sorted - 1] ==
+                 begin + header.log_offset))
+          << "Corrupt index " << index_path;
+
+      for (const char* log = begin + header.log_offset; log < end;) {
+        uint32_t size;
+        CHECK_LE(sizeof(size), static_cast<size_t>(end - log))
+            << "Corrupt index " << index_path;
+        memcpy(&size, log, sizeof(size));
+        log += sizeof(size);
+        CHECK_LE(size, static_cast<size_t>(end - log))
+            << "Corrupt index " << index_path;
+        index.unsorted_.emplace(log, size);
+        log += size;
+      }
+      index.up_to_date_ = true;
+    }
+    PCHECK(close(fd) == 0);
+    if (!index.up_to_date_) {
+      LOG(WARNING) << "Ignoring stale index " << index_path;
+    }
+  }
+  if (index.up_to_date_) {
+    return index;
+  }
+
+  riegeli::FdReader<> reader(json_path);
+  std::string_view json_content;
+  CHECK_OK(riegeli::ReadAll(reader, json_content));
+  CompilationDatabase compilation_database;
+  CHECK_OK(google::protobuf::util::JsonStringToMessage(
+      absl::StrCat("{commands:", json_content, "}"), &compilation_database));
+  for (const Command& command : compilation_database.commands()) {
+    index.unsorted_.insert(absl::StrCat(command.directory(), command.file()));
+  }
+  return index;
+}
+
+size_t CompileCommandsIndex::Merge(const std::vector<Command>& commands,
+                                   int threads) {
+  const auto sorted = std::views::iota(size_t{0}, n_sorted_);
+  std::vector<const Command*> added;
+  for (const Command& command : commands) {
+    std::string key = absl::StrCat(command.directory(), command.file());
+    if (std::ranges::binary_search(
+            sorted, std::string_view(key), {},
+            [this](size_t i) { return sorted_key(i); }) ||
+        !unsorted_.insert(key).second) {
+      continue;
+    }
+    added_keys_.push_back(std::move(key));
+    added.push_back(&command);
+  }
+  std::ranges::move(SerializeCommands(added, threads),
+                    std::back_inserter(added_json_));
+  return added.size();
+}
+
+void CompileCommandsIndex::Write(const std::string& json_path,
+                                 const std::string& index_path) {
+  // The added commands replace the end of the array, from the end of its
+  // last element on.
+  if (!json_exists_ || !added_json_.empty()) {
+    const int fd = open(json_path.c_str(), O_RDWR | O_CREAT, 0644);
+    PCHECK(fd >= 0) << "Failed to open " << json_path;
+    uint64_t pos = 0;
+    std::string json;
+    if (json_exists_) {
+      struct stat st;
+      PCHECK(fstat(fd, &st) == 0);
+      pos = ArrayContentEnd(fd, st.st_size, json_path);
+    } else {
+      json = "[";
+    }
+    if (!added_json_.empty()) {
+      absl::StrAppend(&json, size() > added_json_.size() ? ",\n" : "\n",
+                      absl::StrJoin(added_json_, ",\n"));
+    }
+    // No trailing comma
+    json += "\n]\n";
+    PwriteAll(fd, json, pos, json_path);
+    PCHECK(ftruncate(fd, pos + json.size()) == 0);
+    PCHECK(close(fd) == 0);
+  }
+  struct stat json;
+  PCHECK(stat(json_path.c_str(), &json) == 0)
+      << "Failed to stat " << json_path;
+
+  if (!up_to_date_ ||
+      unsorted_.size() > std::max(kMinLogKeys, n_sorted_ / 8)) {
+    WriteSorted(index_path, json);
+  } else {
+    // Only the header changes in place, after the log grew, so that the
+    // index stays stale if this is interrupted.
+    std::string log;
+    for (const std::string& key : added_keys_) {
+      const uint32_t size = key.size();
+      log.append(reinterpret_cast<const char*>(&size), sizeof(size));
+      log += key;
+    }
+    IndexHeader header;
+    memcpy(&header, mapping_.get(), sizeof(header));
+    const IndexHeader json_header = MakeHeader(json);
+    header.json_size = json_header.json_size;
+    header.json_mtime_ns = json_header.json_mtime_ns;
+    header.json_inode = json_header.json_inode;
+
+    const int fd = open(index_path.c_str(), O_WRONLY);
+    PCHECK(fd >= 0) << "Failed to open " << index_path;
+    PwriteAll(fd, log, mapping_.get_deleter().size, index_path);
+    PwriteAll(fd,
+              std::string_view(reinterpret_cast<const char*>(&header),
+                               sizeof(header)),
+              0, index_path);
+    PCHECK(close(fd) == 0);
+  }
+}
+
+void CompileCommandsIndex::WriteSorted(const std::string& index_path,
+                                       const struct stat& json) const {
+  std::vector<std::string_view> keys;
+  keys.reserve(size());
+  for (size_t i = 0; i < n_sorted_; ++i) {
+    keys.push_back(sorted_key(i));
+  }
+  keys.insert(keys.end(), unsorted_.begin(), unsorted_.end());
+  std::ranges::sort(keys);
+
+  IndexHeader header = MakeHeader(json);
+  header.n_sorted = keys.size();
+  std::vector<uint64_t> key_ends;
+  key_ends.reserve(keys.size());
+  uint64_t key_bytes = 0;
+  for (const std::string_view key : keys) {
+    key_bytes += key.size();
+    key_ends.push_back(key_bytes);
+  }
+  header.log_offset =
+      sizeof(header) + key_ends.size() * sizeof(uint64_t) + key_bytes;
+
+  // Written aside and renamed, as the old index may still be mapped.
+  const std::string tmp_path = index_path + ".tmp";
+  riegeli::FdWriter<> index(tmp_path);
+  index.Write(std::string_view(reinterpret_cast<const char*>(&header),
+                               sizeof(header)));
+  index.Write(std::string_view(reinterpret_cast<const char*>(key_ends.data()),
+                               key_ends.size() * sizeof(uint64_t)));
+  for (const std::string_view key : keys) {
+    index.Write(key);
+  }
+  CHECK(index.Close()) << index.status();
+  PCHECK(rename(tmp_path.c_str(), index_path.c_str()) == 0)
+      << "Failed to rename " << tmp_path << " to " << index_path;
+}
+
+}  // namespace g5::tools
@@ -0,0 +1,91 @@
+// Binary sidecar index of a compile_commands.json.
+//
+// The index holds the key (directory + file) of every command in the JSON, so
+// that an update serializes only the commands with a new key and appends them
+// to the JSON array in place. The commands already in the JSON are neither
+// read nor written again. The index file is mapped: a part sorted by key that
+// is searched in place, then a log of the keys appended since. Loading an up
+// to date index reads the log only, which is folded into the sorted part once
+// it outgrows an eighth of it.
+//
+// An index that doesn't match the size, mtime and inode of its
+// compile_commands.json, e.g. after the file was edited by hand, is ignored.
+// The JSON is parsed once instead and the index written again in full.
+
+#ifndef TOOLS_COMPILE_COMMANDS_INDEX_H_
+#define TOOLS_COMPILE_COMMANDS_INDEX_H_
+
+#include <sys/stat.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "absl/container/flat_hash_set.h"
+#include "tools/compilation_database.pb.h"
+
+namespace g5::tools {
+
+class CompileCommandsIndex {
+ public:
+  // Returns the index of the compile_commands.json at `json_path`, mapped from
+  // `index_path` if it is up to date, otherwise parsed from the JSON. Empty if
+  // there is no JSON.
+  static CompileCommandsIndex Load(const std::string& json_path,
+                                   const std::string& index_path);
+
+  // Adds the commands with a key not in the index yet, the first one of
+  // each key only, serialized on up to `threads` threads. Returns number of
+  // commands added.
+  size_t Merge(const std::vector<compilation_database::Command>& commands,
+               int threads);
+
+  // Appends the commands added since Load() to the compile_commands.json at
+  // `json_path`, or writes it if there is none, and updates the index at
+  // `index_path`. The last call on an index, as it leaves the mapped file
+  // behind.
+  void Write(const std::string& json_path, const std::string& index_path);
+
+  size_t size() const { return n_sorted_ + unsorted_.size(); }
+
+  // Returns whether the index was read from an up to date sidecar.
+  bool up_to_date() const { return up_to_date_; }
+
+ private:
+  struct Unmap {
+    size_t size;
+    void operator()(const char* data) const;
+  };
+
+  // Returns key `i` of the sorted part.
+  std::string_view sorted_key(size_t i) const;
+
+  // Writes the index of the JSON of file status `json` to `index_path`, with
+  // all keys in the sorted part and an empty log.
+  void WriteSorted(const std::string& index_path,
+                   const struct stat& json) const;
+
+  // The index file, if it is up to date. Its sorted part holds n_sorted_ keys,
+  // which end at the offsets key_ends_ into key_bytes_.
+  std::unique_ptr<const char, Unmap> mapping_{nullptr, Unmap{0}};
+  size_t n_sorted_ = 0;
+  const uint64_t* key_ends_ = nullptr;
+  const char* key_bytes_ = nullptr;
+
+  // Keys outside the sorted part: those of the log of the index, or of a
+  // JSON parsed instead, and those added by Merge().
+  absl::flat_hash_set<std::string> unsorted_;
+  // The keys and JSON of the commands added by Merge().
+  std::vector<std::string> added_keys_;
+  std::vector<std::string> added_json_;
+
+  bool json_exists_ = false;
+  bool up_to_date_ = false;
+};
+
+}  // namespace g5::tools
+
+#endif  // TOOLS_COMPILE_COMMANDS_INDEX_H_
@@ -0,0 +1,212 @@
+#include "tools/execlog_analysis.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "google/protobuf/duration.pb.h"
+#include "tools/execlog_analysis.pb.h"
+#include "tools/execlog_compile_commands.h"
+#include "tools/spawn.pb.h"
+
+namespace g5::tools {
+namespace {
+
+int64_t Micros(const google::protobuf::Duration& duration) {
+  return duration.seconds() * 1000000 + duration.nanos() / 1000;
+}
+
+double Seconds(int64_t micros) { return micros / 1e6; }
+
+}  // namespace
+
+ExecLogAnalyzer::Chain ExecLogAnalyzer::ChainOf(uint32_t id) const {
+  if (const auto it = producers_.find(id); it != producers_.end()) {
+    return {spawns_[it->second].chain_micros, it->second};
+  }
+  if (const auto it = chains_.find(id); it != chains_.end()) {
+    return it->second;
+  }
+  return {};
+}
+
+void ExecLogAnalyzer::Add(const bazel::ExecLogEntry& entry) {
+  if (entry.has_input_set()) {
+    Chain chain;
+    for (const uint32_t id : entry.input_set().input_ids()) {
+      chain = std::max(chain, ChainOf(id));
+    }
+    for (const uint32_t id : entry.input_set().transitive_set_ids()) {
+      chain = std::max(chain, ChainOf(id));
+    }
+    // Sets of source files only are most of them, and need no node.
+    if (chain.spawn != kNone) {
+      chains_[entry.id()] = chain;
+    }
+    return;
+  }
+
+  if (entry.has_runfiles_tree()) {
+    const Chain chain = ChainOf(entry.runfiles_tree().input_set_id());
+    if (chain.spawn != kNone) {
+      chains_[entry.id()] = chain;
+    }
+    return;
+  }
+
+  if (entry.has_spawn()) {
+    AddSpawn(entry.spawn());
+  }
+}
+
+void ExecLogAnalyzer::AddSpawn(const bazel::ExecLogEntry::Spawn& spawn) {
+  const uint32_t index = spawns_.size();
+  const Chain inputs = std::max(ChainOf(spawn.input_set_id()),
+                                ChainOf(spawn.tool_set_id()));
+  Spawn& node = spawns_.emplace_back();
+  node.micros = Micros(spawn.metrics().total_time());
+  node.input_bytes = spawn.metrics().input_bytes();
+  node.chain_micros = inputs.micros + node.micros;
+  node.previous = inputs.spawn;
+  node.label = names_.Intern(spawn.target_label());
+  node.mnemonic = names_.Intern(spawn.mnemonic());
+  node.runner = names_.Intern(spawn.runner());
+  node.cache_hit = spawn.cache_hit();
+  micros_ += node.micros;
+
+  for (const auto& output : spawn.outputs()) {
+    if (output.has_output_id()) {
+      producers_[output.output_id()] = index;
+    }
+  }
+
+  PushTop(slowest_, {node.micros, index});
+
+  MnemonicStats& mnemonic = mnemonics_[node.mnemonic];
+  ++mnemonic.actions;
+  mnemonic.cache_hits += node.cache_hit;
+  mnemonic.micros += node.micros;
+  mnemonic.max_micros = std::max(mnemonic.max_micros, node.micros);
+  // Welford's online algorithm.
+  const double delta = node.input_bytes - mnemonic.mean_input_bytes;
+  mnemonic.mean_input_bytes += delta / mnemonic.actions;
+  mnemonic.m2_input_bytes +=
+      delta * (node.input_bytes - mnemonic.mean_input_bytes);
+  PushTop(mnemonic.largest_inputs, {node.input_bytes, index});
+
+  RunnerStats& runner = runners_[node.runner];
+  ++runner.actions;
+  runner.cache_hits += node.cache_hit;
+}
+
+void ExecLogAnalyzer::PushTop(std::vector<std::pair<int64_t, uint32_t>>& heap,
+                              std::pair<int64_t, uint32_t> value) const {
+  if (heap.size() < static_cast<size_t>(options_.top)) {
+    heap.push_back(value);
+    std::ranges::push_heap(heap, std::greater());
+  } else if (!heap.empty() && heap.front() < value) {
+    std::ranges::pop_heap(heap, std::greater());
+    heap.back() = value;
+    std::ranges::push_heap(heap, std::greater());
+  }
+}
+
+execlog_analysis::Action ExecLogAnalyzer::ActionOf(uint32_t spawn) const {
+  const Spawn& node = spawns_[spawn];
+  execlog_analysis::Action action;
+  action.set_label(names_[node.label]);
+  action.set_mnemonic(names_[node.mnemonic]);
+  action.set_runner(names_[node.runner]);
+  action.set_cache_hit(node.cache_hit);
+  action.set_seconds(Seconds(node.micros));
+  action.set_input_bytes(node.input_bytes);
+  return action;
+}
+
+execlog_analysis::Report ExecLogAnalyzer::Report() const {
+  execlog_analysis::Report report;
+  report.set_actions(spawns_.size());
+  report.set_seconds(Seconds(micros_));
+
+  const auto last = std::ranges::max_element(spawns_, {}, &Spawn::chain_micros);
+  if (last != spawns_.end()) {
+    report.set_critical_path_seconds(Seconds(last->chain_micros));
+    std::vector<uint32_t> path;
+    for (uint32_t i = last - spawns_.begin(); i != kNone;
+         i = spawns_[i].previous) {
+      path.push_back(i);
+    }
+    for (auto it = path.rbegin(); it != path.rend(); ++it) {
+      *report.add_critical_path() = ActionOf(*it);
+    }
+  }
+
+  auto slowest = slowest_;
+  std::ranges::sort(slowest, std::greater());
+  for (const auto& [_, spawn] : slowest) {
+    *report.add_slowest_actions() = ActionOf(spawn);
+  }
+
+  std::vector<std::pair<int64_t, uint32_t>> mnemonics;
+  for (const auto& [name, stats] : mnemonics_) {
+    mnemonics.emplace_back(stats.micros, name);
+  }
+  std::ranges::sort(mnemonics, std::greater());
+  mnemonics.resize(std::min<size_t>(mnemonics.size(), options_.top));
+  for (const auto& [_, name] : mnemonics) {
+    const MnemonicStats& stats = mnemonics_.at(name);
+    execlog_analysis::Mnemonic& mnemonic = *report.add_slowest_mnemonics();
+    mnemonic.set_name(names_[name]);
+    mnemonic.set_actions(stats.actions);
+    mnemonic.set_cache_hits(stats.cache_hits);
+    mnemonic.set_seconds(Seconds(stats.micros));
+    mnemonic.set_max_seconds(Seconds(stats.max_micros));
+  }
+
+  std::vector<std::pair<std::string_view, const RunnerStats*>> runners;
+  for (const auto& [name, stats] : runners_) {
+    runners.emplace_back(names_[name], &stats);
+  }
+  std::ranges::sort(runners);
+  for (const auto& [name, stats] : runners) {
+    execlog_analysis::Runner& runner = *report.add_runners();
+    runner.set_name(name);
+    runner.set_actions(stats->actions);
+    runner.set_cache_hits(stats->cache_hits);
+    runner.set_cache_hit_rate(static_cast<double>(stats->cache_hits) /
+                              stats->actions);
+  }
+
+  std::vector<execlog_analysis::InputOutlier> outliers;
+  for (const auto& [_, stats] : mnemonics_) {
+    const double stddev = std::sqrt(stats.m2_input_bytes / stats.actions);
+    if (stddev == 0) {
+      continue;
+    }
+    for (const auto& [input_bytes, spawn] : stats.largest_inputs) {
+      const double sigmas = (input_bytes - stats.mean_input_bytes) / stddev;
+      if (sigmas < options_.outlier_sigmas) {
+        continue;
+      }
+      execlog_analysis::InputOutlier& outlier = outliers.emplace_back();
+      *outlier.mutable_action() = ActionOf(spawn);
+      outlier.set_mean_input_bytes(stats.mean_input_bytes);
+      outlier.set_sigmas(sigmas);
+    }
+  }
+  std::ranges::sort(outliers, std::greater(),
+                    &execlog_analysis::InputOutlier::sigmas);
+  outliers.resize(std::min<size_t>(outliers.size(), options_.top));
+  for (auto& outlier : outliers) {
+    *report.add_input_outliers() = std::move(outlier);
+  }
+  return report;
+}
+
+}  // namespace g5::tools
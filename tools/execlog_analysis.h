@@ -0,0 +1,118 @@
+// Build performance analysis of a Bazel compact execution log.
+//
+// The log is streamed once. Of every spawn only a fixed-size node is kept,
+// with its labels interned, and nothing of the files and input sets but the
+// spawns that produce them:
+//
+// - The critical path is the longest chain of spawns by total time, each
+//   consuming an output of the one before. The longest chain ending in a
+//   spawn is known when the spawn is logged, as the log has the producers of
+//   its inputs before it. Every input set memoizes the latest finishing
+//   producer among its transitive inputs, so no set is ever expanded.
+// - The slowest spawns and the input size outliers are kept in heaps of at
+//   most `top` entries, per mnemonic for the outliers, whose mean and
+//   deviation are only known at the end.
+
+#ifndef TOOLS_EXECLOG_ANALYSIS_H_
+#define TOOLS_EXECLOG_ANALYSIS_H_
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "tools/execlog_analysis.pb.h"
+#include "tools/execlog_compile_commands.h"
+#include "tools/spawn.pb.h"
+
+namespace g5::tools {
+
+class ExecLogAnalyzer {
+ public:
+  struct Options {
+    // Entries of each list of the report.
+    int top = 20;
+    // Standard deviations above the mean of its mnemonic from which the input
+    // size of a spawn is an outlier.
+    double outlier_sigmas = 3;
+  };
+
+  explicit ExecLogAnalyzer(Options options) : options_(options) {}
+
+  // Adds the next entry of the log.
+  void Add(const bazel::ExecLogEntry& entry);
+
+  // Returns the report of the entries added so far.
+  execlog_analysis::Report Report() const;
+
+ private:
+  static constexpr uint32_t kNone = UINT32_MAX;
+
+  struct Spawn {
+    int64_t micros;
+    int64_t input_bytes;
+    // Sum of the times of the longest chain ending in this spawn.
+    int64_t chain_micros;
+    // Previous spawn of that chain.
+    uint32_t previous;
+    uint32_t label;
+    uint32_t mnemonic;
+    uint32_t runner;
+    bool cache_hit;
+  };
+
+  // Latest finishing chain among the producers of a set of inputs.
+  struct Chain {
+    int64_t micros = 0;
+    uint32_t spawn = kNone;
+
+    bool operator<(const Chain& other) const { return micros < other.micros; }
+  };
+
+  struct MnemonicStats {
+    int64_t actions = 0;
+    int64_t cache_hits = 0;
+    int64_t micros = 0;
+    int64_t max_micros = 0;
+    // Running mean and sum of squared deviations of the input bytes.
+    double mean_input_bytes = 0;
+    double m2_input_bytes = 0;
+    // Min-heap by input bytes of the largest inputs.
+    std::vector<std::pair<int64_t, uint32_t>> largest_inputs;
+  };
+
+  struct RunnerStats {
+    int64_t actions = 0;
+    int64_t cache_hits = 0;
+  };
+
+  // Returns the chain of entry `id`, a file, directory, input set or runfiles
+  // tree.
+  Chain ChainOf(uint32_t id) const;
+
+  void AddSpawn(const bazel::ExecLogEntry::Spawn& spawn);
+
+  // Pushes `value` into min-heap `heap`, keeping the top largest.
+  void PushTop(std::vector<std::pair<int64_t, uint32_t>>& heap,
+               std::pair<int64_t, uint32_t> value) const;
+
+  execlog_analysis::Action ActionOf(uint32_t spawn) const;
+
+  const Options options_;
+  // Labels, mnemonics and runners.
+  StringInterner names_;
+  std::vector<Spawn> spawns_;
+  // Producing spawn of output entries.
+  absl::flat_hash_map<uint32_t, uint32_t> producers_;
+  // Chains of the input sets and runfiles trees with a produced input.
+  absl::flat_hash_map<uint32_t, Chain> chains_;
+  // Min-heap by time of the slowest spawns.
+  std::vector<std::pair<int64_t, uint32_t>> slowest_;
+  absl::flat_hash_map<uint32_t, MnemonicStats> mnemonics_;
+  absl::flat_hash_map<uint32_t, RunnerStats> runners_;
+  int64_t micros_ = 0;
+};
+
+}  // namespace g5::tools
+
+#endif  // TOOLS_EXECLOG_ANALYSIS_H_
@@ -0,0 +1,289 @@
+// Benchmarks of ParseExecLog() on a synthetic compact execlog, against the
+// eager flattening of every input set that it replaced, of SerializeCommands()
+// on its commands, on state.range(1) threads, and of updates of a
+// CompileCommandsIndex of all of them: one with all of them again, which adds
+// nothing, and one that adds state.range(1) new commands and writes them.
+//
+// The log has state.range(0) libraries. Each has a source and a header, a
+// compile action whose inputs are its source, the headers of up to three
+// nearby libraries and a shared toolchain, and a lint action over the sources
+// of the libraries before it in the same package.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/log/check.h"
+#include "absl/strings/str_cat.h"
+#include "benchmark/benchmark.h"
+#include "riegeli/bytes/string_reader.h"
+#include "riegeli/bytes/string_writer.h"
+#include "riegeli/messages/parse_message.h"
+#include "riegeli/messages/serialize_message.h"
+#include "tools/compilation_database.pb.h"
+#include "tools/compile_commands_index.h"
+#include "tools/execlog_compile_commands.h"
+#include "tools/spawn.pb.h"
+
+namespace g5::tools {
+namespace {
+
+using compilation_database::Command;
+
+constexpr int kPackageSize = 64;
+constexpr int kToolchainFiles = 256;
+constexpr int kDepsWindow = 32;
+
+// Returns a compact execlog of `libraries` libraries, length-prefixed.
+std::string SyntheticExecLog(int libraries) {
+  std::string execlog;
+  riegeli::StringWriter writer(&execlog);
+  uint32_t next_id = 1;
+  auto write = [&](bazel::ExecLogEntry& entry) {
+    entry.set_id(next_id++);
+    CHECK_OK(riegeli::SerializeLengthPrefixedMessage(entry, writer));
+    return entry.id();
+  };
+
+  bazel::ExecLogEntry entry;
+  bazel::ExecLogEntry toolchain;
+  for (int i = 0; i < kToolchainFiles; ++i) {
+    entry.mutable_file()->set_path(
+        absl::StrCat("external/toolchain/include/header_", i, ".h"));
+    toolchain.mutable_input_set()->add_input_ids(write(entry));
+  }
+  const uint32_t toolchain_id = write(toolchain);
+
+  std::mt19937 rng(libraries);
+  std::vector<uint32_t> hdrs_ids;
+  uint32_t srcs_id = 0;
+  for (int i = 0; i < libraries; ++i) {
+    const std::string package = absl::StrCat("pkg", i / kPackageSize);
+    entry.Clear();
+    entry.mutable_file()->set_path(absl::StrCat(package, "/lib", i, ".cc"));
+    const uint32_t src_id = write(entry);
+    entry.Clear();
+    entry.mutable_file()->set_path(absl::StrCat(package, "/lib", i, ".h"));
+    const uint32_t hdr_id = write(entry);
+
+    std::vector<uint32_t> deps;
+    for (int j = 0; j < 3 && i > 0; ++j) {
+      const int low = std::max(0, i - kDepsWindow);
+      deps.push_back(hdrs_ids[std::uniform_int_distribution(low, i - 1)(rng)]);
+    }
+
+    entry.Clear();
+    entry.mutable_input_set()->add_input_ids(hdr_id);
+    for (const uint32_t dep : deps) {
+      entry.mutable_input_set()->add_transitive_set_ids(dep);
+    }
+    hdrs_ids.push_back(write(entry));
+
+    entry.Clear();
+    entry.mutable_input_set()->add_input_ids(src_id);
+    if (i % kPackageSize != 0) {
+      entry.mutable_input_set()->add_transitive_set_ids(srcs_id);
+    }
+    srcs_id = write(entry);
+
+    entry.Clear();
+    entry.mutable_input_set()->add_input_ids(src_id);
+    entry.mutable_input_set()->add_transitive_set_ids(toolchain_id);
+    for (const uint32_t dep : deps) {
+      entry.mutable_input_set()->add_transitive_set_ids(dep);
+    }
+    const uint32_t compile_id = write(entry);
+
+    const std::string label = absl::StrCat("//", package, ":lib", i);
+    entry.Clear();
+    auto* spawn = entry.mutable_spawn();
+    spawn->set_mnemonic("CppCompile");
+    spawn->set_target_label(label);
+    spawn->set_input_set_id(compile_id);
+    for (const char* arg : {"clang", "-std=c++23", "-O2", "-c"}) {
+      spawn->add_args(arg);
+    }
+    spawn->add_args(absl::StrCat(package, "/lib", i, ".cc"));
+    write(entry);
+
+    entry.Clear();
+    spawn = entry.mutable_spawn();
+    spawn->set_mnemonic("Lint");
+    spawn->set_target_label(label);
+    spawn->set_input_set_id(srcs_id);
+    write(entry);
+  }
+  CHECK(writer.Close());
+  return execlog;
+}
+
+// The eager algorithm: every input set holds a copy of all of its transitive
+// sources.
+std::vector<Command> FlattenExecLog(riegeli::Reader& reader,
+                                    std::string_view directory) {
+  absl::flat_hash_map<uint32_t, std::string> files;
+  absl::flat_hash_map<uint32_t, std::vector<std::string>> source_files;
+
+  bazel::ExecLogEntry log_entry;
+  std::vector<Command> commands;
+  while (riegeli::ParseLengthPrefixedMessage(reader, log_entry).ok()) {
+    if (log_entry.has_file()) {
+      files[log_entry.id()] = log_entry.file().path();
+      continue;
+    }
+
+    if (log_entry.has_input_set()) {
+      for (uint32_t input_id : log_entry.input_set().input_ids()) {
+        if (IsCppSourceFile(files[input_id])) {
+          source_files[log_entry.id()].push_back(files[input_id]);
+        }
+      }
+      for (uint32_t input_set_id : log_entry.input_set().transitive_set_ids()) {
+        source_files[log_entry.id()].append_range(source_files[input_set_id]);
+      }
+      continue;
+    }
+
+    if (!(log_entry.spawn().mnemonic() == "CppCompile")) {
+      continue;
+    }
+
+    auto it = source_files.find(log_entry.spawn().input_set_id());
+    if (it == source_files.end() || it->second.size() != 1) {
+      continue;
+    }
+    Command command;
+    command.set_directory(directory);
+    command.set_file(it->second[0]);
+    for (const auto& arg : log_entry.spawn().args()) {
+      command.add_arguments(arg);
+    }
+    commands.push_back(std::move(command));
+  }
+  return commands;
+}
+
+template <auto Parse>
+void BM_ParseExecLog(benchmark::State& state) {
+  const std::string execlog = SyntheticExecLog(state.range(0));
+  size_t commands = 0;
+  for (auto _ : state) {
+    riegeli::StringReader reader(execlog);
+    commands = Parse(reader, "/src").size();
+    benchmark::DoNotOptimize(commands);
+  }
+  CHECK_EQ(commands, state.range(0));
+  state.SetBytesProcessed(execlog.size() * state.iterations());
+  state.SetItemsProcessed(commands * state.iterations());
+}
+
+// Returns the commands of a synthetic execlog of `libraries` libraries.
+std::vector<Command> SyntheticCommands(int libraries) {
+  const std::string execlog = SyntheticExecLog(libraries);
+  riegeli::StringReader reader(execlog);
+  return ParseExecLog(reader, "/src");
+}
+
+void BM_SerializeCommands(benchmark::State& state) {
+  const std::vector<Command> commands = SyntheticCommands(state.range(0));
+  std::vector<const Command*> pointers;
+  for (const Command& command : commands) {
+    pointers.push_back(&command);
+  }
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(SerializeCommands(pointers, state.range(1)));
+  }
+  state.SetItemsProcessed(commands.size() * state.iterations());
+}
+
+// Writes an index of `commands` to a temporary compile_commands.json, and
+// removes both files when destroyed.
+class IndexFiles {
+ public:
+  explicit IndexFiles(const std::vector<Command>& commands)
+      : json_path_(std::filesystem::temp_directory_path() /
+                   "execlog_benchmark.json"),
+        index_path_(json_path_ + ".index") {
+    std::filesystem::remove(json_path_);
+    CompileCommandsIndex index =
+        CompileCommandsIndex::Load(json_path_, index_path_);
+    index.Merge(commands, /*threads=*/8);
+    index.Write(json_path_, index_path_);
+  }
+
+  ~IndexFiles() {
+    std::filesystem::remove(json_path_);
+    std::filesystem::remove(index_path_);
+  }
+
+  const std::string& json_path() const { return json_path_; }
+  const std::string& index_path() const { return index_path_; }
+
+ private:
+  std::string json_path_;
+  std::string index_path_;
+};
+
+void BM_NoopUpdateIndex(benchmark::State& state) {
+  const std::vector<Command> commands = SyntheticCommands(state.range(0));
+  const IndexFiles files(commands);
+  for (auto _ : state) {
+    CompileCommandsIndex index =
+        CompileCommandsIndex::Load(files.json_path(), files.index_path());
+    CHECK(index.up_to_date());
+    CHECK_EQ(index.Merge(commands, /*threads=*/8), 0);
+  }
+  state.SetItemsProcessed(commands.size() * state.iterations());
+}
+
+// Updates after a small incremental build, whose execlog only has a few
+// commands, all of them new. Includes folding the log of the index into its
+// sorted part every so often.
+void BM_UpdateIndex(benchmark::State& state) {
+  const std::vector<Command> commands = SyntheticCommands(state.range(0));
+  const IndexFiles files(commands);
+  std::vector<Command> added(state.range(1), commands.front());
+  int64_t n = 0;
+  for (auto _ : state) {
+    state.PauseTiming();
+    for (Command& command : added) {
+      command.set_file(absl::StrCat("added/", n++, ".cc"));
+    }
+    state.ResumeTiming();
+    CompileCommandsIndex index =
+        CompileCommandsIndex::Load(files.json_path(), files.index_path());
+    CHECK(index.up_to_date());
+    CHECK_EQ(index.Merge(added, /*threads=*/1), added.size());
+    index.Write(files.json_path(), files.index_path());
+  }
+  state.SetItemsProcessed(added.size() * state.iterations());
+}
+
+BENCHMARK(BM_ParseExecLog<ParseExecLog>)
+    ->RangeMultiplier(10)
+    ->Range(1000, 100000)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ParseExecLog<FlattenExecLog>)
+    ->RangeMultiplier(10)
+    ->Range(1000, 100000)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_SerializeCommands)
+    ->ArgsProduct({{100000}, {1, 2, 4, 8}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+BENCHMARK(BM_NoopUpdateIndex)
+    ->RangeMultiplier(10)
+    ->Range(1000, 100000)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_UpdateIndex)
+    ->ArgsProduct({{1000, 10000, 100000}, {1, 10}})
+    ->Unit(benchmark::kMillisecond);
+
+}  // namespace
+}  // namespace g5::tools
@@ -0,0 +1,300 @@
+#include "tools/execlog_compile_commands.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/log/check.h"
+#include "absl/log/log.h"
+#include "absl/functional/function_ref.h"
+#include "absl/types/span.h"
+#include "google/protobuf/util/json_util.h"
+#include "riegeli/bytes/reader.h"
+#include "riegeli/varint/varint_reading.h"
+#include "tools/compilation_database.pb.h"
+#include "tools/spawn.pb.h"
+
+namespace g5::tools {
+
+using compilation_database::Command;
+
+namespace {
+
+// Serialized log entries, handed from the framing thread to the handling one
+// in batches to keep the locking off the per-entry path.
+using Batch = std::vector<std::string>;
+
+constexpr size_t kBatchEntries = 1024;
+// Batches in flight, bounds the memory taken when handling falls behind.
+constexpr size_t kMaxBatches = 16;
+
+class BatchQueue {
+ public:
+  // Waits for room and adds `batch`. Returns false once `stop` is requested.
+  bool Push(Batch batch, std::stop_token stop) {
+    {
+      std::unique_lock lock(mu_);
+      if (!cv_.wait(lock, stop,
+                    [this] { return batches_.size() < kMaxBatches; })) {
+        return false;
+      }
+      batches_.push_back(std::move(batch));
+    }
+    cv_.notify_all();
+    return true;
+  }
+
+  // Marks the end of the batches.
+  void Close() {
+    {
+      std::lock_guard lock(mu_);
+      closed_ = true;
+    }
+    cv_.notify_all();
+  }
+
+  // Waits for the next batch. Returns false once closed and drained.
+  bool Pop(Batch* batch) {
+    {
+      std::unique_lock lock(mu_);
+      cv_.wait(lock, [this] { return !batches_.empty() || closed_; });
+      if (batches_.empty()) {
+        return false;
+      }
+      *batch = std::move(batches_.front());
+      batches_.pop_front();
+    }
+    cv_.notify_all();
+    return true;
+  }
+
+ private:
+  std::mutex mu_;
+  std::condition_variable_any cv_;
+  std::deque<Batch> batches_;
+  bool closed_ = false;
+};
+
+// Cuts the length-prefixed entries read from `reader` into batches until the
+// end of input, or until a truncated entry.
+void FrameExecLog(riegeli::Reader& reader, BatchQueue& queue,
+                  std::stop_token stop) {
+  Batch batch;
+  for (;;) {
+    uint32_t size;
+    std::string entry;
+    if (!riegeli::ReadVarint32(reader, size) || !reader.Read(size, entry)) {
+      break;
+    }
+    batch.push_back(std::move(entry));
+    if (batch.size() == kBatchEntries) {
+      if (!queue.Push(std::move(batch), stop)) {
+        return;
+      }
+      batch.clear();
+    }
+  }
+  if (!batch.empty()) {
+    queue.Push(std::move(batch), stop);
+  }
+  queue.Close();
+}
+
+}  // namespace
+
+bool IsCppSourceFile(std::string_view path) {
+  return path.ends_with(".cc") || path.ends_with(".cpp") ||
+         path.ends_with(".cxx") || path.ends_with(".c++") ||
+         path.ends_with(".c");
+}
+
+uint32_t StringInterner::Intern(std::string_view s) {
+  auto it = ids_.find(s);
+  if (it == ids_.end()) {
+    // Keyed by the interned copy, which a deque never moves.
+    strings_.emplace_back(s);
+    it = ids_.emplace(strings_.back(), strings_.size() - 1).first;
+  }
+  return it->second;
+}
+
+void InputSetResolver::AddFile(uint32_t id, std::string_view path) {
+  if (!IsCppSourceFile(path)) {
+    return;
+  }
+  sources_[id] = paths_.Intern(path);
+}
+
+void InputSetResolver::AddInputSet(uint32_t id,
+                                   const bazel::ExecLogEntry::InputSet& set) {
+  Node node;
+  node.begin = edges_.size();
+  for (const uint32_t input_id : set.input_ids()) {
+    if (const auto it = sources_.find(input_id); it != sources_.end()) {
+      edges_.push_back(it->second);
+    }
+  }
+  node.n_sources = edges_.size() - node.begin;
+  for (const uint32_t set_id : set.transitive_set_ids()) {
+    // Sets without any node never contribute a source.
+    if (nodes_.contains(set_id)) {
+      edges_.push_back(set_id);
+    }
+  }
+  node.n_children = edges_.size() - node.begin - node.n_sources;
+  nodes_[id] = node;
+}
+
+uint32_t InputSetResolver::Combine(uint32_t a, uint32_t b) {
+  if (a == kNoSource) {
+    return b;
+  }
+  if (b == kNoSource || a == b) {
+    return a;
+  }
+  return kManySources;
+}
+
+uint32_t InputSetResolver::Resolve(uint32_t id) {
+  const auto root = nodes_.find(id);
+  if (root == nodes_.end()) {
+    return kNoSource;
+  }
+  if (root->second.memo != kUnresolved) {
+    return root->second.memo;
+  }
+
+  // Depth-first over the nodes not resolved yet, with an explicit stack as
+  // the DAG can be deeper than the call stack allows.
+  struct Frame {
+    Node* node;
+    uint32_t next_child = 0;
+    uint32_t result = kNoSource;
+  };
+  auto enter = [this](Node* node) {
+    Frame frame{node};
+    for (uint32_t i = 0; i < node->n_sources; ++i) {
+      frame.result = Combine(frame.result, edges_[node->begin + i]);
+    }
+    return frame;
+  };
+
+  std::vector<Frame> stack = {enter(&root->second)};
+  for (;;) {
+    Frame& frame = stack.back();
+    Node* node = frame.node;
+    // A second source settles the set, whatever else is below it.
+    if (frame.result == kManySources || frame.next_child == node->n_children) {
+      node->memo = frame.result;
+      stack.pop_back();
+      if (stack.empty()) {
+        return node->memo;
+      }
+      stack.back().result = Combine(stack.back().result, node->memo);
+      continue;
+    }
+
+    const uint32_t child_id =
+        edges_[node->begin + node->n_sources + frame.next_child++];
+    Node* child = &nodes_.find(child_id)->second;
+    if (child->memo == kUnresolved) {
+      stack.push_back(enter(child));
+    } else {
+      frame.result = Combine(frame.result, child->memo);
+    }
+  }
+}
+
+void ReadExecLog(riegeli::Reader& reader,
+                 absl::FunctionRef<void(const bazel::ExecLogEntry&)> handle) {
+  BatchQueue queue;
+  // Joined before `queue` goes away, also when stopped early.
+  std::jthread framing([&reader, &queue](std::stop_token stop) {
+    FrameExecLog(reader, queue, stop);
+  });
+
+  bazel::ExecLogEntry log_entry;
+  Batch batch;
+  while (queue.Pop(&batch)) {
+    for (const std::string& entry : batch) {
+      CHECK(log_entry.ParseFromString(entry)) << "Corrupt execlog entry";
+      handle(log_entry);
+    }
+  }
+}
+
+std::vector<Command> ParseExecLog(riegeli::Reader& reader,
+                                  std::string_view directory) {
+  InputSetResolver resolver;
+  std::vector<Command> commands;
+  ReadExecLog(reader, [&](const bazel::ExecLogEntry& log_entry) {
+    if (log_entry.has_file()) {
+      resolver.AddFile(log_entry.id(), log_entry.file().path());
+      return;
+    }
+
+    if (log_entry.has_input_set()) {
+      resolver.AddInputSet(log_entry.id(), log_entry.input_set());
+      return;
+    }
+
+    if (!(log_entry.spawn().mnemonic() == "CppCompile")) {
+      return;
+    }
+
+    const uint32_t source = resolver.Resolve(log_entry.spawn().input_set_id());
+    if (source == InputSetResolver::kNoSource) {
+      LOG(WARNING) << "C/C++ source file not found: "
+                   << log_entry.spawn().target_label();
+      return;
+    }
+    if (source == InputSetResolver::kManySources) {
+      LOG(ERROR) << "Multiple C/C++ source file found: "
+                 << log_entry.spawn().target_label();
+      return;
+    }
+
+    Command command;
+    command.set_directory(directory);
+    command.set_file(resolver.path(source));
+
+    for (const auto& arg : log_entry.spawn().args()) {
+      command.add_arguments(arg);
+    }
+    commands.push_back(std::move(command));
+  });
+
+  return commands;
+}
+
+std::vector<std::string> SerializeCommands(
+    absl::Span<const Command* const> commands, int threads) {
+  // Every thread serializes a contiguous range of the commands.
+  const size_t n_threads =
+      std::clamp<size_t>(threads, 1, std::max<size_t>(commands.size(), 1));
+  std::vector<std::string> json(commands.size());
+  std::vector<std::jthread> workers;
+  for (size_t i = 0; i < n_threads; ++i) {
+    workers.emplace_back([&, i] {
+      const size_t begin = commands.size() * i / n_threads;
+      const size_t end = commands.size() * (i + 1) / n_threads;
+      for (size_t j = begin; j < end; ++j) {
+        CHECK_OK(
+            google::protobuf::util::MessageToJsonString(*commands[j], &json[j]));
+      }
+    });
+  }
+  workers.clear();
+  return json;
+}
+
+}  // namespace g5::tools
@@ -0,0 +1,111 @@
+// Extraction of clangd compile commands from a Bazel compact execution log.
+//
+// The compact execlog lists every file once and describes the inputs of a
+// spawn as a DAG of nested input sets. Paths of C++ sources are interned, all
+// other files are dropped, and input sets are kept as shared DAG nodes. Only
+// the sets of CppCompile spawns are expanded, lazily, with memoization per
+// node, and no further than needed to tell whether there is exactly one
+// source.
+//
+// Reading the log is pipelined: a framing thread decompresses it and cuts it
+// into serialized entries while the calling thread parses and handles them.
+// The JSON of the commands is serialized on a pool of threads.
+
+#ifndef TOOLS_EXECLOG_COMPILE_COMMANDS_H_
+#define TOOLS_EXECLOG_COMPILE_COMMANDS_H_
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/functional/function_ref.h"
+#include "absl/types/span.h"
+#include "riegeli/bytes/reader.h"
+#include "tools/compilation_database.pb.h"
+#include "tools/spawn.pb.h"
+
+namespace g5::tools {
+
+bool IsCppSourceFile(std::string_view path);
+
+// Keeps one copy of each distinct string and numbers them densely in the
+// order they were first seen.
+class StringInterner {
+ public:
+  // Returns the id of `s`, adding it if it is new.
+  uint32_t Intern(std::string_view s);
+
+  // Returns the string of `id`.
+  std::string_view operator[](uint32_t id) const { return strings_[id]; }
+
+ private:
+  std::deque<std::string> strings_;
+  absl::flat_hash_map<std::string_view, uint32_t> ids_;
+};
+
+// Resolves the C++ source of input sets.
+class InputSetResolver {
+ public:
+  // Results of Resolve() other than a path id.
+  static constexpr uint32_t kNoSource = UINT32_MAX;
+  static constexpr uint32_t kManySources = UINT32_MAX - 1;
+
+  // Records file entry `id`, if it is a C++ source.
+  void AddFile(uint32_t id, std::string_view path);
+
+  // Records input set entry `id`.
+  void AddInputSet(uint32_t id, const bazel::ExecLogEntry::InputSet& set);
+
+  // Returns the path id of the only C++ source among the transitive inputs of
+  // set `id`, kNoSource if there is none or kManySources if there are more.
+  uint32_t Resolve(uint32_t id);
+
+  // Returns the path of `path_id`.
+  std::string_view path(uint32_t path_id) const { return paths_[path_id]; }
+
+ private:
+  // Memo of a node that was not resolved yet.
+  static constexpr uint32_t kUnresolved = UINT32_MAX - 2;
+
+  struct Node {
+    // Path ids of the direct sources, followed by the ids of the nested sets,
+    // in `edges_`.
+    uint32_t begin;
+    uint32_t n_sources;
+    uint32_t n_children;
+    uint32_t memo = kUnresolved;
+  };
+
+  // Returns the combined result of two disjoint parts of an input set.
+  static uint32_t Combine(uint32_t a, uint32_t b);
+
+  StringInterner paths_;
+  // Path id of the file entries that are C++ sources.
+  absl::flat_hash_map<uint32_t, uint32_t> sources_;
+  absl::flat_hash_map<uint32_t, Node> nodes_;
+  std::vector<uint32_t> edges_;
+};
+
+// Calls `handle` on every entry of the compact execlog read from `reader`, as
+// length-prefixed ExecLogEntry messages. `reader` is read and framed on a
+// thread of its own, `handle` runs on the calling thread.
+void ReadExecLog(riegeli::Reader& reader,
+                 absl::FunctionRef<void(const bazel::ExecLogEntry&)> handle);
+
+// Returns a command for the CppCompile spawns of the compact execlog read from
+// `reader`, as length-prefixed ExecLogEntry messages, run in `directory`.
+std::vector<compilation_database::Command> ParseExecLog(
+    riegeli::Reader& reader, std::string_view directory);
+
+// Returns the JSON of each of `commands`, serialized on up to `threads`
+// threads.
+std::vector<std::string> SerializeCommands(
+    absl::Span<const compilation_database::Command* const> commands,
+    int threads);
+
+}  // namespace g5::tools
+
+#endif  // TOOLS_EXECLOG_COMPILE_COMMANDS_H_